@@ -0,0 +1,246 @@
+// Machaira: BenchFixture.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file builds the synthetic SWORD library used by the benchmarks from
+// the module configs in Res/Fixture, so they can run offline
+// Current version: Pre-release
+
+#include "BenchFixture.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstdio>
+
+#include <swmgr.h>
+#include <swmodule.h>
+#include <versekey.h>
+#include <rawtext.h>
+#include <ztext.h>
+#include <rawcom.h>
+#include <rawld.h>
+
+namespace
+{
+  // Small deterministic generator so every run benchmarks identical text
+  class FixtureRandom
+  {
+    public:
+      FixtureRandom(unsigned int seed) : state(seed) {}
+      unsigned int Next(unsigned int n)
+      {
+        state = state*1103515245u + 12345u;
+        return (state >> 8) % n;
+      }
+    private:
+      unsigned int state;
+  };
+
+  const char * english_words[] = {"and", "the", "word", "was", "with", "God",
+    "light", "life", "in", "him", "world", "grace", "truth", "glory",
+    "believe", "sent", "came", "witness", "darkness", "men", "made", "name"};
+  const char * greek_words[] = {"\xce\xbb\xcf\x8c\xce\xb3\xce\xbf\xcf\x82",
+    "\xce\xb8\xce\xb5\xcf\x8c\xcf\x82", "\xcf\x86\xe1\xbf\xb6\xcf\x82",
+    "\xce\xb6\xcf\x89\xce\xae", "\xe1\xbc\x80\xce\xbb\xce\xae\xce\xb8\xce\xb5\xce\xb9\xce\xb1"};
+  const char * morph_codes[] = {"N-NSM", "V-IAI-3S", "T-NSM", "CONJ", "PREP",
+    "N-GSF", "V-AAP-NPM"};
+  const char * cross_refs[] = {"Gen.1.1", "Gen.1.3", "Rom.8.28", "Rom.8.1",
+    "John.1.1", "John.3.16", "John.14.6", "Gen.1.26-Gen.1.27"};
+
+  std::string VerseText(FixtureRandom & rng, int verse_number)
+  {
+    std::stringstream ss;
+    bool red_letter = (rng.Next(4) == 0);
+    if(verse_number == 1) ss << "<title>Chapter heading</title>";
+    if(red_letter) ss << "<q who=\"Jesus\" marker=\"\">";
+    int words = 12 + rng.Next(20);
+    for(int n = 0; n < words; n++)
+    {
+      ss << "<w lemma=\"strong:G" << (1 + rng.Next(5624)) << "\" morph=\"robinson:"
+        << morph_codes[rng.Next(7)] << "\">"
+        << english_words[rng.Next(22)] << "</w> ";
+      if(rng.Next(10) == 0) ss << "(" << greek_words[rng.Next(5)] << ") ";
+    }
+    if(red_letter) ss << "</q>";
+    if(rng.Next(3) == 0)
+    {
+      const char * ref = cross_refs[rng.Next(8)];
+      ss << "<note type=\"crossReference\" n=\"a\"><reference osisRef=\""
+        << ref << "\">" << ref << "</reference></note>";
+    }
+    if(rng.Next(5) == 0) ss << "<note type=\"explanation\" n=\"1\">Or, "
+      << english_words[rng.Next(22)] << "</note>";
+    return ss.str();
+  }
+
+  std::string CommentaryText(FixtureRandom & rng, int paragraphs)
+  {
+    std::stringstream ss;
+    for(int p = 0; p < paragraphs; p++)
+    {
+      ss << "<div type=\"paragraph\">";
+      int sentences = 3 + rng.Next(5);
+      for(int n = 0; n < sentences; n++)
+      {
+        int words = 8 + rng.Next(16);
+        for(int w = 0; w < words; w++) ss << english_words[rng.Next(22)] << ' ';
+        if(rng.Next(4) == 0) ss << greek_words[rng.Next(5)] << ' ';
+        const char * ref = cross_refs[rng.Next(8)];
+        ss << "(<reference osisRef=\"" << ref << "\">" << ref << "</reference>). ";
+      }
+      ss << "</div>";
+    }
+    return ss.str();
+  }
+
+  void WriteVerses(sword::SWModule * module, const char * first,
+    const char * last, FixtureRandom & rng, bool commentary)
+  {
+    sword::VerseKey vk(first, last);
+    for(vk.setPosition(TOP); !vk.popError(); vk.increment())
+    {
+      module->setKey(vk);
+      std::string text;
+      // Long, link-dense commentary entries on the first verse of a chapter
+      if(commentary) text = CommentaryText(rng, vk.getVerse() == 1 ? 60 : 1);
+      else text = VerseText(rng, vk.getVerse());
+      module->setEntry(text.c_str());
+    }
+  }
+
+  bool CopyTree(std::filesystem::path from, std::filesystem::path to)
+  {
+    std::error_code ec;
+    std::filesystem::create_directories(to, ec);
+    std::filesystem::copy(from, to, std::filesystem::copy_options::recursive |
+      std::filesystem::copy_options::overwrite_existing, ec);
+    if(ec) std::cerr << "Error copying " << from << ": " << ec.message() << '\n';
+    return !ec;
+  }
+}
+
+bool BuildBenchFixture(std::string fixture_dir, std::string work_dir,
+  int catalog_size, BenchFixture & fixture)
+{
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::path work(work_dir);
+  fs::remove_all(work, ec);
+
+  fixture.LibraryDir = (work / "library").string();
+  fixture.InstallDir = (work / "install").string();
+  fixture.CatalogDir = (work / "catalog").string();
+  fixture.BibleModule = "MachBenchBible";
+  fixture.CompressedModule = "MachBenchZText";
+  fixture.CommentaryModule = "MachBenchCom";
+  fixture.LexiconModule = "MachBenchLex";
+  fixture.UpdatedModule = "MachBenchCom";
+  fixture.UpdatedFile = "modules/comments/rawcom/machbenchcom/nt";
+  fixture.SweepBook = "John";
+  fixture.CatalogSize = catalog_size;
+
+  // Module configs come from Res/Fixture; data files are generated
+  if(!CopyTree(fs::path(fixture_dir) / "mods.d",
+    fs::path(fixture.LibraryDir) / "mods.d")) return false;
+  fs::create_directories(fixture.InstallDir, ec);
+
+  fs::path lib(fixture.LibraryDir);
+  fs::path bible_path = lib / "modules/texts/rawtext/machbenchbible";
+  fs::path ztext_path = lib / "modules/texts/ztext/machbenchztext";
+  fs::path com_path = lib / "modules/comments/rawcom/machbenchcom";
+  fs::path lex_path = lib / "modules/lexdict/rawld/machbenchlex";
+  fs::create_directories(bible_path, ec);
+  fs::create_directories(ztext_path, ec);
+  fs::create_directories(com_path, ec);
+  fs::create_directories(lex_path, ec);
+  if(sword::RawText::createModule((bible_path.string() + "/").c_str()) ||
+    sword::zText::createModule((ztext_path.string() + "/").c_str(), BOOKBLOCKS) ||
+    sword::RawCom::createModule((com_path.string() + "/").c_str()) ||
+    sword::RawLD::createModule((lex_path / "machbenchlex").string().c_str()))
+  {
+    std::cerr << "Error creating fixture modules in " << fixture.LibraryDir << '\n';
+    return false;
+  }
+
+  {
+    sword::SWMgr mgr(fixture.LibraryDir.c_str(), true, 0, false, false);
+    sword::SWModule * bible = mgr.getModule(fixture.BibleModule.c_str());
+    sword::SWModule * ztext = mgr.getModule(fixture.CompressedModule.c_str());
+    sword::SWModule * com = mgr.getModule(fixture.CommentaryModule.c_str());
+    sword::SWModule * lex = mgr.getModule(fixture.LexiconModule.c_str());
+    if(!bible || !ztext || !com || !lex || !bible->isWritable() ||
+      !ztext->isWritable())
+    {
+      std::cerr << "Error opening fixture modules for writing\n";
+      return false;
+    }
+    FixtureRandom rng(1611);
+    WriteVerses(bible, "Gen 1:1", "Gen 1:31", rng, false);
+    WriteVerses(bible, "John 1:1", "John 21:25", rng, false);
+    WriteVerses(bible, "Rom 8:1", "Rom 8:39", rng, false);
+    FixtureRandom ztext_rng(1611);
+    WriteVerses(ztext, "Gen 1:1", "Gen 1:31", ztext_rng, false);
+    WriteVerses(ztext, "John 1:1", "John 21:25", ztext_rng, false);
+    WriteVerses(ztext, "Rom 8:1", "Rom 8:39", ztext_rng, false);
+    WriteVerses(com, "John 1:1", "John 21:25", rng, true);
+    for(int n = 1; n <= 5624; n++)
+    {
+      char key[8];
+      std::snprintf(key, sizeof(key), "%05d", n);
+      std::stringstream ss;
+      ss << "<entryFree n=\"" << n << "\"><orth>" << greek_words[n % 5]
+        << "</orth> <def>" << english_words[n % 22] << ", "
+        << english_words[(n*7) % 22] << "; see <reference osisRef=\""
+        << cross_refs[n % 8] << "\">" << cross_refs[n % 8]
+        << "</reference></def></entryFree>";
+      lex->setKey(key);
+      lex->setEntry(ss.str().c_str());
+    }
+  }
+
+  // Local source: the real fixture modules plus conf-only catalog entries
+  if(!CopyTree(lib, fixture.CatalogDir)) return false;
+  {
+    fs::path updated_conf = fs::path(fixture.CatalogDir) /
+      "mods.d/machbenchcom.conf";
+    std::ifstream old_conf(updated_conf.string());
+    std::stringstream body;
+    body << old_conf.rdbuf();
+    old_conf.close();
+    std::string text = body.str();
+    size_t version = text.find("Version=1.0");
+    if(version == std::string::npos) return false;
+    text.replace(version, 11, "Version=1.1");
+    std::ofstream new_conf(updated_conf.string());
+    new_conf << text;
+
+    // One letter of the last entry changes case in the newer version
+    fs::path updated_data = fs::path(fixture.CatalogDir) / fixture.UpdatedFile;
+    std::fstream data(updated_data.string(),
+      std::ios::in | std::ios::out | std::ios::binary);
+    std::stringstream data_body;
+    data_body << data.rdbuf();
+    std::string bytes = data_body.str();
+    size_t letter = bytes.find_last_of("abcdefghijklmnopqrstuvwxyz");
+    if(letter == std::string::npos) return false;
+    data.clear();
+    data.seekp(letter);
+    data.put(char(toupper(bytes[letter])));
+    if(!data) return false;
+  }
+  std::ifstream fin((fs::path(fixture_dir) / "mods.d/machbenchbible.conf").string());
+  std::stringstream conf;
+  conf << fin.rdbuf();
+  std::string conf_body = conf.str().substr(conf.str().find(']') + 1);
+  for(int n = 0; n < catalog_size; n++)
+  {
+    char name[32];
+    std::snprintf(name, sizeof(name), "MachCatalog%04d", n);
+    std::string lower(name);
+    for(char & c : lower) c = tolower(c);
+    std::ofstream fout((fs::path(fixture.CatalogDir) / "mods.d" /
+      (lower + ".conf")).string());
+    fout << '[' << name << ']' << conf_body;
+  }
+  return true;
+}
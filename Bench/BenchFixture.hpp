@@ -0,0 +1,38 @@
+// Machaira: BenchFixture.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file builds the synthetic SWORD library used by the benchmarks from
+// the module configs in Res/Fixture, so they can run offline
+// Current version: Pre-release
+
+#ifndef BENCHFIXTURE_HPP
+#define BENCHFIXTURE_HPP
+
+#include <string>
+#include <vector>
+
+struct BenchFixture
+{
+  // Library with the generated Bible, commentary and lexicon
+  std::string LibraryDir;
+  // Install manager directory used by the benchmark backend
+  std::string InstallDir;
+  // Local (file://) source with the fixture modules plus a large catalog
+  std::string CatalogDir;
+  std::string BibleModule;
+  // Same books as BibleModule, zip-compressed one block per book (zText)
+  std::string CompressedModule;
+  std::string CommentaryModule;
+  std::string LexiconModule;
+  // Module the local source offers a newer Version of, which differs in one
+  // data file (same size), so an update skips the others
+  std::string UpdatedModule;
+  std::string UpdatedFile;
+  // Book that is fully populated in the Bible and commentary
+  std::string SweepBook;
+  int CatalogSize;
+};
+
+bool BuildBenchFixture(std::string fixture_dir, std::string work_dir,
+  int catalog_size, BenchFixture & fixture);
+
+#endif
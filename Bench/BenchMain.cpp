@@ -0,0 +1,679 @@
+// Machaira: BenchMain.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the machaira_bench program, which times the backend hot
+// paths against the synthetic fixture library and reports JSON
+// Current version: Pre-release
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <algorithm>
+#include <numeric>
+#include <mutex>
+#include <condition_variable>
+
+#include "SwordBackend.hpp"
+#include "SwordReader.hpp"
+#include "ParallelRenderer.hpp"
+#include "HoverPreviewer.hpp"
+#include "BenchFixture.hpp"
+
+// Latency samples (microseconds) for one benchmarked operation
+class BenchSeries
+{
+  public:
+    BenchSeries(std::string name, std::string item_unit, double items_per_sample = 1.0) :
+      name(name), item_unit(item_unit), items_per_sample(items_per_sample) {}
+    template<typename F> void Time(F func)
+    {
+      auto t0 = std::chrono::steady_clock::now();
+      func();
+      auto t1 = std::chrono::steady_clock::now();
+      samples.push_back(std::chrono::duration<double, std::micro>(t1-t0).count());
+    }
+    void WriteJSON(std::ostream & out);
+    size_t Size(){ return samples.size(); }
+  private:
+    double Percentile(const std::vector<double> & sorted, double p);
+    std::string name;
+    std::string item_unit;
+    double items_per_sample;
+    std::vector<double> samples;
+};
+
+double BenchSeries::Percentile(const std::vector<double> & sorted, double p)
+{
+  // Nearest-rank percentile
+  if(sorted.empty()) return 0.0;
+  size_t rank = static_cast<size_t>(p/100.0*sorted.size() + 0.5);
+  rank = std::min(std::max(rank, size_t(1)), sorted.size());
+  return sorted[rank-1];
+}
+
+void BenchSeries::WriteJSON(std::ostream & out)
+{
+  std::vector<double> sorted(samples);
+  std::sort(sorted.begin(), sorted.end());
+  double total = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+  double mean = sorted.empty() ? 0.0 : total/sorted.size();
+  double throughput = (total > 0.0) ?
+    (items_per_sample*sorted.size())/(total/1.0e6) : 0.0;
+  out << "    {\"name\": \"" << name << "\", \"unit\": \"us\", \"samples\": "
+    << sorted.size() << ", \"mean\": " << mean
+    << ", \"min\": " << (sorted.empty() ? 0.0 : sorted.front())
+    << ", \"p50\": " << Percentile(sorted, 50.0)
+    << ", \"p90\": " << Percentile(sorted, 90.0)
+    << ", \"p99\": " << Percentile(sorted, 99.0)
+    << ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back())
+    << ", \"throughput\": " << throughput
+    << ", \"throughput_unit\": \"" << item_unit << "/s\"}";
+}
+
+void PrintUsage()
+{
+  std::cerr << "Usage: machaira_bench [--fixture DIR] [--work DIR] "
+    "[--iterations N] [--catalog-size N] [--output FILE]\n";
+}
+
+int main(int argc, char ** argv)
+{
+  std::string fixture_dir("./Res/Fixture");
+  std::string work_dir("./bench_work");
+  std::string output_file("");
+  int iterations = 5;
+  int catalog_size = 500;
+  for(int n = 1; n < argc; n++)
+  {
+    std::string arg(argv[n]);
+    if(arg == "--fixture" && n+1 < argc) fixture_dir = argv[++n];
+    else if(arg == "--work" && n+1 < argc) work_dir = argv[++n];
+    else if(arg == "--output" && n+1 < argc) output_file = argv[++n];
+    else if(arg == "--iterations" && n+1 < argc) iterations = std::stoi(argv[++n]);
+    else if(arg == "--catalog-size" && n+1 < argc) catalog_size = std::stoi(argv[++n]);
+    else
+    {
+      PrintUsage();
+      return 1;
+    }
+  }
+
+  std::cerr << "Building fixture library in " << work_dir << '\n';
+  BenchFixture fixture;
+  if(!BuildBenchFixture(fixture_dir, work_dir, catalog_size, fixture)) return 1;
+
+  // The backend reports progress on std::cout; keep stdout for the JSON
+  std::streambuf * cout_buf = std::cout.rdbuf(nullptr);
+
+  SwordBackendSettings settings;
+  settings.LibraryDir = fixture.LibraryDir;
+  settings.InstallDir = fixture.InstallDir;
+  settings.DefaultSource = "BenchCatalog";
+  std::vector<std::unique_ptr<BenchSeries>> results;
+
+  // Backend construction (installer config + library scan), first with the
+  // catalog snapshot removed each time, then starting from the snapshot
+  std::cerr << "Timing backend construction\n";
+  results.emplace_back(new BenchSeries("backend.construct.no_snapshot",
+    "constructions"));
+  std::unique_ptr<SwordBackend> backend;
+  for(int n = 0; n < iterations; n++)
+  {
+    backend.reset();
+    std::remove(CatalogSnapshotFile(fixture.LibraryDir).c_str());
+    results.back()->Time([&]{ backend.reset(new SwordBackend(settings)); });
+  }
+  results.emplace_back(new BenchSeries("backend.construct", "constructions"));
+  for(int n = 0; n < iterations; n++)
+  {
+    backend.reset();
+    results.back()->Time([&]{ backend.reset(new SwordBackend(settings)); });
+  }
+  // First render after a snapshot start opens the module
+  results.emplace_back(new BenchSeries("backend.first_text", "calls"));
+  results.back()->Time([&]{
+    backend->GetText(fixture.SweepBook + " 1:1", fixture.BibleModule);
+  });
+  // Registering installed modules after a batch install: every config
+  // checked for changes, then only the installed ones read
+  std::cerr << "Timing module registration\n";
+  std::vector<std::string> installed = {fixture.BibleModule,
+    fixture.CompressedModule, fixture.CommentaryModule, fixture.LexiconModule};
+  results.emplace_back(new BenchSeries("library.register.full", "modules",
+    installed.size()));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->RegisterInstalledModules(); });
+  }
+  results.emplace_back(new BenchSeries("library.register.incremental",
+    "modules", installed.size()));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->RegisterInstalledModules(installed); });
+  }
+  backend->AddLocalSource("BenchCatalog", fixture.CatalogDir);
+
+  // Collect every verse key of the sweep book
+  std::vector<std::string> verses;
+  backend->SetVerseRef(fixture.BibleModule, fixture.SweepBook + " 1:1");
+  std::string verse = backend->GetVerseRef(fixture.BibleModule);
+  while(verse.compare(0, fixture.SweepBook.size(), fixture.SweepBook) == 0)
+  {
+    verses.push_back(verse);
+    std::string next = backend->IncrementVerse(fixture.BibleModule, 1);
+    if(next == verse) break;
+    verse = next;
+  }
+  std::cerr << "Sweep book has " << verses.size() << " verses\n";
+
+  // Verse sweeps with IncrementVerse
+  std::cerr << "Timing IncrementVerse sweeps\n";
+  results.emplace_back(new BenchSeries("increment_verse.step", "verses"));
+  BenchSeries * step = results.back().get();
+  results.emplace_back(new BenchSeries("increment_verse.book_sweep", "verses",
+    verses.size()));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{
+      backend->SetVerseRef(fixture.BibleModule, verses.front());
+      for(size_t v = 1; v < verses.size(); v++)
+      {
+        step->Time([&]{ backend->IncrementVerse(fixture.BibleModule, 1); });
+      }
+    });
+  }
+
+  // GetText on short verses, without and with the render cache
+  std::cerr << "Timing GetText on short verses\n";
+  size_t cache_size = backend->GetRenderCacheStats().MaxBytes;
+  backend->SetRenderCacheSize(0);
+  results.emplace_back(new BenchSeries("get_text.verse.uncached", "calls"));
+  for(int n = 0; n < iterations; n++)
+  {
+    for(const std::string & v : verses)
+    {
+      results.back()->Time([&]{ backend->GetText(v, fixture.BibleModule); });
+    }
+  }
+  backend->SetRenderCacheSize(cache_size);
+  for(const std::string & v : verses) backend->GetText(v, fixture.BibleModule);
+  results.emplace_back(new BenchSeries("get_text.verse.cached", "calls"));
+  for(int n = 0; n < iterations; n++)
+  {
+    for(const std::string & v : verses)
+    {
+      results.back()->Time([&]{ backend->GetText(v, fixture.BibleModule); });
+    }
+  }
+
+  // GetText served from the pre-rendered verse store (render cache off, so
+  // every call is a store lookup); the store is removed again afterwards
+  std::cerr << "Timing verse store export and GetText from the store\n";
+  results.emplace_back(new BenchSeries("verse_store.build", "builds"));
+  results.back()->Time([&]{ backend->ExportVerseStore(fixture.BibleModule); });
+  backend->InitializeLibrary();
+  backend->SetRenderCacheSize(0);
+  results.emplace_back(new BenchSeries("get_text.verse.store", "calls"));
+  for(int n = 0; n < iterations; n++)
+  {
+    for(const std::string & v : verses)
+    {
+      results.back()->Time([&]{ backend->GetText(v, fixture.BibleModule); });
+    }
+  }
+  backend->SetRenderCacheSize(cache_size);
+  std::remove(VerseStoreFile(fixture.LibraryDir, fixture.BibleModule).c_str());
+  backend->InitializeLibrary();
+
+  // Display option toggles: the first time each verse is shown under
+  // non-default options it is parsed from the raw entry; toggling options
+  // after that re-emits it from the cached tokens without SWORD
+  std::cerr << "Timing display option changes\n";
+  DisplayOptions study_options;
+  study_options.Morphology = true;
+  study_options.Footnotes = true;
+  study_options.CrossReferences = true;
+  DisplayOptions reading_options;
+  reading_options.StrongsNumbers = false;
+  reading_options.Headings = true;
+  reading_options.RedLetter = true;
+  backend->SetDisplayOptions(study_options);
+  results.emplace_back(new BenchSeries("get_text.verse.tokenize", "calls"));
+  for(int n = 0; n < iterations; n++)
+  {
+    backend->InitializeLibrary();
+    for(const std::string & v : verses)
+    {
+      results.back()->Time([&]{ backend->GetText(v, fixture.BibleModule); });
+    }
+  }
+  results.emplace_back(new BenchSeries("get_text.verse.reemit", "calls"));
+  for(int n = 0; n < iterations; n++)
+  {
+    backend->SetDisplayOptions((n % 2) ? study_options : reading_options);
+    for(const std::string & v : verses)
+    {
+      results.back()->Time([&]{ backend->GetText(v, fixture.BibleModule); });
+    }
+  }
+  backend->SetDisplayOptions(DisplayOptions());
+
+  // GetText on long, link-dense commentary entries (first verse of chapters)
+  std::cerr << "Timing GetText on long commentary entries\n";
+  backend->SetRenderCacheSize(0);
+  results.emplace_back(new BenchSeries("get_text.commentary.uncached", "calls"));
+  size_t commentary_bytes = 0;
+  for(int n = 0; n < iterations; n++)
+  {
+    for(int chapter = 1; chapter <= 21; chapter++)
+    {
+      std::string key = fixture.SweepBook + " " + std::to_string(chapter) + ":1";
+      results.back()->Time([&]{
+        commentary_bytes += backend->GetText(key, fixture.CommentaryModule).size();
+      });
+    }
+  }
+  backend->SetRenderCacheSize(cache_size);
+
+  // Compressed Bible (one zip block per book): GetText alternating between
+  // Genesis and John, which makes SWORD inflate a block on every call, with
+  // and without the shared block cache (render cache off); then a chapter
+  // read by a second reader, after the first has read it
+  std::cerr << "Timing compressed module reads\n";
+  size_t block_cache_size = backend->GetBlockCacheStats().MaxBytes;
+  double block_hit_rate = 0.0;
+  backend->SetRenderCacheSize(0);
+  for(bool cached : {false, true})
+  {
+    backend->SetBlockCacheSize(cached ? block_cache_size : 0);
+    backend->ClearBlockCache();
+    BlockCacheStats before = backend->GetBlockCacheStats();
+    results.emplace_back(new BenchSeries(cached ?
+      "block_cache.alternate.cached" : "block_cache.alternate.uncached",
+      "calls"));
+    for(int n = 0; n < iterations; n++)
+    {
+      for(int verse = 1; verse <= 31; verse++)
+      {
+        std::string v = std::to_string(verse);
+        results.back()->Time([&]{
+          backend->GetText("Gen 1:" + v, fixture.CompressedModule);
+        });
+        results.back()->Time([&]{
+          backend->GetText(fixture.SweepBook + " 1:" + v, fixture.CompressedModule);
+        });
+      }
+    }
+    BlockCacheStats after = backend->GetBlockCacheStats();
+    unsigned long lookups = (after.Hits - before.Hits) +
+      (after.Misses - before.Misses);
+    if(cached && lookups) block_hit_rate = double(after.Hits - before.Hits)/lookups;
+  }
+  backend->SetRenderCacheSize(cache_size);
+  std::string sweep_chapter = fixture.SweepBook + " 3";
+  for(bool cached : {false, true})
+  {
+    backend->SetBlockCacheSize(cached ? block_cache_size : 0);
+    results.emplace_back(new BenchSeries(cached ?
+      "block_cache.second_reader.cached" : "block_cache.second_reader.uncached",
+      "passages"));
+    for(int n = 0; n < iterations; n++)
+    {
+      backend->ClearBlockCache();
+      SwordReader first_reader(fixture.LibraryDir);
+      SwordReader second_reader(fixture.LibraryDir);
+      first_reader.GetPassage(sweep_chapter, fixture.CompressedModule);
+      results.back()->Time([&]{
+        second_reader.GetPassage(sweep_chapter, fixture.CompressedModule);
+      });
+    }
+  }
+
+  // Parallel-translation view: one chapter in six columns, rendered one
+  // after another with a single reader, then fanned out over the pool (the
+  // fixture has one Bible, so every column renders it)
+  std::cerr << "Timing parallel-translation rendering\n";
+  const int parallel_columns = 6;
+  std::string chapter = fixture.SweepBook + " 1";
+  std::vector<std::string> columns(parallel_columns, fixture.BibleModule);
+  SwordReader serial_reader(fixture.LibraryDir);
+  results.emplace_back(new BenchSeries("parallel_view.serial", "columns",
+    parallel_columns));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{
+      for(const std::string & mod_name : columns)
+      {
+        serial_reader.GetPassage(chapter, mod_name);
+      }
+    });
+  }
+  ParallelRenderer renderer(fixture.LibraryDir, parallel_columns);
+  results.emplace_back(new BenchSeries("parallel_view.pool", "columns",
+    parallel_columns));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ renderer.Render(chapter, columns); });
+  }
+
+  // Whole-module export of the sweep book: reader, render pool and ordered
+  // writer joined by bounded queues; then the same export resumed, with
+  // the book already done
+  std::cerr << "Timing module export\n";
+  ExportOptions export_options;
+  export_options.Modules.push_back(fixture.BibleModule);
+  export_options.Books.push_back(fixture.SweepBook);
+  export_options.OutputDir = work_dir + "/export";
+  export_options.Resume = false;
+  ExportStats export_stats;
+  results.emplace_back(new BenchSeries("export.pipeline", "verses",
+    verses.size()));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->ExportModules(export_options, export_stats); });
+  }
+  size_t export_peak_chapters = export_stats.PeakChapters;
+  export_options.Resume = true;
+  results.emplace_back(new BenchSeries("export.resume", "modules"));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->ExportModules(export_options, export_stats); });
+  }
+
+  // Hover previews: bursts of hovers over chapter links, each replacing the
+  // last, as when skimming linked text; without a debounce interval the
+  // earlier lookups start and are cancelled, and only the last is delivered.
+  // Requests are timed alone too, since they are made on the UI thread
+  std::cerr << "Timing hover preview bursts\n";
+  std::mutex preview_mutex;
+  std::condition_variable preview_ready;
+  unsigned long preview_generation = 0;
+  HoverPreviewer previewer(fixture.LibraryDir,
+    [&](const HoverPreview & preview)
+    {
+      std::lock_guard<std::mutex> lock(preview_mutex);
+      preview_generation = preview.Generation;
+      preview_ready.notify_all();
+    }, std::chrono::milliseconds(0));
+  const int hover_burst = 8;
+  results.emplace_back(new BenchSeries("hover.request", "requests"));
+  results.emplace_back(new BenchSeries("hover.burst", "bursts"));
+  BenchSeries * hover_request = results[results.size() - 2].get();
+  for(int n = 0; n < iterations*4; n++)
+  {
+    previewer.ClearPreviews();
+    results.back()->Time([&]{
+      unsigned long last = 0;
+      for(int h = 0; h < hover_burst; h++)
+      {
+        std::string hovered = fixture.SweepBook + " " +
+          std::to_string(1 + (n*hover_burst + h) % 21);
+        hover_request->Time([&]{
+          last = previewer.Request(fixture.BibleModule + '\x1f' + hovered,
+            [&fixture, hovered](SwordReader & reader,
+              const std::function<bool()> & cancelled)
+            {
+              return reader.GetPassage(hovered, fixture.BibleModule, cancelled);
+            });
+        });
+      }
+      std::unique_lock<std::mutex> lock(preview_mutex);
+      preview_ready.wait(lock, [&]{ return preview_generation == last; });
+    });
+  }
+  HoverPreviewStats hover_stats = previewer.GetStats();
+
+  // Full-text index: full rebuild of the fixture modules, then queries
+  std::cerr << "Timing search index build and queries\n";
+  results.emplace_back(new BenchSeries("search_index.build", "builds"));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->UpdateSearchIndex(0, true); });
+  }
+  size_t search_hits = 0;
+  const char * queries[][2] = {
+    {"search.word", "grace"},
+    {"search.phrase", "\"the word\""},
+    {"search.boolean", "light AND (truth OR glory) NOT darkness"}};
+  for(auto & query : queries)
+  {
+    results.emplace_back(new BenchSeries(query[0], "queries"));
+    for(int n = 0; n < iterations*20; n++)
+    {
+      std::string error;
+      size_t hits = 0;
+      results.back()->Time([&]{
+        backend->Search(query[1], [&](const SearchHit &){ hits++; return true; },
+          error);
+      });
+      search_hits = std::max(search_hits, hits);
+    }
+  }
+
+  // Strong's concordance lookups (built with the search index above)
+  std::cerr << "Timing Strong's concordance lookups\n";
+  results.emplace_back(new BenchSeries("strongs.lookup", "lookups"));
+  for(int n = 0; n < iterations*100; n++)
+  {
+    std::string number = "G" + std::to_string(1 + (n*37) % 5624);
+    StrongsOccurrences occurrences;
+    results.back()->Time([&]{
+      backend->GetStrongsOccurrences(fixture.BibleModule, number, occurrences,
+        100);
+    });
+  }
+
+  // Lexicon hovers: the entry through GetText (render cache off), through
+  // the key index and lexicon cache on first and later hovers, and prefix
+  // matches across the installed dictionaries as a key is typed
+  std::cerr << "Timing lexicon lookups\n";
+  backend->SetRenderCacheSize(0);
+  results.emplace_back(new BenchSeries("lexicon.entry.get_text", "lookups"));
+  for(int n = 0; n < iterations*100; n++)
+  {
+    std::string number = std::to_string(1 + (n*37) % 5624);
+    results.back()->Time([&]{ backend->GetText(number, fixture.LexiconModule); });
+  }
+  backend->SetRenderCacheSize(cache_size);
+  results.emplace_back(new BenchSeries("lexicon.entry.first", "lookups"));
+  results.emplace_back(new BenchSeries("lexicon.entry.cached", "lookups"));
+  BenchSeries * first_hover = results[results.size() - 2].get();
+  for(int n = 0; n < iterations*100; n++)
+  {
+    // A stride prime to 5624, so first hovers do not repeat
+    std::string number = std::to_string(1 + (n*41) % 5624);
+    std::string html;
+    first_hover->Time([&]{
+      backend->GetLexiconEntry(fixture.LexiconModule, number, html);
+    });
+    results.back()->Time([&]{
+      backend->GetLexiconEntry(fixture.LexiconModule, number, html);
+    });
+  }
+  results.emplace_back(new BenchSeries("lexicon.prefix", "queries"));
+  size_t lexicon_matches = 0;
+  for(int n = 0; n < iterations*100; n++)
+  {
+    std::string prefix = std::to_string(1 + (n*37) % 999);
+    results.back()->Time([&]{
+      lexicon_matches += backend->FindLexiconKeys(prefix).size();
+    });
+  }
+
+  // Verse references typed a keystroke at a time, as the verse box sees
+  // them: completions of every prefix, then the whole reference parsed
+  std::cerr << "Timing verse reference completion and parsing\n";
+  const char * typed_references[] = {"jn 3:16", "1 jo 1:9", "Song of Sol 2:4",
+    "ps 119:105", "rom 8:28-39", "Gen 1:1; John 1:1-5", "II Kgs 2:11",
+    "jude 5"};
+  results.emplace_back(new BenchSeries("reference.keystroke", "keystrokes"));
+  results.emplace_back(new BenchSeries("reference.parse", "references"));
+  BenchSeries * keystroke = results[results.size() - 2].get();
+  for(int n = 0; n < iterations*10; n++)
+  {
+    for(const char * typed : typed_references)
+    {
+      std::string text(typed);
+      for(size_t length = 1; length <= text.size(); length++)
+      {
+        std::string prefix = text.substr(0, length);
+        keystroke->Time([&]{
+          backend->SuggestReferences(prefix, fixture.BibleModule);
+        });
+      }
+      results.back()->Time([&]{
+        backend->ParseReference(text, fixture.BibleModule);
+      });
+    }
+  }
+  ReferenceParserStats reference_stats = backend->GetReferenceParserStats();
+
+  // Cross-reference lookups in both directions over the sweep book
+  std::cerr << "Timing cross-reference lookups\n";
+  results.emplace_back(new BenchSeries("crossref.lookup", "lookups"));
+  size_t crossref_edges = 0;
+  for(int n = 0; n < iterations; n++)
+  {
+    for(const std::string & v : verses)
+    {
+      std::vector<CrossReference> outgoing;
+      std::vector<CrossReference> incoming;
+      results.back()->Time([&]{
+        backend->GetCrossReferences(v, outgoing, incoming);
+      });
+      if(n == 0) crossref_edges += outgoing.size();
+    }
+  }
+
+  // Remote catalog parsing from the local file:// source
+  std::cerr << "Timing remote catalog parsing\n";
+  backend->SelectRemoteSource("BenchCatalog", true);
+  size_t catalog_modules = backend->GetRemoteCatalog()->GetModules().size();
+  results.emplace_back(new BenchSeries("remote_catalog.select_source", "modules",
+    catalog_modules));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->SelectRemoteSource("BenchCatalog", true); });
+  }
+  // Unchanged directory source: the cached catalog is served after the
+  // validator check, without fetching
+  results.emplace_back(new BenchSeries("remote_catalog.select_source.cached",
+    "modules", catalog_modules));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->SelectRemoteSource("BenchCatalog"); });
+  }
+  results.emplace_back(new BenchSeries("remote_catalog.load_cached", "modules",
+    catalog_modules));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ backend->LoadCachedSourceCatalog("BenchCatalog"); });
+  }
+  // Installer list: building the sorted index, then filtering and sorting
+  // it as the filter box is typed into
+  std::shared_ptr<const CatalogIndex> catalog_index = backend->GetRemoteCatalog();
+  results.emplace_back(new BenchSeries("remote_catalog.index.build", "modules",
+    catalog_modules));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ CatalogIndex index(catalog_index->GetCatalog()); });
+  }
+  results.emplace_back(new BenchSeries("remote_catalog.query", "queries"));
+  std::vector<uint32_t> rows;
+  for(int n = 0; n < iterations; n++)
+  {
+    for(const char * text : {"", "b", "bi", "bib", "bible", "kj"})
+    {
+      CatalogQuery query;
+      query.Text = text;
+      query.SortKey = CatalogSortKey(n % 4);
+      query.Ascending = n % 2 == 0;
+      results.back()->Time([&]{ catalog_index->Query(query, rows); });
+    }
+  }
+
+  // Update check against the cached catalog (the local source offers a
+  // newer version of one module), then the update itself, which copies
+  // only the files that changed: the run fails unless the others were
+  // skipped and the changed one reached the library
+  std::cerr << "Timing module updates\n";
+  std::vector<ModuleUpdate> updates = backend->CheckForUpdates();
+  results.emplace_back(new BenchSeries("update.check", "modules",
+    backend->GetModuleCatalog().size()));
+  for(int n = 0; n < iterations; n++)
+  {
+    results.back()->Time([&]{ updates = backend->CheckForUpdates(); });
+  }
+  size_t modules_outdated = updates.size();
+  results.emplace_back(new BenchSeries("update.apply", "modules",
+    modules_outdated));
+  std::vector<std::string> updated;
+  results.back()->Time([&]{
+    backend->DownloadModuleUpdates(updates, updated);
+    backend->RegisterInstalledModules(updated);
+  });
+  TransferStats update_transfer = backend->GetTransferStats();
+  std::ifstream source_file((std::filesystem::path(fixture.CatalogDir) /
+    fixture.UpdatedFile).string(), std::ios::binary);
+  std::ifstream library_file((std::filesystem::path(fixture.LibraryDir) /
+    fixture.UpdatedFile).string(), std::ios::binary);
+  std::stringstream source_bytes, library_bytes;
+  source_bytes << source_file.rdbuf();
+  library_bytes << library_file.rdbuf();
+  if(updated.size() != 1 || updated[0] != fixture.UpdatedModule ||
+    !backend->CheckForUpdates().empty() || update_transfer.FilesSkipped == 0 ||
+    source_bytes.str() != library_bytes.str())
+  {
+    std::cout.rdbuf(cout_buf);
+    std::cerr << "Error: updating " << fixture.UpdatedModule << " failed (" <<
+      updated.size() << " updated, " << update_transfer.FilesCopied <<
+      " files copied, " << update_transfer.FilesSkipped << " skipped)\n";
+    return 1;
+  }
+
+  ResidencyStats residency = backend->GetResidencyStats();
+  std::cout.rdbuf(cout_buf);
+
+  // Machine-readable report
+  std::ofstream fout;
+  if(output_file != "") fout.open(output_file.c_str());
+  std::ostream & out = (output_file != "") ? fout : std::cout;
+  out << "{\n  \"benchmark\": \"machaira_bench\",\n  \"format_version\": 1,\n"
+    << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+    << "  \"sword_version\": \"" << backend->GetSwordVersion() << "\",\n"
+    << "  \"iterations\": " << iterations << ",\n"
+    << "  \"fixture\": {\"sweep_book_verses\": " << verses.size()
+    << ", \"commentary_entry_bytes_avg\": "
+    << (commentary_bytes/std::max(1, 21*iterations))
+    << ", \"catalog_modules\": " << catalog_modules
+    << ", \"search_hits_max\": " << search_hits
+    << ", \"crossref_edges_from_sweep_book\": " << crossref_edges
+    << ", \"lexicon_prefix_matches\": " << lexicon_matches
+    << ", \"reference_suggestions_over_budget\": "
+    << reference_stats.OverBudget
+    << ", \"export_peak_chapters\": " << export_peak_chapters
+    << ", \"block_cache_hit_rate\": " << block_hit_rate
+    << ", \"hover_requests\": " << hover_stats.Requests
+    << ", \"hover_debounced\": " << hover_stats.Debounced
+    << ", \"hover_cancelled\": " << hover_stats.Cancelled
+    << ", \"hover_rendered\": " << hover_stats.Rendered
+    << ", \"modules_outdated\": " << modules_outdated
+    << ", \"update_files_copied\": " << update_transfer.FilesCopied
+    << ", \"update_files_skipped\": " << update_transfer.FilesSkipped
+    << ", \"open_modules\": " << residency.OpenModules
+    << ", \"resident_mb\": " << residency.ResidentBytes/(1024*1024) << "},\n"
+    << "  \"results\": [\n";
+  for(size_t n = 0; n < results.size(); n++)
+  {
+    results[n]->WriteJSON(out);
+    out << ((n+1 < results.size()) ? ",\n" : "\n");
+  }
+  out << "  ]\n}\n";
+  return 0;
+}
@@ -0,0 +1,54 @@
+// Machaira: BinaryRecord.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file has the fields of small binary cache files: numbers in host byte
+// order and length-prefixed strings, read back with bounds checks
+// Current version: Pre-release
+
+#ifndef BINARYRECORD_HPP
+#define BINARYRECORD_HPP
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+template <class T> inline void AppendNumber(std::string & out, T value)
+{
+  out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Strings are a uint32 length followed by the text
+inline void AppendString(std::string & out, const std::string & text)
+{
+  AppendNumber<uint32_t>(out, text.size());
+  out += text;
+}
+
+// Reads fields in order, failing once the end of the data is passed
+struct RecordReader
+{
+  const char * pos;
+  const char * end;
+  bool Magic(const char * magic)
+  {
+    if(size_t(end - pos) < 4 || std::memcmp(pos, magic, 4) != 0) return false;
+    pos += 4;
+    return true;
+  }
+  template <class T> bool Number(T & value)
+  {
+    if(size_t(end - pos) < sizeof(T)) return false;
+    std::memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+  bool String(std::string & text)
+  {
+    uint32_t length;
+    if(!Number(length) || size_t(end - pos) < length) return false;
+    text.assign(pos, length);
+    pos += length;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,195 @@
+// Machaira: BlockCache.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a memory-bounded LRU cache of the decompressed blocks of
+// compressed (zText/zCom) modules, shared by every SWORD manager in the
+// process, so a block is only inflated again once it has been evicted
+// Current version: Pre-release
+
+#include "BlockCache.hpp"
+#include "Trace.hpp"
+
+#include <zverse.h>
+#include <swcomprs.h>
+
+namespace
+{
+  // Reaches the compressor a zVerse module was created with (SWMgr builds
+  // it from the module's CompressType)
+  struct CompressorSlot : public sword::zVerse
+  {
+    static sword::SWCompress *& Of(sword::zVerse & verse)
+    {
+      return verse.*(&CompressorSlot::compressor);
+    }
+  };
+
+  // Stands in for a module's compressor: zVerse hands it each compressed
+  // block it reads (zBuf) and asks for the text (Buf), which comes from the
+  // cache when any manager has inflated that block before. Writing
+  // (Buf with text, then zBuf) goes straight to the module's compressor
+  class CachedCompress : public sword::SWCompress
+  {
+    public:
+      CachedCompress(sword::SWCompress * compressor, BlockCache & cache) :
+        compressor(compressor), cache(cache), reading(false) {}
+      virtual ~CachedCompress(){ delete compressor; }
+      virtual char * Buf(const char * buf = 0, unsigned long * len = 0)
+      {
+        if(buf || !reading)
+        {
+          reading = false;
+          block.reset();
+          return compressor->Buf(buf, len);
+        }
+        if(!block)
+        {
+          block = cache.Get(compressed);
+          if(block) TRACE_COUNT("block_cache.hits", 1);
+          else
+          {
+            TRACE_SCOPE("block_cache.Inflate");
+            TRACE_COUNT("block_cache.misses", 1);
+            unsigned long size = compressed.size();
+            compressor->zBuf(&size, &compressed[0]);
+            size = 0;
+            char * text = compressor->Buf(0, &size);
+            block = cache.Put(compressed, std::string(text, size));
+          }
+        }
+        if(len) *len = block->size();
+        // zVerse only copies out of the buffer
+        return const_cast<char *>(block->c_str());
+      }
+      virtual char * zBuf(unsigned long * len, char * buf = 0)
+      {
+        if(!buf)
+        {
+          reading = false;
+          return compressor->zBuf(len, buf);
+        }
+        // Only kept here: it is inflated on a cache miss
+        compressed.assign(buf, *len);
+        block.reset();
+        reading = true;
+        return &compressed[0];
+      }
+    private:
+      sword::SWCompress * compressor;
+      BlockCache & cache;
+      bool reading;
+      std::string compressed;
+      std::shared_ptr<const std::string> block;
+  };
+}
+
+BlockCache::BlockCache(size_t max_bytes) :
+  max_bytes(max_bytes), current_bytes(0)
+{
+}
+
+std::shared_ptr<const std::string> BlockCache::Get(
+  const std::string & compressed)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = lookup.find(std::string_view(compressed));
+  if(it == lookup.end())
+  {
+    stats.Misses++;
+    return nullptr;
+  }
+  // Move entry to the front of the list (most recently used)
+  entries.splice(entries.begin(), entries, it->second);
+  stats.Hits++;
+  return it->second->Text;
+}
+
+std::shared_ptr<const std::string> BlockCache::Put(
+  const std::string & compressed, std::string text)
+{
+  std::shared_ptr<const std::string> block =
+    std::make_shared<const std::string>(std::move(text));
+  std::lock_guard<std::mutex> lock(mutex);
+  // Another manager may have inflated the same block meanwhile
+  auto it = lookup.find(std::string_view(compressed));
+  if(it != lookup.end())
+  {
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->Text;
+  }
+  Entry entry{compressed, block};
+  // Blocks larger than the whole budget are never cached
+  if(EntryBytes(entry) > max_bytes) return block;
+
+  entries.push_front(std::move(entry));
+  lookup[std::string_view(entries.front().Compressed)] = entries.begin();
+  current_bytes += EntryBytes(entries.front());
+  EvictToFit();
+  return block;
+}
+
+void BlockCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  lookup.clear();
+  entries.clear();
+  current_bytes = 0;
+}
+
+void BlockCache::SetMaxBytes(size_t max_bytes)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  this->max_bytes = max_bytes;
+  EvictToFit();
+}
+
+size_t BlockCache::GetMaxBytes()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return max_bytes;
+}
+
+BlockCacheStats BlockCache::GetStats()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  stats.Blocks = entries.size();
+  stats.Bytes = current_bytes;
+  stats.MaxBytes = max_bytes;
+  return stats;
+}
+
+size_t BlockCache::EntryBytes(const Entry & entry)
+{
+  // Compressed bytes are kept to match blocks exactly, plus bookkeeping
+  return entry.Compressed.size() + entry.Text->size() + sizeof(Entry) + 96;
+}
+
+void BlockCache::EvictToFit()
+{
+  while(current_bytes > max_bytes && !entries.empty())
+  {
+    Entry & oldest = entries.back();
+    current_bytes -= EntryBytes(oldest);
+    lookup.erase(std::string_view(oldest.Compressed));
+    entries.pop_back();
+    stats.Evictions++;
+  }
+}
+
+BlockCache & SharedBlockCache()
+{
+  static BlockCache cache;
+  return cache;
+}
+
+bool CacheModuleBlocks(sword::SWModule * module, BlockCache & cache)
+{
+  sword::zVerse * verse = dynamic_cast<sword::zVerse *>(module);
+  if(!verse) return false;
+  sword::SWCompress *& compressor = CompressorSlot::Of(*verse);
+  if(!compressor) return false;
+  if(!dynamic_cast<CachedCompress *>(compressor))
+  {
+    compressor = new CachedCompress(compressor, cache);
+  }
+  return true;
+}
@@ -0,0 +1,77 @@
+// Machaira: BlockCache.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a memory-bounded LRU cache of the decompressed blocks of
+// compressed (zText/zCom) modules, shared by every SWORD manager in the
+// process, so a block is only inflated again once it has been evicted
+// Current version: Pre-release
+
+#ifndef BLOCKCACHE_HPP
+#define BLOCKCACHE_HPP
+
+#include <string>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include <swmodule.h>
+
+struct BlockCacheStats
+{
+  unsigned long Hits = 0;
+  unsigned long Misses = 0;
+  unsigned long Evictions = 0;
+  size_t Blocks = 0;
+  size_t Bytes = 0;
+  size_t MaxBytes = 0;
+  double HitRate() const
+  {
+    return (Hits + Misses) ? double(Hits)/(Hits + Misses) : 0.0;
+  }
+};
+
+// Blocks are keyed by their compressed bytes, so modules opened by separate
+// managers share them, and an updated module never sees its old blocks
+class BlockCache
+{
+  public:
+    // Constructor
+    BlockCache(size_t max_bytes = 32*1024*1024);
+    // Cache Access (safe from any thread); blocks stay valid while held,
+    // even once evicted
+    std::shared_ptr<const std::string> Get(const std::string & compressed);
+    // Returns the stored block (or the text alone, when larger than the
+    // whole budget)
+    std::shared_ptr<const std::string> Put(const std::string & compressed,
+      std::string text);
+    void Clear();
+    // Get/Set
+    void SetMaxBytes(size_t max_bytes);
+    size_t GetMaxBytes();
+    BlockCacheStats GetStats();
+  private:
+    struct Entry
+    {
+      std::string Compressed;
+      std::shared_ptr<const std::string> Text;
+    };
+    size_t EntryBytes(const Entry & entry);
+    void EvictToFit();
+    // Most recently used entries are at the front of the list; the lookup
+    // keys point into the entries' compressed bytes
+    std::mutex mutex;
+    std::list<Entry> entries;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> lookup;
+    size_t max_bytes;
+    size_t current_bytes;
+    BlockCacheStats stats;
+};
+
+// Cache shared by every manager in the process
+BlockCache & SharedBlockCache();
+// Sends a zText or zCom module's block reads through the cache; false (and
+// the module left alone) for any other driver
+bool CacheModuleBlocks(sword::SWModule * module, BlockCache & cache);
+
+#endif
@@ -0,0 +1,116 @@
+// Machaira: CatalogIndex.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a read-only install-source catalog with its sort orders and
+// search text built once, so the installer list can be sorted and filtered
+// without copying the catalog
+// Current version: Pre-release
+
+#include "CatalogIndex.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <cctype>
+
+#include <swversion.h>
+
+namespace
+{
+  std::string LowerCase(std::string text)
+  {
+    for(char & c : text) c = std::tolower(static_cast<unsigned char>(c));
+    return text;
+  }
+
+  const std::string & SortField(const SwordModuleInfo & module,
+    CatalogSortKey key)
+  {
+    switch(key)
+    {
+      case SORT_Type: return module.Type;
+      case SORT_Language: return module.Language;
+      case SORT_Version: return module.Version;
+      default: return module.Name;
+    }
+  }
+
+  std::vector<std::string> Distinct(const std::vector<SwordModuleInfo> & modules,
+    CatalogSortKey key)
+  {
+    std::vector<std::string> values;
+    for(const SwordModuleInfo & module : modules)
+    {
+      values.push_back(SortField(module, key));
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+  }
+}
+
+CatalogIndex::CatalogIndex(SourceCatalog catalog) : catalog(std::move(catalog))
+{
+  const std::vector<SwordModuleInfo> & modules = this->catalog.Modules;
+  // Versions are compared as SWORD compares them for updates, so that
+  // "1.10" follows "1.9"
+  std::vector<sword::SWVersion> versions;
+  versions.reserve(modules.size());
+  for(const SwordModuleInfo & module : modules)
+  {
+    versions.emplace_back(module.Version.c_str());
+  }
+  // Ties (same type, language or version) fall back to name order
+  for(int key = SORT_Name; key <= SORT_Version; key++)
+  {
+    std::vector<uint32_t> & order = orders[key];
+    order.resize(modules.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+      int c = 0;
+      if(key == SORT_Version) c = versions[a].compare(versions[b]);
+      if(c == 0)
+      {
+        c = SortField(modules[a], CatalogSortKey(key)).compare(
+          SortField(modules[b], CatalogSortKey(key)));
+      }
+      if(c != 0) return c < 0;
+      return modules[a].Name < modules[b].Name;
+    });
+  }
+  search_text.reserve(modules.size());
+  for(const SwordModuleInfo & module : modules)
+  {
+    search_text.push_back(LowerCase(module.Name + '\n' + module.Description));
+  }
+  languages = Distinct(modules, SORT_Language);
+  types = Distinct(modules, SORT_Type);
+}
+
+void CatalogIndex::Query(const CatalogQuery & query,
+  std::vector<uint32_t> & rows) const
+{
+  rows.clear();
+  const std::vector<uint32_t> & order = orders[query.SortKey];
+  std::string text = LowerCase(query.Text);
+  for(size_t n = 0; n < order.size(); n++)
+  {
+    uint32_t m = query.Ascending ? order[n] : order[order.size() - 1 - n];
+    const SwordModuleInfo & module = catalog.Modules[m];
+    if(!query.Language.empty() && module.Language != query.Language) continue;
+    if(!query.Type.empty() && module.Type != query.Type) continue;
+    if(!text.empty() && search_text[m].find(text) == std::string::npos) continue;
+    rows.push_back(m);
+  }
+}
+
+long CatalogIndex::Find(const std::string & mod_name) const
+{
+  const std::vector<uint32_t> & order = orders[SORT_Name];
+  std::vector<uint32_t>::const_iterator it = std::lower_bound(order.begin(),
+    order.end(), mod_name, [this](uint32_t m, const std::string & name)
+    {
+      return catalog.Modules[m].Name < name;
+    });
+  if(it == order.end() || catalog.Modules[*it].Name != mod_name) return -1;
+  return *it;
+}
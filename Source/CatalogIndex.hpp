@@ -0,0 +1,63 @@
+// Machaira: CatalogIndex.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a read-only install-source catalog with its sort orders and
+// search text built once, so the installer list can be sorted and filtered
+// without copying the catalog
+// Current version: Pre-release
+
+#ifndef CATALOGINDEX_HPP
+#define CATALOGINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "SourceCatalog.hpp"
+
+// Sort keys, in the order of the installer's list columns
+enum CatalogSortKey
+{
+  SORT_Name = 0,
+  SORT_Type = 1,
+  SORT_Language = 2,
+  SORT_Version = 3
+};
+
+struct CatalogQuery
+{
+  CatalogSortKey SortKey = SORT_Name;
+  bool Ascending = true;
+  // Case-insensitive text found in the name or description
+  std::string Text;
+  // Exact language and type ("" for any)
+  std::string Language;
+  std::string Type;
+};
+
+class CatalogIndex
+{
+  public:
+    // Constructor (the index owns the catalog and never changes it)
+    CatalogIndex(SourceCatalog catalog = SourceCatalog());
+    const SourceCatalog & GetCatalog() const { return catalog; }
+    const std::vector<SwordModuleInfo> & GetModules() const
+    {
+      return catalog.Modules;
+    }
+    // Distinct languages and types, sorted, for the filter choices
+    const std::vector<std::string> & GetLanguages() const { return languages; }
+    const std::vector<std::string> & GetTypes() const { return types; }
+    // Positions of the modules matching the query, in sort order
+    void Query(const CatalogQuery & query, std::vector<uint32_t> & rows) const;
+    // Position of a module by name, or -1
+    long Find(const std::string & mod_name) const;
+  private:
+    SourceCatalog catalog;
+    std::vector<uint32_t> orders[4];
+    // Lower-case name and description of each module
+    std::vector<std::string> search_text;
+    std::vector<std::string> languages;
+    std::vector<std::string> types;
+};
+
+#endif
@@ -0,0 +1,317 @@
+// Machaira: CrossRefGraph.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the cross-reference graph of a Bible or commentary: every
+// reference found in the module, stored as forward and reverse adjacency
+// arrays (CSR) keyed by verse ID in a memory-mapped file
+// Current version: Pre-release
+
+#include "CrossRefGraph.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <cstring>
+
+#include <listkey.h>
+
+// Graph file layout (host byte order):
+//   CrossRefHeader, stamp text, padding to 8 bytes
+//   uint32 forward offsets[verse_count+1], uint32 forward targets[edges]
+//   uint32 reverse offsets[verse_count+1], uint32 reverse targets[edges]
+struct CrossRefHeader
+{
+  char Magic[4];
+  uint32_t Version;
+  uint32_t VerseCount;
+  uint32_t EdgeCount;
+  uint32_t StampLength;
+  uint32_t Reserved;
+  uint64_t StampOffset;
+  uint64_t ForwardOffsetsOffset;
+  uint64_t ForwardTargetsOffset;
+  uint64_t ReverseOffsetsOffset;
+  uint64_t ReverseTargetsOffset;
+  uint64_t FileSize;
+};
+
+static const char graph_magic[4] = {'M', 'X', 'X', 'G'};
+static const uint32_t graph_version = 1;
+// Ranges longer than this (whole books) only link their first verses
+static const int max_range_verses = 200;
+
+uint32_t CrossRefVerseId(const sword::VerseKey & verse)
+{
+  sword::VerseKey kjv;
+  kjv.setVersificationSystem("KJV");
+  kjv.positionFrom(verse);
+  return static_cast<uint32_t>(kjv.getIndex());
+}
+
+std::string CrossRefVerseText(uint32_t verse_id)
+{
+  sword::VerseKey kjv;
+  kjv.setVersificationSystem("KJV");
+  kjv.setIndex(verse_id);
+  return kjv.getText();
+}
+
+CrossRefGraph::CrossRefGraph() :
+  verse_count(0), edge_count(0), forward_offsets(0), forward_targets(0),
+  reverse_offsets(0), reverse_targets(0), stamp(0), stamp_length(0)
+{
+}
+
+bool CrossRefGraph::Open(std::string file_name)
+{
+  if(!file.Open(file_name)) return false;
+  if(file.Size() < sizeof(CrossRefHeader))
+  {
+    file.Close();
+    return false;
+  }
+  const CrossRefHeader * header =
+    reinterpret_cast<const CrossRefHeader *>(file.Data());
+  uint64_t offsets_bytes = 4*(uint64_t(header->VerseCount) + 1);
+  uint64_t targets_bytes = 4*uint64_t(header->EdgeCount);
+  if(std::memcmp(header->Magic, graph_magic, 4) != 0 ||
+    header->Version != graph_version || header->FileSize != file.Size() ||
+    header->ForwardOffsetsOffset + offsets_bytes > file.Size() ||
+    header->ForwardTargetsOffset + targets_bytes > file.Size() ||
+    header->ReverseOffsetsOffset + offsets_bytes > file.Size() ||
+    header->ReverseTargetsOffset + targets_bytes > file.Size())
+  {
+    file.Close();
+    return false;
+  }
+  verse_count = header->VerseCount;
+  edge_count = header->EdgeCount;
+  stamp = file.Data() + header->StampOffset;
+  stamp_length = header->StampLength;
+  forward_offsets = reinterpret_cast<const uint32_t *>(file.Data() +
+    header->ForwardOffsetsOffset);
+  forward_targets = reinterpret_cast<const uint32_t *>(file.Data() +
+    header->ForwardTargetsOffset);
+  reverse_offsets = reinterpret_cast<const uint32_t *>(file.Data() +
+    header->ReverseOffsetsOffset);
+  reverse_targets = reinterpret_cast<const uint32_t *>(file.Data() +
+    header->ReverseTargetsOffset);
+  return true;
+}
+
+std::string CrossRefGraph::GetStamp()
+{
+  if(!stamp) return "";
+  return std::string(stamp, stamp_length);
+}
+
+bool CrossRefGraph::GetRange(const uint32_t * offsets, const uint32_t * targets,
+  uint32_t verse_id, const uint32_t *& begin, const uint32_t *& end)
+{
+  if(!offsets || verse_id >= verse_count) return false;
+  begin = targets + offsets[verse_id];
+  end = targets + offsets[verse_id + 1];
+  return begin != end;
+}
+
+bool CrossRefGraph::GetOutgoing(uint32_t verse_id, const uint32_t *& begin,
+  const uint32_t *& end)
+{
+  return GetRange(forward_offsets, forward_targets, verse_id, begin, end);
+}
+
+bool CrossRefGraph::GetIncoming(uint32_t verse_id, const uint32_t *& begin,
+  const uint32_t *& end)
+{
+  return GetRange(reverse_offsets, reverse_targets, verse_id, begin, end);
+}
+
+namespace
+{
+  // Reference text from an attribute (attr="...") inside one tag
+  bool TagAttribute(const std::string & raw, size_t tag_begin, size_t tag_end,
+    const char * attribute, std::string & value)
+  {
+    size_t p = raw.find(attribute, tag_begin);
+    if(p == std::string::npos || p > tag_end) return false;
+    p += std::strlen(attribute);
+    size_t q = raw.find('"', p);
+    if(q == std::string::npos || q > tag_end) return false;
+    value = raw.substr(p, q - p);
+    return true;
+  }
+
+  // OSIS references are space separated, may name a work ("KJV:Gen.1.1")
+  // and may carry a grain ("Gen.1.1!a"), neither of which SWORD parses
+  void AddOsisReferences(const std::string & value, std::vector<std::string> & refs)
+  {
+    size_t start = 0;
+    while(start < value.size())
+    {
+      size_t end = value.find(' ', start);
+      if(end == std::string::npos) end = value.size();
+      std::string ref = value.substr(start, end - start);
+      size_t colon = ref.find(':');
+      if(colon != std::string::npos &&
+        ref.find_first_of("0123456789") > colon)
+      {
+        ref = ref.substr(colon + 1);
+      }
+      size_t grain;
+      while((grain = ref.find('!')) != std::string::npos)
+      {
+        size_t grain_end = ref.find('-', grain);
+        ref.erase(grain, grain_end == std::string::npos ? std::string::npos :
+          grain_end - grain);
+      }
+      if(!ref.empty()) refs.push_back(ref);
+      start = end + 1;
+    }
+  }
+
+  void ExtractReferences(const std::string & raw, std::vector<std::string> & refs)
+  {
+    std::string value;
+    // OSIS: <reference osisRef="Gen.1.1-Gen.1.3">
+    size_t pos = 0;
+    while((pos = raw.find("<reference", pos)) != std::string::npos)
+    {
+      size_t tag_end = raw.find('>', pos);
+      if(tag_end == std::string::npos) break;
+      if(TagAttribute(raw, pos, tag_end, "osisRef=\"", value))
+      {
+        AddOsisReferences(value, refs);
+      }
+      pos = tag_end;
+    }
+    // ThML: <scripRef passage="John 3:16"> or <scripRef>John 3:16</scripRef>
+    const char * thml_tags[] = {"<scripRef", "<scripref"};
+    for(const char * tag : thml_tags)
+    {
+      pos = 0;
+      while((pos = raw.find(tag, pos)) != std::string::npos)
+      {
+        size_t tag_end = raw.find('>', pos);
+        if(tag_end == std::string::npos) break;
+        if(TagAttribute(raw, pos, tag_end, "passage=\"", value))
+        {
+          refs.push_back(value);
+        }
+        else if(raw[tag_end - 1] != '/')
+        {
+          size_t close = raw.find("</scrip", tag_end);
+          if(close != std::string::npos)
+          {
+            refs.push_back(raw.substr(tag_end + 1, close - tag_end - 1));
+          }
+        }
+        pos = tag_end;
+      }
+    }
+  }
+
+  void WriteOffsets(std::string & body, const std::vector<uint32_t> & counts)
+  {
+    uint32_t offset = 0;
+    body.append(reinterpret_cast<const char *>(&offset), 4);
+    for(uint32_t count : counts)
+    {
+      offset += count;
+      body.append(reinterpret_cast<const char *>(&offset), 4);
+    }
+  }
+}
+
+bool BuildCrossRefGraph(sword::SWModule * module, std::string stamp,
+  std::string file_name)
+{
+  // References are parsed in the module's own versification
+  std::unique_ptr<sword::SWKey> parser_key(module->createKey());
+  sword::VerseKey * parser = dynamic_cast<sword::VerseKey *>(parser_key.get());
+  if(!parser) return false;
+
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  std::vector<std::string> refs;
+  module->setPosition(TOP);
+  for(; !module->popError(); module->increment(1))
+  {
+    sword::VerseKey * current = dynamic_cast<sword::VerseKey *>(module->getKey());
+    if(!current) continue;
+    refs.clear();
+    ExtractReferences(std::string(module->getRawEntry()), refs);
+    if(refs.empty()) continue;
+    uint32_t source = CrossRefVerseId(*current);
+    for(const std::string & ref : refs)
+    {
+      sword::ListKey targets = parser->parseVerseList(ref.c_str(),
+        current->getText(), true);
+      for(int n = 0; n < targets.getCount(); n++)
+      {
+        sword::VerseKey * element =
+          dynamic_cast<sword::VerseKey *>(targets.getElement(n));
+        if(!element) continue;
+        sword::VerseKey verse(element->isBoundSet() ?
+          element->getLowerBound() : *element);
+        sword::VerseKey last(element->isBoundSet() ?
+          element->getUpperBound() : *element);
+        for(int v = 0; v < max_range_verses && verse.compare(last) <= 0 &&
+          !verse.popError(); v++, verse.increment(1))
+        {
+          uint32_t target = CrossRefVerseId(verse);
+          if(target != source) edges.push_back(std::make_pair(source, target));
+        }
+      }
+    }
+  }
+
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  uint32_t verse_count = 0;
+  for(const std::pair<uint32_t, uint32_t> & edge : edges)
+  {
+    verse_count = std::max(verse_count, std::max(edge.first, edge.second) + 1);
+  }
+
+  auto pad = [](std::string & out)
+  {
+    while(out.size() % 8) out += '\0';
+  };
+  CrossRefHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, graph_magic, 4);
+  header.Version = graph_version;
+  header.VerseCount = verse_count;
+  header.EdgeCount = edges.size();
+  header.StampLength = stamp.size();
+
+  std::string body(sizeof(CrossRefHeader), '\0');
+  header.StampOffset = body.size();
+  body += stamp;
+  pad(body);
+
+  // Forward arrays: edges are sorted by source, then target
+  std::vector<uint32_t> counts(verse_count, 0);
+  for(const std::pair<uint32_t, uint32_t> & edge : edges) counts[edge.first]++;
+  header.ForwardOffsetsOffset = body.size();
+  WriteOffsets(body, counts);
+  header.ForwardTargetsOffset = body.size();
+  for(const std::pair<uint32_t, uint32_t> & edge : edges)
+  {
+    body.append(reinterpret_cast<const char *>(&edge.second), 4);
+  }
+
+  // Reverse arrays: the same edges sorted by target, then source
+  for(std::pair<uint32_t, uint32_t> & edge : edges) std::swap(edge.first, edge.second);
+  std::sort(edges.begin(), edges.end());
+  std::fill(counts.begin(), counts.end(), 0);
+  for(const std::pair<uint32_t, uint32_t> & edge : edges) counts[edge.first]++;
+  header.ReverseOffsetsOffset = body.size();
+  WriteOffsets(body, counts);
+  header.ReverseTargetsOffset = body.size();
+  for(const std::pair<uint32_t, uint32_t> & edge : edges)
+  {
+    body.append(reinterpret_cast<const char *>(&edge.second), 4);
+  }
+  header.FileSize = body.size();
+  std::memcpy(&body[0], &header, sizeof(header));
+
+  return ReplaceFileContents(file_name, body);
+}
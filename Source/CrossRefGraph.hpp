@@ -0,0 +1,66 @@
+// Machaira: CrossRefGraph.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the cross-reference graph of a Bible or commentary: every
+// reference found in the module, stored as forward and reverse adjacency
+// arrays (CSR) keyed by verse ID in a memory-mapped file
+// Current version: Pre-release
+
+#ifndef CROSSREFGRAPH_HPP
+#define CROSSREFGRAPH_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <swmodule.h>
+#include <versekey.h>
+
+#include "MappedFile.hpp"
+
+struct CrossReference
+{
+  // Module the reference was found in, and the verse on the other end
+  std::string Module;
+  uint32_t VerseId;
+  std::string Verse;
+};
+
+// Verse IDs are indexes in the KJV versification, so graphs of modules
+// with other versifications can be queried together
+uint32_t CrossRefVerseId(const sword::VerseKey & verse);
+std::string CrossRefVerseText(uint32_t verse_id);
+
+class CrossRefGraph
+{
+  public:
+    // Constructor
+    CrossRefGraph();
+    bool Open(std::string file_name);
+    std::string GetStamp();
+    uint32_t GetEdgeCount(){ return edge_count; }
+    // Verses referenced from a verse, and verses referring to it; the
+    // returned range points into the mapped file
+    bool GetOutgoing(uint32_t verse_id, const uint32_t *& begin,
+      const uint32_t *& end);
+    bool GetIncoming(uint32_t verse_id, const uint32_t *& begin,
+      const uint32_t *& end);
+  private:
+    bool GetRange(const uint32_t * offsets, const uint32_t * targets,
+      uint32_t verse_id, const uint32_t *& begin, const uint32_t *& end);
+    MappedFile file;
+    uint32_t verse_count;
+    uint32_t edge_count;
+    const uint32_t * forward_offsets;
+    const uint32_t * forward_targets;
+    const uint32_t * reverse_offsets;
+    const uint32_t * reverse_targets;
+    const char * stamp;
+    uint32_t stamp_length;
+};
+
+// Extracts the references of every entry (OSIS <reference osisRef>, ThML
+// <scripRef>) and writes the module's graph file
+bool BuildCrossRefGraph(sword::SWModule * module, std::string stamp,
+  std::string file_name);
+
+#endif
@@ -0,0 +1,327 @@
+// Machaira: DirInstallMgr.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file extends the SWORD install manager with local directory sources
+// (file:// paths laid out like a remote repository, i.e. mods.d/ and
+// modules/), so catalogs and installs can be exercised offline
+// Current version: Pre-release
+
+#include "DirInstallMgr.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+
+#include <swconfig.h>
+
+namespace
+{
+  // Same contents, read side by side (only called for files of equal size)
+  bool SameContents(const std::filesystem::path & a,
+    const std::filesystem::path & b)
+  {
+    std::ifstream fa(a, std::ios::binary);
+    std::ifstream fb(b, std::ios::binary);
+    if(!fa || !fb) return false;
+    std::vector<char> buf_a(64*1024), buf_b(64*1024);
+    while(fa && fb)
+    {
+      fa.read(buf_a.data(), buf_a.size());
+      fb.read(buf_b.data(), buf_b.size());
+      if(fa.gcount() != fb.gcount() ||
+        !std::equal(buf_a.begin(), buf_a.begin() + fa.gcount(), buf_b.begin()))
+      {
+        return false;
+      }
+    }
+    return fa.eof() && fb.eof();
+  }
+}
+
+void InstallStatusReporter::SetCallback(
+  std::function<void(const InstallProgress &)> callback)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  this->callback = callback;
+}
+
+void InstallStatusReporter::Reset()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  progress = InstallProgress();
+}
+
+void InstallStatusReporter::Report(unsigned long total,
+  unsigned long completed, std::string message)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  progress.TotalBytes = total;
+  progress.CompletedBytes = completed;
+  progress.Message = message;
+  if(callback) callback(progress);
+}
+
+void InstallStatusReporter::update(unsigned long totalBytes,
+  unsigned long completedBytes)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  progress.TotalBytes = totalBytes;
+  progress.CompletedBytes = completedBytes;
+  if(callback) callback(progress);
+}
+
+void InstallStatusReporter::preStatus(long totalBytes, long completedBytes,
+  const char * message)
+{
+  // SWORD calls this once before each file of a transfer
+  std::lock_guard<std::mutex> lock(mutex);
+  progress.TotalBytes = totalBytes;
+  progress.CompletedBytes = completedBytes;
+  progress.FilesStarted++;
+  progress.Message = message ? message : "";
+  if(callback) callback(progress);
+}
+
+DirInstallMgr::DirInstallMgr(const char * private_path,
+  sword::StatusReporter * status_reporter) :
+  sword::InstallMgr(private_path, status_reporter),
+  private_path(private_path), cancelled(false)
+{
+  ReadDirSources();
+}
+
+bool DirInstallMgr::IsDirSource(const sword::InstallSource * is)
+{
+  return std::string(is->type.c_str()) == "DIR";
+}
+
+void DirInstallMgr::AddDirSource(std::string caption, std::string path)
+{
+  // Config entry layout is caption|source|directory|user|password|uid
+  std::string uid = caption;
+  for(char & c : uid) if(!isalnum(static_cast<unsigned char>(c))) c = '_';
+  std::string conf_ent = caption + "|file://|" +
+    std::filesystem::absolute(path).string() + "|||" + uid;
+
+  sword::InstallSource * is = new sword::InstallSource("DIR", conf_ent.c_str());
+  is->localShadow = (private_path + "/" + uid).c_str();
+  sword::InstallSourceMap::iterator old = sources.find(caption.c_str());
+  if(old != sources.end()) delete old->second;
+  sources[caption.c_str()] = is;
+  // InstallMgr writes every source back as "<type>Source", so directory
+  // sources are stored in InstallMgr.conf as DIRSource entries
+  saveInstallConf();
+}
+
+void DirInstallMgr::ReadDirSources()
+{
+  // The stock reader only knows FTP/SFTP/HTTP/HTTPS sources
+  std::string conf_path = private_path + "/InstallMgr.conf";
+  if(!std::filesystem::exists(conf_path)) return;
+  sword::SWConfig config(conf_path.c_str());
+  sword::SectionMap::iterator section = config.Sections.find("Sources");
+  if(section == config.Sections.end()) return;
+  sword::ConfigEntMap::iterator it = section->second.lower_bound("DIRSource");
+  sword::ConfigEntMap::iterator end = section->second.upper_bound("DIRSource");
+  for(; it != end; it++)
+  {
+    sword::InstallSource * is = new sword::InstallSource("DIR",
+      it->second.c_str());
+    is->localShadow = (private_path + "/" + is->uid.c_str()).c_str();
+    sword::InstallSourceMap::iterator old = sources.find(is->caption);
+    if(old != sources.end()) delete old->second;
+    sources[is->caption] = is;
+  }
+}
+
+int DirInstallMgr::remoteCopy(sword::InstallSource * is, const char * src,
+  const char * dest, bool dirTransfer, const char * suffix)
+{
+  if(!IsDirSource(is))
+  {
+    return sword::InstallMgr::remoteCopy(is, src, dest, dirTransfer, suffix);
+  }
+
+  if(cancelled) return -1;
+  std::error_code ec;
+  std::filesystem::path from = std::filesystem::path(is->directory.c_str()) /
+    std::filesystem::path(src).relative_path();
+  std::filesystem::path to(dest);
+  if(!dirTransfer)
+  {
+    if(!std::filesystem::is_regular_file(from, ec)) return -1;
+    unsigned long size = std::filesystem::file_size(from, ec);
+    if(statusReporter) statusReporter->preStatus(size, 0, src);
+    std::filesystem::create_directories(to.parent_path(), ec);
+    CopyChangedFile(from, to, to, ec);
+    if(statusReporter && !ec) statusReporter->update(size, size);
+    return ec ? -1 : 0;
+  }
+
+  if(!std::filesystem::is_directory(from, ec)) return -1;
+  // Collect the file list first so progress can report a total
+  std::string file_suffix(suffix ? suffix : "");
+  std::vector<std::filesystem::path> files;
+  unsigned long total_bytes = 0, completed_bytes = 0;
+  for(const auto & entry : std::filesystem::recursive_directory_iterator(from, ec))
+  {
+    if(!entry.is_regular_file()) continue;
+    std::string name = entry.path().filename().string();
+    if(file_suffix.size() > 0 && (name.size() < file_suffix.size() ||
+      name.compare(name.size()-file_suffix.size(), file_suffix.size(),
+      file_suffix) != 0)) continue;
+    files.push_back(entry.path());
+    total_bytes += entry.file_size();
+  }
+  for(size_t n = 0; n < files.size(); n++)
+  {
+    if(cancelled) return -1;
+    std::filesystem::path target = to /
+      std::filesystem::relative(files[n], from);
+    if(statusReporter)
+    {
+      std::string message = "Copying (" + std::to_string(n+1) + " of " +
+        std::to_string(files.size()) + "): " + files[n].filename().string();
+      statusReporter->preStatus(total_bytes, completed_bytes, message.c_str());
+    }
+    std::filesystem::create_directories(target.parent_path(), ec);
+    CopyChangedFile(files[n], target, target, ec);
+    if(ec)
+    {
+      std::cout << "Error copying " << files[n] << ": " << ec.message() << '\n';
+      return -1;
+    }
+    completed_bytes += std::filesystem::file_size(files[n], ec);
+    if(statusReporter) statusReporter->update(total_bytes, completed_bytes);
+  }
+  return 0;
+}
+
+int DirInstallMgr::installModule(sword::SWMgr * destMgr,
+  const char * fromLocation, const char * modName, sword::InstallSource * is)
+{
+  if(!is || !IsDirSource(is))
+  {
+    return sword::InstallMgr::installModule(destMgr, fromLocation, modName, is);
+  }
+  namespace fs = std::filesystem;
+  if(cancelled) return -1;
+  std::error_code ec;
+  fs::path source_dir(is->directory.c_str());
+  fs::path dest_dir(destMgr->prefixPath);
+  fs::path installed_dir = installed_library.empty() ? dest_dir :
+    fs::path(installed_library);
+
+  // The module's config in the source
+  fs::path conf_file;
+  sword::ConfigEntMap section;
+  for(const auto & entry : fs::directory_iterator(source_dir / "mods.d", ec))
+  {
+    if(entry.path().extension() != ".conf") continue;
+    sword::SWConfig config(entry.path().string().c_str());
+    sword::SectionMap::iterator found = config.getSections().find(modName);
+    if(found == config.getSections().end()) continue;
+    conf_file = entry.path();
+    section = found->second;
+    break;
+  }
+  if(conf_file.empty())
+  {
+    std::cout << "Error: " << is->caption.c_str() << " has no config for " <<
+      modName << '\n';
+    return -1;
+  }
+
+  // Files named by File entries, else everything in the data directory
+  // (DataPath ends in a file name prefix for some drivers), as SWORD copies
+  // them; paths are relative to the library
+  std::vector<fs::path> files;
+  for(sword::ConfigEntMap::iterator it = section.lower_bound("File");
+    it != section.upper_bound("File"); ++it)
+  {
+    files.push_back(fs::path(it->second.c_str()).relative_path());
+  }
+  if(files.empty())
+  {
+    sword::ConfigEntMap::iterator data_path = section.find("DataPath");
+    if(data_path == section.end()) return -1;
+    std::string data_dir(data_path->second.c_str());
+    if(data_dir.compare(0, 2, "./") == 0) data_dir.erase(0, 2);
+    if(data_dir.empty()) return -1;
+    if(data_dir.back() != '/') data_dir.erase(data_dir.rfind('/') + 1);
+    for(const auto & entry :
+      fs::recursive_directory_iterator(source_dir / data_dir, ec))
+    {
+      if(!entry.is_regular_file()) continue;
+      files.push_back(fs::relative(entry.path(), source_dir));
+    }
+  }
+  files.push_back(fs::path("mods.d") / conf_file.filename());
+
+  unsigned long total_bytes = 0, completed_bytes = 0;
+  for(const fs::path & file : files)
+  {
+    total_bytes += fs::file_size(source_dir / file, ec);
+  }
+  for(size_t n = 0; n < files.size(); n++)
+  {
+    if(cancelled) return -1;
+    if(statusReporter)
+    {
+      std::string message = "Checking (" + std::to_string(n+1) + " of " +
+        std::to_string(files.size()) + "): " + files[n].filename().string();
+      statusReporter->preStatus(total_bytes, completed_bytes, message.c_str());
+    }
+    fs::path target = dest_dir / files[n];
+    fs::create_directories(target.parent_path(), ec);
+    CopyChangedFile(source_dir / files[n], installed_dir / files[n], target, ec);
+    if(ec)
+    {
+      std::cout << "Error copying " << files[n] << ": " << ec.message() << '\n';
+      return -1;
+    }
+    completed_bytes += fs::file_size(source_dir / files[n], ec);
+    if(statusReporter) statusReporter->update(total_bytes, completed_bytes);
+  }
+  return 0;
+}
+
+bool DirInstallMgr::CopyChangedFile(const std::filesystem::path & from,
+  const std::filesystem::path & installed, const std::filesystem::path & to,
+  std::error_code & ec)
+{
+  // Copies keep the source's modification time, so a file copied before
+  // is recognised without reading it; otherwise equal sizes are compared
+  // byte for byte. The installed copy is never touched (its time is part of
+  // the module's index stamps)
+  ec.clear();
+  std::error_code ignored;
+  std::uintmax_t size = std::filesystem::file_size(from, ec);
+  if(ec) return false;
+  std::filesystem::file_time_type modified =
+    std::filesystem::last_write_time(from, ec);
+  if(ec) return false;
+  if(std::filesystem::is_regular_file(installed, ignored) &&
+    std::filesystem::file_size(installed, ignored) == size &&
+    (std::filesystem::last_write_time(installed, ignored) == modified ||
+    SameContents(from, installed)))
+  {
+    transfer_stats.FilesSkipped++;
+    transfer_stats.BytesSkipped += size;
+    return false;
+  }
+  std::filesystem::copy_file(from, to,
+    std::filesystem::copy_options::overwrite_existing, ec);
+  if(ec) return false;
+  std::filesystem::last_write_time(to, modified, ignored);
+  transfer_stats.FilesCopied++;
+  transfer_stats.BytesCopied += size;
+  return true;
+}
+
+void DirInstallMgr::terminate()
+{
+  cancelled = true;
+  sword::InstallMgr::terminate();
+}
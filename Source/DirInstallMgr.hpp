@@ -0,0 +1,99 @@
+// Machaira: DirInstallMgr.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file extends the SWORD install manager with local directory sources
+// (file:// paths laid out like a remote repository, i.e. mods.d/ and
+// modules/), so catalogs and installs can be exercised offline
+// Current version: Pre-release
+
+#ifndef DIRINSTALLMGR_HPP
+#define DIRINSTALLMGR_HPP
+
+#include <string>
+#include <filesystem>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+#include <installmgr.h>
+#include <remotetrans.h>
+
+struct InstallProgress
+{
+  unsigned long TotalBytes = 0;
+  unsigned long CompletedBytes = 0;
+  int FilesStarted = 0;
+  std::string Message;
+};
+
+// Forwards SWORD transfer status (bytes and files) to a callback, which is
+// called on whatever thread runs the transfer
+class InstallStatusReporter : public sword::StatusReporter
+{
+  public:
+    void SetCallback(std::function<void(const InstallProgress &)> callback);
+    void Reset();
+    // Progress through a batch (TotalBytes and CompletedBytes then count
+    // modules)
+    void Report(unsigned long total, unsigned long completed,
+      std::string message);
+    virtual void update(unsigned long totalBytes, unsigned long completedBytes);
+    virtual void preStatus(long totalBytes, long completedBytes,
+      const char * message);
+  private:
+    std::mutex mutex;
+    std::function<void(const InstallProgress &)> callback;
+    InstallProgress progress;
+};
+
+// Files copied from directory sources, and those left alone because the
+// installed copy already matched (same size and time, or same contents);
+// remote sources count nothing
+struct TransferStats
+{
+  unsigned long FilesCopied = 0;
+  unsigned long FilesSkipped = 0;
+  unsigned long BytesCopied = 0;
+  unsigned long BytesSkipped = 0;
+};
+
+class DirInstallMgr : public sword::InstallMgr
+{
+  public:
+    // Constructor
+    DirInstallMgr(const char * private_path,
+      sword::StatusReporter * status_reporter = 0);
+    // Local Directory Sources
+    static bool IsDirSource(const sword::InstallSource * is);
+    void AddDirSource(std::string caption, std::string path);
+    void ReadDirSources();
+    // Transfers from local directory sources are plain file copies (a file
+    // already at dest with the same contents is left alone)
+    virtual int remoteCopy(sword::InstallSource * is, const char * src,
+      const char * dest, bool dirTransfer = false, const char * suffix = "");
+    // Modules from local directory sources are copied straight into
+    // destMgr's library, but only the files (data and config) that differ
+    // from the installed copy in the installed library, so an update writes
+    // just what the new version changed; other sources go through SWORD
+    virtual int installModule(sword::SWMgr * destMgr, const char * fromLocation,
+      const char * modName, sword::InstallSource * is = 0);
+    // Library the installed copies are in (destMgr's own when empty)
+    void SetInstalledLibrary(std::string library_dir){ installed_library = library_dir; }
+    // Cancellation (terminate may be called from any thread)
+    virtual void terminate();
+    void ResetCancel(){ cancelled = false; }
+    bool IsCancelled(){ return cancelled; }
+    // Get/Set
+    TransferStats GetTransferStats(){ return transfer_stats; }
+    void ResetTransferStats(){ transfer_stats = TransferStats(); }
+  private:
+    // Copies from to to unless installed matches it; true when copied
+    bool CopyChangedFile(const std::filesystem::path & from,
+      const std::filesystem::path & installed,
+      const std::filesystem::path & to, std::error_code & ec);
+    std::string private_path;
+    std::string installed_library;
+    TransferStats transfer_stats;
+    std::atomic<bool> cancelled;
+};
+
+#endif
@@ -0,0 +1,165 @@
+// Machaira: HoverPreviewer.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file renders previews of hovered links on a background thread (with
+// its own SWORD manager): a lookup starts once the pointer has rested on a
+// link, and a newer hover cancels any lookup still in progress
+// Current version: Pre-release
+
+#include "HoverPreviewer.hpp"
+#include "Trace.hpp"
+
+HoverPreviewer::HoverPreviewer(std::string library_dir,
+  std::function<void(const HoverPreview &)> on_ready,
+  std::chrono::milliseconds debounce) :
+  library_dir(library_dir), on_ready(on_ready), stopping(false), pending(false), generation(0),
+  debounce(debounce), previews(2*1024*1024)
+{
+  // Reader is created here, on the caller's thread, because SWORD's global
+  // managers are not safe to initialize from two threads at once
+  reader.reset(new SwordReader(library_dir));
+  worker = std::thread(&HoverPreviewer::Run, this);
+}
+
+HoverPreviewer::~HoverPreviewer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  worker.join();
+}
+
+unsigned long HoverPreviewer::Request(std::string key, PreviewRenderer render,
+  bool debounced)
+{
+  unsigned long my_generation;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(pending) stats.Debounced++;
+    pending = true;
+    my_generation = ++generation;
+    pending_key = key;
+    pending_render = render;
+    start_at = std::chrono::steady_clock::now();
+    if(debounced) start_at += debounce;
+    stats.Requests++;
+  }
+  wake.notify_all();
+  return my_generation;
+}
+
+void HoverPreviewer::Cancel()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  generation++;
+  pending = false;
+  pending_render = nullptr;
+}
+
+unsigned long HoverPreviewer::GetGeneration()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return generation;
+}
+
+HoverPreviewStats HoverPreviewer::GetStats()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+void HoverPreviewer::SetDebounce(std::chrono::milliseconds interval)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  debounce = interval;
+}
+
+void HoverPreviewer::SetDisplayOptions(const DisplayOptions & options)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if(options == display_options) return;
+  display_options = options;
+  generation++;
+  pending = false;
+  pending_render = nullptr;
+  previews.Clear();
+}
+
+void HoverPreviewer::ClearPreviews()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  previews.Clear();
+}
+
+void HoverPreviewer::ReloadLibrary()
+{
+  // Created on the caller's thread, as in the constructor
+  std::unique_ptr<SwordReader> fresh(new SwordReader(library_dir));
+  std::lock_guard<std::mutex> lock(mutex);
+  next_reader.swap(fresh);
+  generation++;
+  pending = false;
+  pending_render = nullptr;
+  previews.Clear();
+}
+
+bool HoverPreviewer::IsStale(unsigned long my_generation)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return stopping || generation != my_generation;
+}
+
+void HoverPreviewer::Run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+  {
+    wake.wait(lock, [this]{ return stopping || pending; });
+    // Each newer request moves start_at on, so only the last of a run of
+    // hovers is looked up
+    while(!stopping && pending && std::chrono::steady_clock::now() < start_at)
+    {
+      wake.wait_until(lock, start_at);
+    }
+    if(stopping) return;
+    if(!pending) continue;
+    pending = false;
+    unsigned long my_generation = generation;
+    PreviewRenderer render = pending_render;
+    pending_render = nullptr;
+    HoverPreview preview;
+    preview.Generation = my_generation;
+    preview.Key = pending_key;
+    if(next_reader) reader.swap(next_reader);
+    next_reader.reset();
+    bool cached = previews.Get(preview.Key, preview.Html);
+    if(cached) stats.CacheHits++;
+    else reader->SetDisplayOptions(display_options);
+    lock.unlock();
+
+    if(!cached)
+    {
+      TRACE_SCOPE("hover.Render");
+      preview.Html = render(*reader,
+        [this, my_generation]{ return IsStale(my_generation); });
+    }
+
+    lock.lock();
+    if(stopping) return;
+    // Results of replaced requests may be incomplete, so are never kept
+    if(generation != my_generation)
+    {
+      stats.Cancelled++;
+      continue;
+    }
+    if(!cached)
+    {
+      previews.Put(preview.Key, preview.Html);
+      stats.Rendered++;
+    }
+    lock.unlock();
+    on_ready(preview);
+    lock.lock();
+  }
+}
@@ -0,0 +1,99 @@
+// Machaira: HoverPreviewer.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file renders previews of hovered links on a background thread (with
+// its own SWORD manager): a lookup starts once the pointer has rested on a
+// link, and a newer hover cancels any lookup still in progress
+// Current version: Pre-release
+
+#ifndef HOVERPREVIEWER_HPP
+#define HOVERPREVIEWER_HPP
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+#include "SwordReader.hpp"
+#include "RenderCache.hpp"
+
+struct HoverPreview
+{
+  // Generation of the request it answers
+  unsigned long Generation = 0;
+  std::string Key;
+  std::string Html;
+};
+
+struct HoverPreviewStats
+{
+  unsigned long Requests = 0;
+  // Requests replaced by a newer one before their lookup started
+  unsigned long Debounced = 0;
+  // Lookups stopped (or their result dropped) because a newer request came
+  unsigned long Cancelled = 0;
+  unsigned long Rendered = 0;
+  unsigned long CacheHits = 0;
+};
+
+// Renders a preview with the previewer's reader; cancelled turns true once
+// the request has been replaced, and the result is then thrown away
+typedef std::function<std::string(SwordReader & reader,
+  const std::function<bool()> & cancelled)> PreviewRenderer;
+
+class HoverPreviewer
+{
+  public:
+    // Constructor (on_ready is called on the worker thread)
+    HoverPreviewer(std::string library_dir,
+      std::function<void(const HoverPreview &)> on_ready,
+      std::chrono::milliseconds debounce = std::chrono::milliseconds(150));
+    ~HoverPreviewer();
+    // Replaces any earlier request and returns its generation; the lookup
+    // starts once no newer request has come for the debounce interval (at
+    // once when debounced is false). Previews are cached under key, which
+    // must name everything the preview depends on
+    unsigned long Request(std::string key, PreviewRenderer render,
+      bool debounced = true);
+    // Drops the current request, so nothing more is delivered for it
+    void Cancel();
+    // Latest generation, so results that arrive late can be told apart
+    unsigned long GetGeneration();
+    // Get/Set
+    HoverPreviewStats GetStats();
+    void SetDebounce(std::chrono::milliseconds interval);
+    // Drops cached previews (and any lookup in progress), since they were
+    // rendered with the old options
+    void SetDisplayOptions(const DisplayOptions & options);
+    void ClearPreviews();
+    // After modules are installed or updated: cached previews (and any
+    // lookup in progress) are dropped, and the worker moves to a new
+    // reader, created here, before its next lookup
+    void ReloadLibrary();
+  private:
+    void Run();
+    bool IsStale(unsigned long my_generation);
+    // Worker state (reader is only used on the worker thread)
+    std::string library_dir;
+    std::unique_ptr<SwordReader> reader;
+    std::unique_ptr<SwordReader> next_reader;
+    std::function<void(const HoverPreview &)> on_ready;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    bool pending;
+    unsigned long generation;
+    std::string pending_key;
+    PreviewRenderer pending_render;
+    std::chrono::steady_clock::time_point start_at;
+    std::chrono::milliseconds debounce;
+    DisplayOptions display_options;
+    // Finished previews, so hovering a link again is immediate
+    RenderCache previews;
+    HoverPreviewStats stats;
+};
+
+#endif
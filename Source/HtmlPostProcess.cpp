@@ -0,0 +1,190 @@
+// Machaira: HtmlPostProcess.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file converts rendered SWORD output into the HTML shown by the UI:
+// non-ASCII characters become hexadecimal entities and SWORD's
+// passagestudy.jsp links are condensed to action_type_value hrefs
+// Current version: Pre-release
+
+#include "HtmlPostProcess.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+  #include <emmintrin.h>
+  #define MACHAIRA_SSE2_ASCII
+#endif
+
+namespace
+{
+  const char hex_digits[] = "0123456789abcdef";
+
+  // Length of the leading run of bytes that are copied through unchanged
+  // (every byte up to and including 0x7e)
+  size_t AsciiRunLength(const char * p, const char * end)
+  {
+    const char * start = p;
+#ifdef MACHAIRA_SSE2_ASCII
+    const __m128i limit = _mm_set1_epi8(0x7e);
+    while(end - p >= 16)
+    {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      // Bytes >= 0x80 are negative as signed chars (sign bit already set),
+      // 0x7f is the only byte that compares greater than 0x7e
+      __m128i special = _mm_or_si128(chunk, _mm_cmpgt_epi8(chunk, limit));
+      int mask = _mm_movemask_epi8(special);
+      if(mask != 0) return (p - start) + __builtin_ctz(mask);
+      p += 16;
+    }
+#else
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    while(end - p >= 8)
+    {
+      uint64_t word;
+      std::memcpy(&word, p, 8);
+      // High bit set in any byte that is >= 0x80 or equal to 0x7f
+      if(((word + ones) | word) & highs) break;
+      p += 8;
+    }
+#endif
+    while(p < end && static_cast<unsigned char>(*p) <= 0x7e) p++;
+    return p - start;
+  }
+
+  // Decode one UTF-8 sequence starting at p; invalid or truncated sequences
+  // consume a single byte and decode to U+FFFD
+  uint32_t DecodeUtf8(const char *& p, const char * end)
+  {
+    const unsigned char * s = reinterpret_cast<const unsigned char *>(p);
+    size_t avail = end - p;
+    uint32_t c = s[0];
+    size_t len = 1;
+    uint32_t min = 0;
+    if(c < 0x80) { p++; return c; }
+    else if(c >= 0xc2 && c <= 0xdf) { len = 2; c &= 0x1f; min = 0x80; }
+    else if(c >= 0xe0 && c <= 0xef) { len = 3; c &= 0x0f; min = 0x800; }
+    else if(c >= 0xf0 && c <= 0xf4) { len = 4; c &= 0x07; min = 0x10000; }
+    else { p++; return 0xfffd; }
+
+    if(avail < len) { p++; return 0xfffd; }
+    for(size_t n = 1; n < len; n++)
+    {
+      if((s[n] & 0xc0) != 0x80) { p++; return 0xfffd; }
+      c = (c << 6) | (s[n] & 0x3f);
+    }
+    if(c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+    {
+      p++;
+      return 0xfffd;
+    }
+    p += len;
+    return c;
+  }
+
+  // Entity format matches the original renderer: "&#x", at least four
+  // lowercase hex digits, then a newline
+  void AppendEntity(uint32_t c, std::string & output)
+  {
+    char buf[16];
+    int digits = 4;
+    while(digits < 8 && (c >> (4*digits)) != 0) digits++;
+    buf[0] = '&'; buf[1] = '#'; buf[2] = 'x';
+    for(int n = 0; n < digits; n++)
+    {
+      buf[3+n] = hex_digits[(c >> (4*(digits-1-n))) & 0xf];
+    }
+    buf[3+digits] = '\n';
+    output.append(buf, 4+digits);
+  }
+
+  void EncodeEntities(const char * p, const char * end, std::string & output)
+  {
+    while(p < end)
+    {
+      size_t run = AsciiRunLength(p, end);
+      output.append(p, run);
+      p += run;
+      if(p < end) AppendEntity(DecodeUtf8(p, end), output);
+    }
+  }
+
+  // Rewrite one (already entity-encoded) <a ...>text</a> element as
+  // <a href="action_type_value">text</a>; returns false, leaving the
+  // element untouched, if it is too malformed to take apart
+  bool CondenseLink(std::string_view link, std::string & condensed)
+  {
+    size_t p1, p2;
+
+    p1 = link.find("action=", 0); p1 += 7;
+    if(p1 > link.size()) return false;
+    p2 = link.find('&', p1);
+    std::string_view l_action = link.substr(p1, p2-p1);
+
+    p1 = link.find("type=", 0); p1 += 5;
+    if(p1 > link.size()) return false;
+    p2 = link.find('&', p1);
+    std::string_view l_type = link.substr(p1, p2-p1);
+
+    p1 = link.find("value=", 0); p1 += 6;
+    if(p1 > link.size()) return false;
+    p2 = std::min(link.find('\"', p1), link.find('&', p1));
+    std::string_view l_val = link.substr(p1, p2-p1);
+
+    p1 = link.find('>', 0); p1 += 1;
+    if(p1 > link.size()) return false;
+    p2 = link.find('<', p1);
+    std::string_view l_text = link.substr(p1, p2-p1);
+
+    condensed.clear();
+    condensed += "<a href=\"";
+    condensed += l_action; condensed += '_';
+    condensed += l_type; condensed += '_';
+    condensed += l_val; condensed += "\">";
+    condensed += l_text; condensed += "</a>";
+    return true;
+  }
+}
+
+void PostProcessHtml(const std::string & input, std::string & output)
+{
+  TRACE_SCOPE("html.PostProcessHtml");
+  output.clear();
+  output.reserve(input.size() + input.size()/4 + 64);
+  std::string condensed;
+  const char * data = input.data();
+  size_t pos = 0, a_begin, a_end;
+  // Link markers are plain ASCII, so they can be found in the raw UTF-8
+  // input; each link is encoded into the output and then condensed in place
+  while((a_begin = input.find("<a", pos)) != std::string::npos)
+  {
+    EncodeEntities(data + pos, data + a_begin, output);
+    a_end = input.find("</a>", a_begin);
+    a_end = (a_end == std::string::npos) ? input.size() : a_end + 4;
+    size_t link_start = output.size();
+    EncodeEntities(data + a_begin, data + a_end, output);
+    if(CondenseLink(std::string_view(output).substr(link_start), condensed))
+    {
+      output.resize(link_start);
+      output += condensed;
+    }
+    pos = a_end;
+  }
+  EncodeEntities(data + pos, data + input.size(), output);
+}
+
+std::string PostProcessHtml(const std::string & input)
+{
+  std::string output;
+  PostProcessHtml(input, output);
+  return output;
+}
+
+void AppendEncodedHtml(const char * begin, const char * end,
+  std::string & output)
+{
+  EncodeEntities(begin, end, output);
+}
@@ -0,0 +1,22 @@
+// Machaira: HtmlPostProcess.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file converts rendered SWORD output into the HTML shown by the UI:
+// non-ASCII characters become hexadecimal entities and SWORD's
+// passagestudy.jsp links are condensed to action_type_value hrefs
+// Current version: Pre-release
+
+#ifndef HTMLPOSTPROCESS_HPP
+#define HTMLPOSTPROCESS_HPP
+
+#include <string>
+
+// Single linear pass over the input; output is written into one buffer,
+// which is cleared first (callers may reuse it between passages)
+void PostProcessHtml(const std::string & input, std::string & output);
+std::string PostProcessHtml(const std::string & input);
+// Appends text with non-ASCII characters entity-encoded (no link handling),
+// for HTML built from parsed entries
+void AppendEncodedHtml(const char * begin, const char * end,
+  std::string & output);
+
+#endif
@@ -0,0 +1,126 @@
+// Machaira: JobQueue.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file runs long backend operations (catalog downloads, module
+// installs) one at a time on a worker thread, with cancellation and
+// completion callbacks, so the UI thread never waits on the network
+// Current version: Pre-release
+
+#include "JobQueue.hpp"
+
+JobQueue::JobQueue() :
+  next_id(1), running_id(0), running_context(0), stopping(false)
+{
+  worker = std::thread(&JobQueue::Run, this);
+}
+
+JobQueue::~JobQueue()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    // Queued jobs are dropped without callbacks; the owner is going away
+    queued.clear();
+  }
+  CancelAll();
+  wake.notify_all();
+  worker.join();
+}
+
+unsigned long JobQueue::Submit(std::string name, JobFunction job,
+  CompletionFunction done)
+{
+  unsigned long id;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    id = next_id++;
+    queued.push_back(Job{id, name, job, done});
+  }
+  wake.notify_all();
+  return id;
+}
+
+void JobQueue::Cancel(unsigned long id)
+{
+  std::function<void()> hook;
+  Job dropped{0, "", JobFunction(), CompletionFunction()};
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(running_id == id && running_context)
+    {
+      running_context->Cancel();
+      hook = cancel_hook;
+    }
+    for(auto it = queued.begin(); it != queued.end(); it++)
+    {
+      if(it->Id != id) continue;
+      dropped = *it;
+      queued.erase(it);
+      break;
+    }
+  }
+  if(hook) hook();
+  if(dropped.Id != 0) Finish(dropped, false, true, "Cancelled before start");
+}
+
+void JobQueue::CancelAll()
+{
+  std::deque<Job> dropped;
+  std::function<void()> hook;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(running_context)
+    {
+      running_context->Cancel();
+      hook = cancel_hook;
+    }
+    dropped.swap(queued);
+  }
+  if(hook) hook();
+  for(const Job & job : dropped) Finish(job, false, true, "Cancelled before start");
+}
+
+bool JobQueue::IsBusy()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return running_id != 0 || !queued.empty();
+}
+
+void JobQueue::SetCancelHook(std::function<void()> hook)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  cancel_hook = hook;
+}
+
+void JobQueue::Finish(const Job & job, bool success, bool cancelled,
+  std::string message)
+{
+  if(!job.Done) return;
+  JobResult result{job.Id, job.Name, success, cancelled, message};
+  job.Done(result);
+}
+
+void JobQueue::Run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+  {
+    wake.wait(lock, [this]{ return stopping || !queued.empty(); });
+    if(stopping) return;
+    Job job = queued.front();
+    queued.pop_front();
+    JobContext context;
+    running_id = job.Id;
+    running_context = &context;
+    lock.unlock();
+
+    bool success = job.Function(context);
+
+    lock.lock();
+    running_id = 0;
+    running_context = 0;
+    lock.unlock();
+    Finish(job, success && !context.IsCancelled(), context.IsCancelled(),
+      context.Message);
+    lock.lock();
+  }
+}
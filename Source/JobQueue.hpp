@@ -0,0 +1,78 @@
+// Machaira: JobQueue.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file runs long backend operations (catalog downloads, module
+// installs) one at a time on a worker thread, with cancellation and
+// completion callbacks, so the UI thread never waits on the network
+// Current version: Pre-release
+
+#ifndef JOBQUEUE_HPP
+#define JOBQUEUE_HPP
+
+#include <string>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class JobContext
+{
+  public:
+    JobContext() : cancelled(false) {}
+    bool IsCancelled(){ return cancelled; }
+    void Cancel(){ cancelled = true; }
+    // Text reported back with the result (e.g. an error description)
+    std::string Message;
+  private:
+    std::atomic<bool> cancelled;
+};
+
+struct JobResult
+{
+  unsigned long Id;
+  std::string Name;
+  bool Success;
+  bool Cancelled;
+  std::string Message;
+};
+
+class JobQueue
+{
+  public:
+    typedef std::function<bool(JobContext &)> JobFunction;
+    // Completion callbacks run on the worker thread
+    typedef std::function<void(const JobResult &)> CompletionFunction;
+    // Constructor
+    JobQueue();
+    ~JobQueue();
+    // Jobs
+    unsigned long Submit(std::string name, JobFunction job,
+      CompletionFunction done = CompletionFunction());
+    void Cancel(unsigned long id);
+    void CancelAll();
+    bool IsBusy();
+    // Called when the running job is cancelled, to abort blocking work
+    void SetCancelHook(std::function<void()> hook);
+  private:
+    struct Job
+    {
+      unsigned long Id;
+      std::string Name;
+      JobFunction Function;
+      CompletionFunction Done;
+    };
+    void Run();
+    void Finish(const Job & job, bool success, bool cancelled, std::string message);
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> queued;
+    unsigned long next_id;
+    unsigned long running_id;
+    JobContext * running_context;
+    std::function<void()> cancel_hook;
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,235 @@
+// Machaira: LexiconIndex.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the key index of a dictionary or lexicon: every entry key,
+// folded for matching and sorted, in a memory-mapped file, for exact and
+// prefix lookups without going through SWORD
+// Current version: Pre-release
+
+#include "LexiconIndex.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+// Index file layout (host byte order):
+//   LexiconIndexHeader, stamp text, padding to 8 bytes
+//   LexiconKeyEntry[key_count], sorted by folded key, then by key
+//   text of the folded and module keys, back to back
+struct LexiconIndexHeader
+{
+  char Magic[4];
+  uint32_t Version;
+  uint32_t KeyCount;
+  uint32_t StampLength;
+  uint64_t StampOffset;
+  uint64_t EntriesOffset;
+  uint64_t TextOffset;
+  uint64_t TextSize;
+  uint64_t FileSize;
+};
+
+struct LexiconKeyEntry
+{
+  uint32_t FoldedOffset;
+  uint32_t FoldedLength;
+  uint32_t KeyOffset;
+  uint32_t KeyLength;
+};
+
+static const char lexicon_magic[4] = {'M', 'X', 'L', 'K'};
+static const uint32_t lexicon_version = 1;
+
+std::string FoldLexiconKey(const std::string & key)
+{
+  // Surrounding spaces are dropped, ASCII letters upper-cased (SWORD's own
+  // lexicon keys are upper case); other bytes are kept as they are
+  size_t begin = key.find_first_not_of(" \t");
+  if(begin == std::string::npos) return "";
+  size_t end = key.find_last_not_of(" \t") + 1;
+  std::string folded;
+  folded.reserve(end - begin);
+  bool numeric = true;
+  for(size_t n = begin; n < end; n++)
+  {
+    unsigned char c = key[n];
+    if(c < 0x80) c = std::toupper(c);
+    if(!std::isdigit(c)) numeric = false;
+    folded += char(c);
+  }
+  if(numeric)
+  {
+    size_t zeros = folded.find_first_not_of('0');
+    if(zeros == std::string::npos) return "0";
+    folded.erase(0, zeros);
+  }
+  return folded;
+}
+
+LexiconIndex::LexiconIndex() :
+  key_count(0), entries(0), text(0), stamp(0), stamp_length(0)
+{
+}
+
+bool LexiconIndex::Open(std::string file_name)
+{
+  if(!file.Open(file_name)) return false;
+  if(file.Size() < sizeof(LexiconIndexHeader))
+  {
+    file.Close();
+    return false;
+  }
+  const LexiconIndexHeader * header =
+    reinterpret_cast<const LexiconIndexHeader *>(file.Data());
+  if(std::memcmp(header->Magic, lexicon_magic, 4) != 0 ||
+    header->Version != lexicon_version || header->FileSize != file.Size() ||
+    header->StampOffset + header->StampLength > file.Size() ||
+    header->EntriesOffset + sizeof(LexiconKeyEntry)*uint64_t(header->KeyCount) >
+      file.Size() ||
+    header->TextOffset + header->TextSize > file.Size())
+  {
+    file.Close();
+    return false;
+  }
+  entries = reinterpret_cast<const LexiconKeyEntry *>(file.Data() +
+    header->EntriesOffset);
+  // Every key must lie inside the text, so lookups need no checks
+  for(uint32_t n = 0; n < header->KeyCount; n++)
+  {
+    if(uint64_t(entries[n].FoldedOffset) + entries[n].FoldedLength >
+      header->TextSize ||
+      uint64_t(entries[n].KeyOffset) + entries[n].KeyLength > header->TextSize)
+    {
+      file.Close();
+      entries = 0;
+      return false;
+    }
+  }
+  key_count = header->KeyCount;
+  text = file.Data() + header->TextOffset;
+  stamp = file.Data() + header->StampOffset;
+  stamp_length = header->StampLength;
+  return true;
+}
+
+std::string LexiconIndex::GetStamp()
+{
+  if(!stamp) return "";
+  return std::string(stamp, stamp_length);
+}
+
+std::string LexiconIndex::FoldedText(const LexiconKeyEntry & entry)
+{
+  return std::string(text + entry.FoldedOffset, entry.FoldedLength);
+}
+
+std::string LexiconIndex::KeyText(const LexiconKeyEntry & entry)
+{
+  return std::string(text + entry.KeyOffset, entry.KeyLength);
+}
+
+const LexiconKeyEntry * LexiconIndex::LowerBound(const std::string & folded)
+{
+  return std::lower_bound(entries, entries + key_count, folded,
+    [this](const LexiconKeyEntry & entry, const std::string & value)
+    {
+      size_t length = std::min<size_t>(entry.FoldedLength, value.size());
+      int order = std::memcmp(text + entry.FoldedOffset, value.data(), length);
+      if(order != 0) return order < 0;
+      return entry.FoldedLength < value.size();
+    });
+}
+
+bool LexiconIndex::Find(const std::string & key, std::string & entry_key)
+{
+  if(!entries) return false;
+  std::string folded = FoldLexiconKey(key);
+  const LexiconKeyEntry * entry = LowerBound(folded);
+  if(entry == entries + key_count || entry->FoldedLength != folded.size() ||
+    std::memcmp(text + entry->FoldedOffset, folded.data(), folded.size()) != 0)
+  {
+    return false;
+  }
+  entry_key = KeyText(*entry);
+  return true;
+}
+
+size_t LexiconIndex::FindPrefix(const std::string & prefix, size_t max_keys,
+  std::vector<std::string> & keys)
+{
+  if(!entries) return 0;
+  std::string folded = FoldLexiconKey(prefix);
+  size_t added = 0;
+  for(const LexiconKeyEntry * entry = LowerBound(folded);
+    entry != entries + key_count && added < max_keys; ++entry)
+  {
+    if(entry->FoldedLength < folded.size() ||
+      std::memcmp(text + entry->FoldedOffset, folded.data(), folded.size()) != 0)
+    {
+      break;
+    }
+    keys.push_back(KeyText(*entry));
+    added++;
+  }
+  return added;
+}
+
+bool BuildLexiconIndex(sword::SWModule * module, std::string stamp,
+  std::string file_name)
+{
+  std::vector<std::pair<std::string, std::string>> keys;
+  module->setPosition(TOP);
+  for(; !module->popError(); module->increment(1))
+  {
+    std::string key(module->getKeyText());
+    keys.push_back(std::make_pair(FoldLexiconKey(key), key));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  std::vector<LexiconKeyEntry> key_entries;
+  key_entries.reserve(keys.size());
+  std::string key_text;
+  for(const std::pair<std::string, std::string> & key : keys)
+  {
+    LexiconKeyEntry entry;
+    entry.FoldedOffset = key_text.size();
+    entry.FoldedLength = key.first.size();
+    key_text += key.first;
+    // Keys that fold to themselves share their text
+    if(key.first == key.second) entry.KeyOffset = entry.FoldedOffset;
+    else
+    {
+      entry.KeyOffset = key_text.size();
+      key_text += key.second;
+    }
+    entry.KeyLength = key.second.size();
+    key_entries.push_back(entry);
+    if(key_text.size() > UINT32_MAX) return false;
+  }
+
+  auto pad = [](std::string & out)
+  {
+    while(out.size() % 8) out += '\0';
+  };
+  LexiconIndexHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, lexicon_magic, 4);
+  header.Version = lexicon_version;
+  header.KeyCount = key_entries.size();
+  header.StampLength = stamp.size();
+
+  std::string body(sizeof(LexiconIndexHeader), '\0');
+  header.StampOffset = body.size();
+  body += stamp;
+  pad(body);
+  header.EntriesOffset = body.size();
+  body.append(reinterpret_cast<const char *>(key_entries.data()),
+    sizeof(LexiconKeyEntry)*key_entries.size());
+  header.TextOffset = body.size();
+  header.TextSize = key_text.size();
+  body += key_text;
+  header.FileSize = body.size();
+  std::memcpy(&body[0], &header, sizeof(header));
+
+  return ReplaceFileContents(file_name, body);
+}
@@ -0,0 +1,64 @@
+// Machaira: LexiconIndex.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the key index of a dictionary or lexicon: every entry key,
+// folded for matching and sorted, in a memory-mapped file, for exact and
+// prefix lookups without going through SWORD
+// Current version: Pre-release
+
+#ifndef LEXICONINDEX_HPP
+#define LEXICONINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <swmodule.h>
+
+#include "MappedFile.hpp"
+
+struct LexiconMatch
+{
+  std::string Module;
+  // Key as the module has it ("03056", "ABBA")
+  std::string Key;
+};
+
+// Keys are matched ASCII case-insensitively, and numeric keys without
+// their leading zeros, so "3056" finds "03056"
+std::string FoldLexiconKey(const std::string & key);
+
+// Key record of an index file (defined with the file layout)
+struct LexiconKeyEntry;
+
+class LexiconIndex
+{
+  public:
+    // Constructor
+    LexiconIndex();
+    bool Open(std::string file_name);
+    std::string GetStamp();
+    uint32_t GetKeyCount(){ return key_count; }
+    // Module key matching key (folded), if there is one
+    bool Find(const std::string & key, std::string & entry_key);
+    // Module keys starting with prefix (folded), in folded order; adds at
+    // most max_keys and returns how many were added
+    size_t FindPrefix(const std::string & prefix, size_t max_keys,
+      std::vector<std::string> & keys);
+  private:
+    // First key whose folded text is not less than folded
+    const LexiconKeyEntry * LowerBound(const std::string & folded);
+    std::string FoldedText(const LexiconKeyEntry & entry);
+    std::string KeyText(const LexiconKeyEntry & entry);
+    MappedFile file;
+    uint32_t key_count;
+    const LexiconKeyEntry * entries;
+    const char * text;
+    const char * stamp;
+    uint32_t stamp_length;
+};
+
+// Writes a dictionary's key index (to a temporary name, then renamed)
+bool BuildLexiconIndex(sword::SWModule * module, std::string stamp,
+  std::string file_name);
+
+#endif
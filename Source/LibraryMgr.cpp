@@ -0,0 +1,540 @@
+// Machaira: LibraryMgr.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file extends the SWORD manager to open modules on first use, with
+// the classified module catalog kept in a binary snapshot so that startup
+// only has to check the module configs for changes, and to close the least
+// recently used modules again when a budget is exceeded
+// Current version: Pre-release
+
+#include "LibraryMgr.hpp"
+#include "MappedFile.hpp"
+#include "BinaryRecord.hpp"
+#include "SwordReader.hpp"
+#include "BlockCache.hpp"
+#include "Trace.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+
+#include <swconfig.h>
+#include <swoptfilter.h>
+
+#ifdef __linux__
+  #include <unistd.h>
+#endif
+#ifdef __GLIBC__
+  #include <malloc.h>
+#endif
+
+// Snapshot file layout (host byte order):
+//   magic, uint32 version
+//   uint32 conf count, then per config: string file, uint64 size,
+//     int64 modification time
+//   uint32 module count, then per module: strings name, type, language,
+//     description, version and config file, uint32 option count, then per option
+//     strings name and value, uint32 feature count, then the features
+static const char catalog_magic[4] = {'M', 'X', 'M', 'C'};
+static const uint32_t catalog_version = 3;
+// Modules used last, which the residency limits always leave open, so
+// switching between a few texts never reopens them
+static const size_t min_resident_modules = 4;
+
+namespace
+{
+  std::string ModuleText(const char * text)
+  {
+    return text ? std::string(text) : std::string();
+  }
+
+  // Classifies an open module (after its default options are set)
+  CatalogModule CatalogEntry(sword::SWModule * module, std::string conf_file)
+  {
+    CatalogModule entry;
+    entry.Name = ModuleText(module->getName());
+    entry.Type = ModuleText(module->getType());
+    entry.Language = ModuleText(module->getLanguage());
+    entry.Description = ModuleText(module->getDescription());
+    entry.Version = ModuleText(module->getConfigEntry("Version"));
+    for(sword::OptionFilterList::const_iterator it =
+      module->getOptionFilters().begin();
+      it != module->getOptionFilters().end(); ++it)
+    {
+      entry.Options.push_back(std::make_pair(
+        std::string((*it)->getOptionName()),
+        std::string((*it)->getOptionValue())));
+    }
+    const sword::ConfigEntMap & config = module->getConfig();
+    for(sword::ConfigEntMap::const_iterator it = config.lower_bound("Feature");
+      it != config.upper_bound("Feature"); ++it)
+    {
+      entry.Features.push_back(std::string(it->second.c_str()));
+    }
+    entry.ConfFile = conf_file;
+    return entry;
+  }
+}
+
+size_t ProcessResidentBytes()
+{
+#ifdef __linux__
+  // Second field of statm: resident pages
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages, resident_pages;
+  if(!(statm >> total_pages >> resident_pages)) return 0;
+  return resident_pages*size_t(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+std::string CatalogSnapshotFile(std::string library_dir)
+{
+  return (std::filesystem::path(library_dir) / "machaira-index" /
+    "catalog.mxc").string();
+}
+
+bool ReadModuleCatalog(std::string file_name, ModuleCatalog & catalog)
+{
+  catalog = ModuleCatalog();
+  MappedFile file;
+  if(!file.Open(file_name)) return false;
+  RecordReader in = {file.Data(), file.Data() + file.Size()};
+  uint32_t version, count;
+  if(!in.Magic(catalog_magic) || !in.Number(version) ||
+    version != catalog_version || !in.Number(count))
+  {
+    return false;
+  }
+  catalog.Confs.resize(count);
+  for(CatalogConf & conf : catalog.Confs)
+  {
+    if(!in.String(conf.File) || !in.Number(conf.Size) ||
+      !in.Number(conf.ModifiedTime))
+    {
+      return false;
+    }
+  }
+  if(!in.Number(count)) return false;
+  catalog.Modules.resize(count);
+  for(CatalogModule & module : catalog.Modules)
+  {
+    uint32_t options;
+    if(!in.String(module.Name) || !in.String(module.Type) ||
+      !in.String(module.Language) || !in.String(module.Description) ||
+      !in.String(module.Version) || !in.String(module.ConfFile) || !in.Number(options))
+    {
+      return false;
+    }
+    module.Options.resize(options);
+    for(std::pair<std::string, std::string> & option : module.Options)
+    {
+      if(!in.String(option.first) || !in.String(option.second)) return false;
+    }
+    uint32_t features;
+    if(!in.Number(features)) return false;
+    module.Features.resize(features);
+    for(std::string & feature : module.Features)
+    {
+      if(!in.String(feature)) return false;
+    }
+  }
+  return true;
+}
+
+bool WriteModuleCatalog(std::string file_name, const ModuleCatalog & catalog)
+{
+  std::error_code error;
+  std::filesystem::create_directories(
+    std::filesystem::path(file_name).parent_path(), error);
+  std::string body(catalog_magic, 4);
+  AppendNumber(body, catalog_version);
+  AppendNumber<uint32_t>(body, catalog.Confs.size());
+  for(const CatalogConf & conf : catalog.Confs)
+  {
+    AppendString(body, conf.File);
+    AppendNumber(body, conf.Size);
+    AppendNumber(body, conf.ModifiedTime);
+  }
+  AppendNumber<uint32_t>(body, catalog.Modules.size());
+  for(const CatalogModule & module : catalog.Modules)
+  {
+    AppendString(body, module.Name);
+    AppendString(body, module.Type);
+    AppendString(body, module.Language);
+    AppendString(body, module.Description);
+    AppendString(body, module.Version);
+    AppendString(body, module.ConfFile);
+    AppendNumber<uint32_t>(body, module.Options.size());
+    for(const std::pair<std::string, std::string> & option : module.Options)
+    {
+      AppendString(body, option.first);
+      AppendString(body, option.second);
+    }
+    AppendNumber<uint32_t>(body, module.Features.size());
+    for(const std::string & feature : module.Features)
+    {
+      AppendString(body, feature);
+    }
+  }
+  return ReplaceFileContents(file_name, body);
+}
+
+LibraryMgr::LibraryMgr(std::string library_dir, sword::SWFilterMgr * filter_mgr) :
+  sword::SWMgr(library_dir.c_str(), false, filter_mgr),
+  library_dir(library_dir), use_clock(0), scope_depth(0)
+{
+  conf_dir = (std::filesystem::path(library_dir) / "mods.d").string();
+}
+
+void LibraryMgr::LoadCatalog(bool write_snapshot)
+{
+  std::chrono::steady_clock::time_point started =
+    std::chrono::steady_clock::now();
+  stats = LibraryLoadStats();
+  std::error_code error;
+  ModuleCatalog current;
+
+  if(!configPath || !std::filesystem::is_directory(conf_dir, error))
+  {
+    // Libraries with a single mods.conf are loaded as SWORD loads them
+    Load();
+    sword::ModMap::iterator modIterator;
+    for(modIterator = Modules.begin(); modIterator != Modules.end();
+      modIterator++)
+    {
+      sword::SWModule * module = (*modIterator).second;
+      CacheModuleBlocks(module, SharedBlockCache());
+      SetDefaultModuleOptions(module);
+      current.Modules.push_back(CatalogEntry(module, ""));
+      stats.ModulesOpened++;
+      last_used[current.Modules.back().Name] = ++use_clock;
+      residency.Opened++;
+    }
+  }
+  else
+  {
+    if(!config) config = myconfig = new sword::SWConfig();
+    ModuleCatalog snapshot;
+    std::string snapshot_file = CatalogSnapshotFile(library_dir);
+    bool changed = !ReadModuleCatalog(snapshot_file, snapshot);
+    std::map<std::string, const CatalogConf *> snapshot_confs;
+    for(const CatalogConf & conf : snapshot.Confs) snapshot_confs[conf.File] = &conf;
+
+    // Configs in name order, so the snapshot does not depend on the order
+    // the directory is listed in
+    for(const std::filesystem::directory_entry & file :
+      std::filesystem::directory_iterator(conf_dir, error))
+    {
+      if(file.path().extension() != ".conf") continue;
+      CatalogConf conf;
+      conf.File = file.path().filename().string();
+      conf.Size = file.file_size(error);
+      conf.ModifiedTime = file.last_write_time(error).time_since_epoch().count();
+      current.Confs.push_back(conf);
+    }
+    std::sort(current.Confs.begin(), current.Confs.end(),
+      [](const CatalogConf & a, const CatalogConf & b){ return a.File < b.File; });
+    if(current.Confs.size() != snapshot.Confs.size()) changed = true;
+
+    for(const CatalogConf & conf : current.Confs)
+    {
+      std::map<std::string, const CatalogConf *>::iterator known =
+        snapshot_confs.find(conf.File);
+      if(known != snapshot_confs.end() && known->second->Size == conf.Size &&
+        known->second->ModifiedTime == conf.ModifiedTime)
+      {
+        // Unchanged: classified from the snapshot, opened when first used
+        for(const CatalogModule & module : snapshot.Modules)
+        {
+          if(module.ConfFile == conf.File) current.Modules.push_back(module);
+        }
+        continue;
+      }
+      // New or changed: parse it and open its modules to classify them
+      changed = true;
+      stats.ConfsParsed++;
+      std::vector<std::string> sections = LoadConf(conf.File);
+      for(const std::string & section : sections)
+      {
+        sword::SWModule * module = CreateModule(section);
+        if(!module) continue;
+        stats.ModulesOpened++;
+        SetDefaultModuleOptions(module);
+        current.Modules.push_back(CatalogEntry(module, conf.File));
+        // Classified modules are closed again as others are opened
+        TrimModules(section);
+      }
+    }
+
+    // Modules whose configs were removed are closed
+    std::set<std::string> kept;
+    for(const CatalogModule & entry : current.Modules) kept.insert(entry.Name);
+    for(const CatalogModule & module : catalog.Modules)
+    {
+      if(kept.find(module.Name) != kept.end()) continue;
+      deleteModule(module.Name.c_str());
+      last_used.erase(module.Name);
+      closed_keys.erase(module.Name);
+      config->getSections().erase(module.Name.c_str());
+      loaded_confs.erase(module.ConfFile);
+    }
+
+    stats.FromSnapshot = !changed;
+    if(changed && write_snapshot) WriteModuleCatalog(snapshot_file, current);
+  }
+
+  catalog.Confs.swap(current.Confs);
+  catalog.Modules.swap(current.Modules);
+  catalog_index.clear();
+  for(size_t n = 0; n < catalog.Modules.size(); n++)
+  {
+    catalog_index[catalog.Modules[n].Name] = n;
+  }
+  TrimModules("");
+  stats.Milliseconds = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - started).count();
+}
+
+bool LibraryMgr::RegisterModules(const std::vector<std::string> & mod_names,
+  std::vector<CatalogModule> & registered)
+{
+  registered.clear();
+  std::error_code error;
+  if(!configPath || !std::filesystem::is_directory(conf_dir, error)) return false;
+  if(!config) config = myconfig = new sword::SWConfig();
+  for(const std::string & mod_name : mod_names)
+  {
+    // The installer copies the source's config, named after the module
+    CatalogConf conf;
+    conf.File = mod_name + ".conf";
+    for(char & c : conf.File) c = tolower(static_cast<unsigned char>(c));
+    std::filesystem::path path = std::filesystem::path(conf_dir) / conf.File;
+    conf.Size = std::filesystem::file_size(path, error);
+    if(error) return false;
+    conf.ModifiedTime =
+      std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+    // Modules of the config's earlier version are closed and dropped (it
+    // may no longer define them all)
+    for(const CatalogModule & module : catalog.Modules)
+    {
+      if(module.ConfFile != conf.File) continue;
+      deleteModule(module.Name.c_str());
+      config->getSections().erase(module.Name.c_str());
+      last_used.erase(module.Name);
+      closed_keys.erase(module.Name);
+    }
+    catalog.Modules.erase(std::remove_if(catalog.Modules.begin(),
+      catalog.Modules.end(), [&conf](const CatalogModule & module)
+      { return module.ConfFile == conf.File; }), catalog.Modules.end());
+    size_t position = 0;
+    for(size_t n = 0; n < catalog.Modules.size(); n++)
+    {
+      if(catalog.Modules[n].ConfFile < conf.File) position = n + 1;
+    }
+
+    std::vector<std::string> sections = LoadConf(conf.File);
+    if(std::find(sections.begin(), sections.end(), mod_name) == sections.end())
+    {
+      return false;
+    }
+    // Entries stay in config order, as LoadCatalog lists them
+    for(const std::string & section : sections)
+    {
+      sword::SWModule * module = CreateModule(section);
+      if(!module) continue;
+      SetDefaultModuleOptions(module);
+      CatalogModule entry = CatalogEntry(module, conf.File);
+      catalog.Modules.insert(catalog.Modules.begin() + position++, entry);
+      registered.push_back(entry);
+      TrimModules(section);
+    }
+    std::vector<CatalogConf>::iterator known = std::lower_bound(
+      catalog.Confs.begin(), catalog.Confs.end(), conf,
+      [](const CatalogConf & a, const CatalogConf & b){ return a.File < b.File; });
+    if(known != catalog.Confs.end() && known->File == conf.File) *known = conf;
+    else catalog.Confs.insert(known, conf);
+  }
+
+  catalog_index.clear();
+  for(size_t n = 0; n < catalog.Modules.size(); n++)
+  {
+    catalog_index[catalog.Modules[n].Name] = n;
+  }
+  WriteModuleCatalog(CatalogSnapshotFile(library_dir), catalog);
+  return true;
+}
+
+sword::SWModule * LibraryMgr::GetModule(std::string mod_name)
+{
+  TRACE_SCOPE("swmgr.GetModule");
+  sword::ModMap::iterator open = Modules.find(mod_name.c_str());
+  if(open != Modules.end())
+  {
+    last_used[mod_name] = ++use_clock;
+    if(scope_depth > 0) pinned.insert(mod_name);
+    return (*open).second;
+  }
+  std::map<std::string, size_t>::iterator entry = catalog_index.find(mod_name);
+  if(entry == catalog_index.end()) return 0;
+  const CatalogModule & info = catalog.Modules[entry->second];
+  // (Modules of a single mods.conf have their sections loaded already)
+  if(!info.ConfFile.empty() &&
+    loaded_confs.find(info.ConfFile) == loaded_confs.end())
+  {
+    LoadConf(info.ConfFile);
+  }
+  sword::SWModule * module = CreateModule(mod_name);
+  if(!module) return 0;
+  TRACE_COUNT("swmgr.modules_opened", 1);
+  // Option defaults were worked out when the catalog was built
+  for(sword::OptionFilterList::const_iterator it =
+    module->getOptionFilters().begin();
+    it != module->getOptionFilters().end(); ++it)
+  {
+    for(const std::pair<std::string, std::string> & option : info.Options)
+    {
+      if(option.first == (*it)->getOptionName())
+      {
+        (*it)->setOptionValue(option.second.c_str());
+      }
+    }
+  }
+  // Back at the key it was on when it was closed
+  std::map<std::string, std::string>::iterator closed =
+    closed_keys.find(mod_name);
+  if(closed != closed_keys.end())
+  {
+    module->setKey(closed->second.c_str());
+    closed_keys.erase(closed);
+  }
+  if(scope_depth > 0) pinned.insert(mod_name);
+  TrimModules(mod_name);
+  return module;
+}
+
+void LibraryMgr::CloseModule(const std::string & mod_name)
+{
+  sword::ModMap::iterator open = Modules.find(mod_name.c_str());
+  if(open == Modules.end()) return;
+  closed_keys[mod_name] = (*open).second->getKeyText();
+  deleteModule(mod_name.c_str());
+  last_used.erase(mod_name);
+  pinned.erase(mod_name);
+  residency.Closed++;
+}
+
+void LibraryMgr::SetResidencyLimits(const ResidencyLimits & limits)
+{
+  this->limits = limits;
+  TrimModules("");
+}
+
+ResidencyStats LibraryMgr::GetResidencyStats()
+{
+  residency.OpenModules = last_used.size();
+  residency.ResidentBytes = ProcessResidentBytes();
+  return residency;
+}
+
+std::vector<std::string> LibraryMgr::LoadConf(const std::string & conf_file)
+{
+  std::vector<std::string> sections;
+  std::string path = (std::filesystem::path(conf_dir) / conf_file).string();
+  sword::SWConfig module_config(path.c_str());
+  sword::SectionMap::iterator section;
+  for(section = module_config.getSections().begin();
+    section != module_config.getSections().end(); section++)
+  {
+    std::string name((*section).first.c_str());
+    // A changed config replaces the module's section and closes it
+    deleteModule(name.c_str());
+    last_used.erase(name);
+    config->getSections().erase((*section).first);
+    sections.push_back(name);
+  }
+  config->augment(module_config);
+  loaded_confs.insert(conf_file);
+  return sections;
+}
+
+sword::SWModule * LibraryMgr::CreateModule(const std::string & mod_name)
+{
+  sword::SectionMap::iterator section_it =
+    config->getSections().find(mod_name.c_str());
+  if(section_it == config->getSections().end()) return 0;
+  sword::ConfigEntMap & section = (*section_it).second;
+  sword::ConfigEntMap::iterator driver = section.find("ModDrv");
+  if(driver == section.end()) return 0;
+  sword::SWModule * module = createModule(mod_name.c_str(),
+    (*driver).second.c_str(), section);
+  if(!module) return 0;
+  // Compressed modules read their blocks through the shared cache
+  CacheModuleBlocks(module, SharedBlockCache());
+  // Filters are added as SWMgr::createAllModules adds them: option and
+  // local strip filters, then raw, strip, render and encoding filters
+  addGlobalOptions(module, section, section.lower_bound("GlobalOptionFilter"),
+    section.upper_bound("GlobalOptionFilter"));
+  addLocalOptions(module, section, section.lower_bound("LocalOptionFilter"),
+    section.upper_bound("LocalOptionFilter"));
+  addStripFilters(module, section, section.lower_bound("LocalStripFilter"),
+    section.upper_bound("LocalStripFilter"));
+  addRawFilters(module, section);
+  addStripFilters(module, section);
+  addRenderFilters(module, section);
+  addEncodingFilters(module, section);
+  Modules[module->getName()] = module;
+  last_used[mod_name] = ++use_clock;
+  residency.Opened++;
+  return module;
+}
+
+void LibraryMgr::TrimModules(const std::string & keep)
+{
+  size_t max_modules = std::max(limits.MaxModules, min_resident_modules);
+  while(limits.MaxModules > 0 && last_used.size() > max_modules)
+  {
+    if(!CloseLeastRecent(keep)) return;
+  }
+  // Over the memory budget, modules are closed until the resident set is
+  // back under it (their freed memory is handed back to the system first)
+  while(limits.MaxResidentBytes > 0 && last_used.size() > min_resident_modules &&
+    ProcessResidentBytes() > limits.MaxResidentBytes)
+  {
+    if(!CloseLeastRecent(keep)) return;
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+  }
+}
+
+void LibraryMgr::EndScope()
+{
+  pinned.clear();
+  TrimModules("");
+}
+
+bool LibraryMgr::CloseLeastRecent(const std::string & keep)
+{
+  std::map<std::string, uint64_t>::iterator oldest = last_used.end();
+  for(std::map<std::string, uint64_t>::iterator it = last_used.begin();
+    it != last_used.end(); ++it)
+  {
+    if(it->first == keep || pinned.count(it->first)) continue;
+    if(oldest == last_used.end() || it->second < oldest->second) oldest = it;
+  }
+  if(oldest == last_used.end()) return false;
+  sword::ModMap::iterator open = Modules.find(oldest->first.c_str());
+  if(open != Modules.end())
+  {
+    closed_keys[oldest->first] = (*open).second->getKeyText();
+    deleteModule(oldest->first.c_str());
+  }
+  last_used.erase(oldest);
+  residency.Closed++;
+  TRACE_COUNT("swmgr.modules_closed", 1);
+  return true;
+}
@@ -0,0 +1,151 @@
+// Machaira: LibraryMgr.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file extends the SWORD manager to open modules on first use, with
+// the classified module catalog kept in a binary snapshot so that startup
+// only has to check the module configs for changes, and to close the least
+// recently used modules again when a budget is exceeded
+// Current version: Pre-release
+
+#ifndef LIBRARYMGR_HPP
+#define LIBRARYMGR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdint>
+
+#include <swmgr.h>
+
+struct CatalogModule
+{
+  std::string Name;
+  std::string Type;
+  std::string Language;
+  std::string Description;
+  // Version entry of the config (empty when it has none)
+  std::string Version;
+  // Option filters and the values set by SetDefaultModuleOptions
+  std::vector<std::pair<std::string, std::string>> Options;
+  // Feature entries of the config ("GreekDef", "StrongsNumbers"...)
+  std::vector<std::string> Features;
+  // Config file in mods.d that defines the module
+  std::string ConfFile;
+};
+
+struct CatalogConf
+{
+  std::string File;
+  uint64_t Size;
+  int64_t ModifiedTime;
+};
+
+struct ModuleCatalog
+{
+  std::vector<CatalogConf> Confs;
+  std::vector<CatalogModule> Modules;
+};
+
+struct LibraryLoadStats
+{
+  // True when every config matched the snapshot (no module was opened)
+  bool FromSnapshot = false;
+  unsigned long ConfsParsed = 0;
+  unsigned long ModulesOpened = 0;
+  double Milliseconds = 0.0;
+};
+
+// Limits on open modules (0 for none); the least recently used are closed
+// until both are met, though the few used last always stay open
+struct ResidencyLimits
+{
+  // Each open module holds its data files and buffers
+  size_t MaxModules = 0;
+  // Resident set of the whole process (only measured on Linux)
+  size_t MaxResidentBytes = 0;
+};
+
+struct ResidencyStats
+{
+  size_t OpenModules = 0;
+  unsigned long Opened = 0;
+  unsigned long Closed = 0;
+  size_t ResidentBytes = 0;
+};
+
+// Resident set size of this process (0 where it cannot be read)
+size_t ProcessResidentBytes();
+
+// Snapshot files (in the library's machaira-index directory)
+std::string CatalogSnapshotFile(std::string library_dir);
+bool ReadModuleCatalog(std::string file_name, ModuleCatalog & catalog);
+bool WriteModuleCatalog(std::string file_name, const ModuleCatalog & catalog);
+
+class LibraryMgr : public sword::SWMgr
+{
+  public:
+    // Constructor (nothing is loaded until LoadCatalog)
+    LibraryMgr(std::string library_dir, sword::SWFilterMgr * filter_mgr);
+    // Reads the snapshot and parses only the configs that changed since it
+    // was written (opening their modules to classify them); the snapshot is
+    // rewritten when anything changed and write_snapshot is set
+    void LoadCatalog(bool write_snapshot = true);
+    const std::vector<CatalogModule> & GetCatalog(){ return catalog.Modules; }
+    LibraryLoadStats GetLoadStats(){ return stats; }
+    // Adds just-installed modules (or their new versions) from their
+    // configs (mods.d/<name in lower case>.conf) without checking the rest
+    // of the library, and rewrites the snapshot; false when a config is not
+    // where expected, in which case LoadCatalog picks the modules up
+    bool RegisterModules(const std::vector<std::string> & mod_names,
+      std::vector<CatalogModule> & registered);
+    // Opens the module on first use (0 if it is not in the library); a
+    // module closed for the budget is opened again at the key it was on.
+    // Pointers stay valid while a ModuleScope is open (otherwise until the
+    // next GetModule)
+    sword::SWModule * GetModule(std::string mod_name);
+    // Closes an open module (before its files are replaced); it is opened
+    // again, at the key it was on, when next used
+    void CloseModule(const std::string & mod_name);
+    // Modules handed out while a scope is open are pinned: the limits are
+    // applied to them only once the outermost scope ends
+    class ModuleScope
+    {
+      public:
+        ModuleScope(LibraryMgr & mgr) : mgr(mgr) { mgr.scope_depth++; }
+        ~ModuleScope(){ if(--mgr.scope_depth == 0) mgr.EndScope(); }
+      private:
+        LibraryMgr & mgr;
+    };
+    // Get/Set
+    void SetResidencyLimits(const ResidencyLimits & limits);
+    ResidencyLimits GetResidencyLimits(){ return limits; }
+    ResidencyStats GetResidencyStats();
+  private:
+    // Parses one config into the manager's config, closing any open module
+    // it redefines; returns the sections it holds
+    std::vector<std::string> LoadConf(const std::string & conf_file);
+    sword::SWModule * CreateModule(const std::string & mod_name);
+    // Closes least recently used modules (never keep or a pinned one) for
+    // the limits
+    void TrimModules(const std::string & keep);
+    void EndScope();
+    bool CloseLeastRecent(const std::string & keep);
+    std::string library_dir;
+    std::string conf_dir;
+    ModuleCatalog catalog;
+    // Catalog position of each module, and configs already parsed
+    std::map<std::string, size_t> catalog_index;
+    std::set<std::string> loaded_confs;
+    LibraryLoadStats stats;
+    // Residency: last use of each open module, and the keys closed modules
+    // were on
+    ResidencyLimits limits;
+    ResidencyStats residency;
+    uint64_t use_clock;
+    std::map<std::string, uint64_t> last_used;
+    std::map<std::string, std::string> closed_keys;
+    int scope_depth;
+    std::set<std::string> pinned;
+};
+
+#endif
@@ -12,8 +12,22 @@
 #include <wx/listctrl.h>
 #include <wx/combobox.h>
 #include <wx/html/htmlwin.h>
+#include <wx/choicdlg.h>
+
+#include <iostream>
+#include <memory>
+#include <algorithm>
+#include <set>
+#include <ctime>
+#include <cstdlib>
 
 #include "SwordBackend.hpp"
+#include "VersePrefetcher.hpp"
+#include "HoverPreviewer.hpp"
+#include "ParallelRenderer.hpp"
+#include "JobQueue.hpp"
+#include "HtmlPostProcess.hpp"
+#include "Trace.hpp"
 
 SwordBackend SwordApp;
 
@@ -21,6 +35,10 @@ class MyApp: public wxApp
 {
   public:
     virtual bool OnInit();
+    virtual int OnExit();
+  private:
+    // Trace export on exit (MACHAIRA_TRACE_FILE; *.csv for totals)
+    std::string TraceFile;
 };
 wxDECLARE_APP(MyApp);
 
@@ -28,6 +46,7 @@ class MainFrame: public wxFrame
 {
   public:
     MainFrame(const wxString& title, const wxPoint& pos, const wxSize& size);
+    ~MainFrame();
     // Verse controls at top of window
     wxButton * GetTextButton;
     wxTextCtrl * VerseTextCtrl;
@@ -42,35 +61,123 @@ class MainFrame: public wxFrame
     wxHtmlWindow * CommentaryHtmlWindow;
     // Hover display (Dictionary/Lexicon/Cross-Reference)
     wxHtmlWindow * HoverHtmlWindow;
+    // Search pane
+    wxTextCtrl * SearchTextCtrl;
+    wxButton * SearchButton;
+    wxListCtrl * SearchListCtrl;
+    // Dictionary lookup (keys of every dictionary, as you type)
+    wxTextCtrl * LexiconTextCtrl;
   private:
+    // Background rendering of neighbouring verses
+    std::unique_ptr<VersePrefetcher> Prefetcher;
+    // Previews of hovered links, looked up in the background; the link of
+    // the preview shown or on its way (empty once the pane shows another page)
+    std::unique_ptr<HoverPreviewer> Previewer;
+    std::string PreviewedLink;
+    // Parallel-translation view: extra Bibles shown beside the current one,
+    // rendered on a pool of workers (created when first needed)
+    std::vector<std::string> ParallelModules;
+    std::unique_ptr<ParallelRenderer> Renderer;
+    // Background indexing of the library for search
+    std::unique_ptr<JobQueue> Jobs;
+    // Live timing summary in the status bar
+    std::unique_ptr<wxTimer> TimingsTimer;
     // Event Functions
     void OnExit(wxCommandEvent& event);
     void LoadText(wxCommandEvent& event);
+    void SuggestReferences(wxCommandEvent& event);
     void AddModule(wxCommandEvent& event);
+    void ChooseParallelTranslations(wxCommandEvent& event);
     void ChooseTranslation(wxCommandEvent& event);
     void ChooseCommentary(wxCommandEvent& event);
     void GoToPreviousVerse(wxCommandEvent& event);
     void GoToNextVerse(wxCommandEvent& event);
     void UpdateMiscDisplay(wxHtmlLinkEvent& event);
+    void PreviewLink(wxHtmlCellEvent& event);
+    void OnPreviewReady(wxThreadEvent& event);
+    void Search(wxCommandEvent& event);
+    void LookupLexicons(wxCommandEvent& event);
+    void OpenSearchResult(wxListEvent& event);
+    void OnIndexDone(wxThreadEvent& event);
+    void ToggleTimings(wxCommandEvent& event);
+    void ShowTimings(wxTimerEvent& event);
+    void ChangeDisplayOptions(wxCommandEvent& event);
     // Utilities
-    void UpdateWindows(std::string verse);
+    void UpdateWindows(std::string verse, bool navigating = false);
+    void ShowPage(wxHtmlWindow * window, const std::string & html);
+    std::string GetPage(std::string verse, std::string mod_name, bool navigating);
+    void RequestPreview(std::string link, bool debounced);
+    void CancelPreview();
+    // Slowest timings, open modules and memory in use, for the status bar
+    std::string GetDiagnostics();
+    // Builds its page from the indexes only, so may run on the previewer
+    static std::string GetStrongsSummary(std::string scripture,
+      std::string strongs_number);
+    std::string GetCrossRefPage(std::string verse);
+    std::string GetParallelPage(const std::vector<std::string> & mod_names,
+      const std::vector<std::string> & pages);
     wxDECLARE_EVENT_TABLE();
 };
 
+// Virtual list of an install source's catalog: rows are catalog positions,
+// in the order and with the filters of the current query
+class CatalogListCtrl: public wxListCtrl
+{
+public:
+  CatalogListCtrl(wxWindow * parent, wxWindowID id, const wxPoint& pos,
+    const wxSize& size);
+  void SetCatalog(std::shared_ptr<const CatalogIndex> catalog);
+  std::shared_ptr<const CatalogIndex> GetCatalog(){ return catalog; }
+  void SetQuery(const CatalogQuery & query);
+  const CatalogQuery & GetQuery(){ return query; }
+  // Module shown in a row (0 outside the list)
+  const SwordModuleInfo * GetModule(long item);
+  size_t GetRowCount(){ return rows.size(); }
+protected:
+  virtual wxString OnGetItemText(long item, long column) const;
+private:
+  // Names of the selected modules; rows are positions, so the selection
+  // is carried across a new catalog or query by name
+  std::set<std::string> SelectedNames();
+  void UpdateRows(const std::set<std::string> & selected);
+  std::shared_ptr<const CatalogIndex> catalog;
+  CatalogQuery query;
+  std::vector<uint32_t> rows;
+};
+
 class InstallerFrame: public wxFrame
 {
 public:
   InstallerFrame(const wxString& title, const wxPoint& pos, const wxSize& size);
+  ~InstallerFrame();
   wxComboBox * SourceComboBox;
   wxButton * LoadSourceButton;
+  wxButton * RefreshSourceButton;
   wxButton * InstallButton;
-  wxListCtrl * ModuleListCtrl;
+  wxButton * UpdateButton;
+  wxButton * CancelButton;
+  wxGauge * ProgressGauge;
+  CatalogListCtrl * ModuleListCtrl;
   wxTextCtrl * ModDescriptionTextCtrl;
+  wxTextCtrl * ModuleFilterTextCtrl;
+  wxComboBox * LanguageComboBox;
+  wxComboBox * TypeComboBox;
 private:
+  // Source refreshes and installs run here, off the UI thread
+  std::unique_ptr<JobQueue> Jobs;
   void OnExit(wxCommandEvent& event);
   void LoadSource(wxCommandEvent& event);
   void InstallModule(wxCommandEvent& event);
+  void UpdateModules(wxCommandEvent& event);
+  void CancelJob(wxCommandEvent& event);
   void DisplayModuleInfo(wxListEvent& event);
+  void FilterModules(wxCommandEvent& event);
+  void SortModules(wxListEvent& event);
+  void OnJobProgress(wxThreadEvent& event);
+  void OnJobDone(wxThreadEvent& event);
+  // Utilities
+  void SetBusy(bool busy);
+  void FillModuleList();
   wxDECLARE_EVENT_TABLE();
 };
 
@@ -81,11 +188,46 @@ enum
   ID_PrevVerse = wxID_HIGHEST + 3,
   ID_NextVerse = wxID_HIGHEST + 4,
   ID_LoadSource = wxID_HIGHEST + 5,
-  ID_Install = wxID_HIGHEST + 6
+  ID_Install = wxID_HIGHEST + 6,
+  ID_CancelJob = wxID_HIGHEST + 7,
+  ID_JobProgress = wxID_HIGHEST + 8,
+  ID_JobDone = wxID_HIGHEST + 9,
+  ID_Search = wxID_HIGHEST + 10,
+  ID_SearchText = wxID_HIGHEST + 11,
+  ID_SearchResults = wxID_HIGHEST + 12,
+  ID_IndexDone = wxID_HIGHEST + 13,
+  ID_Parallel = wxID_HIGHEST + 14,
+  ID_RefreshSource = wxID_HIGHEST + 15,
+  ID_ModuleList = wxID_HIGHEST + 16,
+  ID_ModuleFilter = wxID_HIGHEST + 17,
+  ID_LanguageFilter = wxID_HIGHEST + 18,
+  ID_TypeFilter = wxID_HIGHEST + 19,
+  ID_Timings = wxID_HIGHEST + 20,
+  ID_TimingsTimer = wxID_HIGHEST + 21,
+  ID_StrongsNumbers = wxID_HIGHEST + 22,
+  ID_Morphology = wxID_HIGHEST + 23,
+  ID_Footnotes = wxID_HIGHEST + 24,
+  ID_CrossReferences = wxID_HIGHEST + 25,
+  ID_Headings = wxID_HIGHEST + 26,
+  ID_RedLetter = wxID_HIGHEST + 27,
+  ID_LexiconText = wxID_HIGHEST + 28,
+  ID_VerseText = wxID_HIGHEST + 29,
+  ID_PreviewReady = wxID_HIGHEST + 30,
+  ID_UpdateModules = wxID_HIGHEST + 31
+};
+
+// Kinds of installer job, passed back with the completion event
+enum
+{
+  JOB_LoadSource = 0,
+  JOB_Install = 1,
+  JOB_Index = 2,
+  JOB_Update = 3
 };
 
 wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
   EVT_MENU(ID_Add, MainFrame::AddModule)
+  EVT_MENU(ID_Parallel, MainFrame::ChooseParallelTranslations)
   EVT_MENU(wxID_EXIT, MainFrame::OnExit)
   EVT_BUTTON(ID_Get, MainFrame::LoadText)
   EVT_COMBOBOX(wxID_ANY, MainFrame::ChooseTranslation)
@@ -93,13 +235,39 @@ wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
   EVT_BUTTON(ID_PrevVerse, MainFrame::GoToPreviousVerse)
   EVT_BUTTON(ID_NextVerse, MainFrame::GoToNextVerse)
   EVT_HTML_LINK_CLICKED(wxID_ANY, MainFrame::UpdateMiscDisplay)
+  EVT_HTML_CELL_HOVER(wxID_ANY, MainFrame::PreviewLink)
+  EVT_THREAD(ID_PreviewReady, MainFrame::OnPreviewReady)
+  EVT_BUTTON(ID_Search, MainFrame::Search)
+  EVT_TEXT_ENTER(ID_SearchText, MainFrame::Search)
+  EVT_TEXT(ID_LexiconText, MainFrame::LookupLexicons)
+  EVT_TEXT(ID_VerseText, MainFrame::SuggestReferences)
+  EVT_TEXT_ENTER(ID_VerseText, MainFrame::LoadText)
+  EVT_LIST_ITEM_ACTIVATED(ID_SearchResults, MainFrame::OpenSearchResult)
+  EVT_THREAD(ID_IndexDone, MainFrame::OnIndexDone)
+  EVT_MENU(ID_Timings, MainFrame::ToggleTimings)
+  EVT_TIMER(ID_TimingsTimer, MainFrame::ShowTimings)
+  EVT_MENU(ID_StrongsNumbers, MainFrame::ChangeDisplayOptions)
+  EVT_MENU(ID_Morphology, MainFrame::ChangeDisplayOptions)
+  EVT_MENU(ID_Footnotes, MainFrame::ChangeDisplayOptions)
+  EVT_MENU(ID_CrossReferences, MainFrame::ChangeDisplayOptions)
+  EVT_MENU(ID_Headings, MainFrame::ChangeDisplayOptions)
+  EVT_MENU(ID_RedLetter, MainFrame::ChangeDisplayOptions)
 wxEND_EVENT_TABLE()
 
 wxBEGIN_EVENT_TABLE(InstallerFrame, wxFrame)
   EVT_MENU(wxID_EXIT, InstallerFrame::OnExit)
   EVT_BUTTON(ID_LoadSource, InstallerFrame::LoadSource)
+  EVT_BUTTON(ID_RefreshSource, InstallerFrame::LoadSource)
   EVT_BUTTON(ID_Install, InstallerFrame::InstallModule)
-  EVT_LIST_ITEM_SELECTED(wxID_ANY, InstallerFrame::DisplayModuleInfo)
+  EVT_BUTTON(ID_UpdateModules, InstallerFrame::UpdateModules)
+  EVT_BUTTON(ID_CancelJob, InstallerFrame::CancelJob)
+  EVT_THREAD(ID_JobProgress, InstallerFrame::OnJobProgress)
+  EVT_THREAD(ID_JobDone, InstallerFrame::OnJobDone)
+  EVT_LIST_ITEM_SELECTED(ID_ModuleList, InstallerFrame::DisplayModuleInfo)
+  EVT_LIST_COL_CLICK(ID_ModuleList, InstallerFrame::SortModules)
+  EVT_TEXT(ID_ModuleFilter, InstallerFrame::FilterModules)
+  EVT_COMBOBOX(ID_LanguageFilter, InstallerFrame::FilterModules)
+  EVT_COMBOBOX(ID_TypeFilter, InstallerFrame::FilterModules)
 wxEND_EVENT_TABLE()
 
 wxIMPLEMENT_APP(MyApp);
@@ -107,6 +275,13 @@ wxIMPLEMENT_APP(MyApp);
 
 bool MyApp::OnInit()
 {
+  // A trace file records the whole session
+  const char * trace_file = std::getenv("MACHAIRA_TRACE_FILE");
+  if(trace_file && *trace_file)
+  {
+    TraceFile = trace_file;
+    Tracer::Enable(true);
+  }
   MainFrame * frame = new MainFrame("Machaira", wxPoint(50, 50),
     wxSize(1000, 800));
   frame->Show(true);
@@ -115,6 +290,15 @@ bool MyApp::OnInit()
 	return true;
 }
 
+int MyApp::OnExit()
+{
+  if(TraceFile != "" && !Tracer::Write(TraceFile))
+  {
+    std::cout << "Error: Couldn't write trace file " << TraceFile << '\n';
+  }
+  return wxApp::OnExit();
+}
+
 MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& size)
         : wxFrame(NULL, wxID_ANY, title, pos, size)
 {
@@ -123,8 +307,27 @@ MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& si
   menuFile->Append(ID_Add, "&Add Module\tCtrl-A", "Add SWORD Module");
   menuFile->AppendSeparator();
   menuFile->Append(wxID_EXIT);
+  wxMenu * menuView = new wxMenu;
+  menuView->Append(ID_Parallel, "&Parallel Translations...\tCtrl-P",
+    "Show other translations beside the current one");
+  menuView->AppendSeparator();
+  menuView->AppendCheckItem(ID_StrongsNumbers, "&Strong's Numbers",
+    "Show Strong's numbers after each word");
+  menuView->AppendCheckItem(ID_Morphology, "&Morphology",
+    "Show morphology codes after each word");
+  menuView->AppendCheckItem(ID_Footnotes, "&Footnotes", "Show footnotes");
+  menuView->AppendCheckItem(ID_CrossReferences, "&Cross-references",
+    "Show cross-references");
+  menuView->AppendCheckItem(ID_Headings, "&Headings", "Show section headings");
+  menuView->AppendCheckItem(ID_RedLetter, "Words of Christ in &Red",
+    "Show the words of Christ in red");
+  menuView->Check(ID_StrongsNumbers, DisplayOptions().StrongsNumbers);
+  menuView->AppendSeparator();
+  menuView->AppendCheckItem(ID_Timings, "Show &Timings",
+    "Show the slowest rendering steps, open modules and memory in the status bar");
   wxMenuBar * menuBar = new wxMenuBar;
   menuBar->Append(menuFile, "&File");
+  menuBar->Append(menuView, "&View");
   //menuBar->Append(menuHelp, "&Help");
   SetMenuBar(menuBar);
 
@@ -136,8 +339,8 @@ MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& si
     wxPoint(30, 30), wxSize(100,30), 0);
 
   // Text Control for Verse Entry
-  VerseTextCtrl = new wxTextCtrl(panel, wxID_ANY, "Enter Verse(s) Here",
-    wxPoint(150, 30), wxSize(200,30));
+  VerseTextCtrl = new wxTextCtrl(panel, ID_VerseText, "Enter Verse(s) Here",
+    wxPoint(150, 30), wxSize(200,30), wxTE_PROCESS_ENTER);
 
   // Static Text to show Current Verse
   std::string boot_verse("Genesis 1:1");
@@ -194,16 +397,87 @@ MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& si
   HoverHtmlWindow = new wxHtmlWindow(panel, wxID_ANY, wxPoint(50, 320),
     wxSize(400, 180));
 
+  // Text Control for Search Queries
+  SearchTextCtrl = new wxTextCtrl(panel, ID_SearchText, "",
+    wxPoint(50, 540), wxSize(300, 30), wxTE_PROCESS_ENTER);
+
+  // Button Control to Search
+  SearchButton = new wxButton(panel, ID_Search, _T("Search"),
+    wxPoint(370, 540), wxSize(100, 30), 0);
+
+  // List Control for Search Results
+  SearchListCtrl = new wxListCtrl(panel, ID_SearchResults, wxPoint(50, 580),
+    wxSize(850, 140), wxLC_REPORT | wxLC_HRULES | wxLC_SINGLE_SEL);
+  SearchListCtrl->InsertColumn(0, "Module", wxLIST_FORMAT_LEFT, 150);
+  SearchListCtrl->InsertColumn(1, "Reference", wxLIST_FORMAT_LEFT, 250);
+
+  // Text Control for Dictionary Lookup (matches listed in the hover window)
+  LexiconTextCtrl = new wxTextCtrl(panel, ID_LexiconText, "",
+    wxPoint(500, 540), wxSize(400, 30));
+
   // Status Bar at Bottom
   CreateStatusBar();
   std::string initial_status("Welcome to Machaira!");
   initial_status += " Using "+SwordApp.GetSwordVersion();
+  LibraryLoadStats load_stats = SwordApp.GetLibraryLoadStats();
+  initial_status += ", library loaded in " +
+    std::to_string(int(load_stats.Milliseconds + 0.5)) + " ms";
+  if(load_stats.FromSnapshot) initial_status += " (from snapshot)";
   SetStatusText(initial_status);
 
+  TimingsTimer.reset(new wxTimer(this, ID_TimingsTimer));
+
+  // Prefetcher renders with its own SWORD manager on a worker thread
+  Prefetcher.reset(new VersePrefetcher(SwordApp.GetLibraryDir()));
+
+  // Link previews also have their own reader and worker; finished previews
+  // come back as events, and are shown only if no newer hover came since
+  Previewer.reset(new HoverPreviewer(SwordApp.GetLibraryDir(),
+    [this](const HoverPreview & preview)
+    {
+      wxThreadEvent * ready = new wxThreadEvent(wxEVT_THREAD, ID_PreviewReady);
+      ready->SetString(preview.Html);
+      ready->SetExtraLong(long(preview.Generation));
+      wxQueueEvent(this, ready);
+    }));
+
+  // Installed and updated modules reach the workers' readers (registration
+  // runs on the UI thread, where the readers are created)
+  SwordApp.SetLibraryChangedCallback([this]()
+  {
+    Prefetcher->ReloadLibrary();
+    Previewer->ReloadLibrary();
+    if(Renderer) Renderer->ReloadLibrary();
+  });
+
+  // Index new or changed modules for search in the background
+  Jobs.reset(new JobQueue());
+  Jobs->Submit("Index library",
+    [](JobContext & context)
+    {
+      SwordApp.UpdateSearchIndex(0, false,
+        [&context]{ return context.IsCancelled(); });
+      return true;
+    },
+    [this](const JobResult & result)
+    {
+      if(result.Cancelled) return;
+      wxQueueEvent(this, new wxThreadEvent(wxEVT_THREAD, ID_IndexDone));
+    });
+
   // Initialize app by showing Genesis 1:1
   //UpdateWindows(boot_verse);
 }
 
+MainFrame::~MainFrame()
+{
+  // Indexing stops after the files in progress, so closing doesn't wait
+  // for the whole library
+  Jobs->CancelAll();
+  Jobs.reset();
+  SwordApp.SetLibraryChangedCallback(std::function<void()>());
+}
+
 void MainFrame::OnExit(wxCommandEvent& event)
 {
   Close(true);
@@ -211,7 +485,38 @@ void MainFrame::OnExit(wxCommandEvent& event)
 
 void MainFrame::LoadText(wxCommandEvent& event)
 {
-  UpdateWindows(std::string(VerseTextCtrl->GetLineText(0)));
+  // Only a reference that parses is opened, under its canonical key
+  ParsedReference reference = SwordApp.ParseReference(
+    std::string(VerseTextCtrl->GetLineText(0)),
+    std::string(ScriptureComboBox->GetValue()));
+  if(!reference.Valid)
+  {
+    SetStatusText("Error: " + reference.Error);
+    return;
+  }
+  UpdateWindows(reference.Key);
+}
+
+void MainFrame::SuggestReferences(wxCommandEvent& event)
+{
+  // Completions of each keystroke for the dropdown, and the reference
+  // Enter would open (or why it can't) in the status bar
+  std::string text(VerseTextCtrl->GetValue());
+  std::string scripture(ScriptureComboBox->GetValue());
+  wxArrayString completions;
+  for(const std::string & suggestion : SwordApp.SuggestReferences(text,
+    scripture))
+  {
+    completions.Add(suggestion);
+  }
+  VerseTextCtrl->AutoComplete(completions);
+  if(text.find_first_not_of(" \t") == std::string::npos)
+  {
+    SetStatusText("");
+    return;
+  }
+  ParsedReference reference = SwordApp.ParseReference(text, scripture);
+  SetStatusText(reference.Valid ? reference.Key : reference.Error);
 }
 
 void MainFrame::AddModule(wxCommandEvent& event)
@@ -222,6 +527,39 @@ void MainFrame::AddModule(wxCommandEvent& event)
 	wxGetApp().SetTopWindow(installer_frame);
 }
 
+void MainFrame::ChooseParallelTranslations(wxCommandEvent& event)
+{
+  std::vector<std::string> translations = SwordApp.GetBiblicalTexts();
+  wxArrayString choices;
+  wxArrayInt selections;
+  for(int n = 0; n < translations.size(); n++)
+  {
+    choices.Add(translations[n].c_str());
+    if(std::find(ParallelModules.begin(), ParallelModules.end(),
+      translations[n]) != ParallelModules.end())
+    {
+      selections.Add(n);
+    }
+  }
+  wxMultiChoiceDialog dialog(this, "Translations to show beside the current one",
+    "Parallel Translations", choices);
+  dialog.SetSelections(selections);
+  if(dialog.ShowModal() != wxID_OK) return;
+
+  selections = dialog.GetSelections();
+  ParallelModules.clear();
+  for(size_t n = 0; n < selections.GetCount(); n++)
+  {
+    ParallelModules.push_back(translations[selections[n]]);
+  }
+  if(!ParallelModules.empty() && !Renderer)
+  {
+    Renderer.reset(new ParallelRenderer(SwordApp.GetLibraryDir()));
+    Renderer->SetDisplayOptions(SwordApp.GetDisplayOptions());
+  }
+  UpdateWindows(std::string(CurrentVerseText->GetLabel()));
+}
+
 void MainFrame::ChooseTranslation(wxCommandEvent& event)
 {
   UpdateWindows(std::string(CurrentVerseText->GetLabel()));
@@ -237,7 +575,8 @@ void MainFrame::GoToPreviousVerse(wxCommandEvent& event)
   SwordApp.SetVerseRef(std::string(ScriptureComboBox->GetValue()),
     std::string(CurrentVerseText->GetLabel()));
   SwordApp.IncrementVerse(std::string(ScriptureComboBox->GetValue()), -1);
-  UpdateWindows(SwordApp.GetVerseRef(std::string(ScriptureComboBox->GetValue())));
+  UpdateWindows(SwordApp.GetVerseRef(std::string(ScriptureComboBox->GetValue())),
+    true);
 }
 
 void MainFrame::GoToNextVerse(wxCommandEvent& event)
@@ -245,51 +584,400 @@ void MainFrame::GoToNextVerse(wxCommandEvent& event)
   SwordApp.SetVerseRef(std::string(ScriptureComboBox->GetValue()),
     std::string(CurrentVerseText->GetLabel()));
   SwordApp.IncrementVerse(std::string(ScriptureComboBox->GetValue()), 1);
-  UpdateWindows(SwordApp.GetVerseRef(std::string(ScriptureComboBox->GetValue())));
+  UpdateWindows(SwordApp.GetVerseRef(std::string(ScriptureComboBox->GetValue())),
+    true);
 }
 
-void MainFrame::UpdateWindows(std::string verse)
+void MainFrame::UpdateWindows(std::string verse, bool navigating)
 {
-  ScriptureHtmlWindow->SetPage(
-    SwordApp.GetText(verse, std::string(ScriptureComboBox->GetValue()))
-  );
-  CommentaryHtmlWindow->SetPage(
-    SwordApp.GetText(verse, std::string(CommentaryComboBox->GetValue()))
-  );
-  CurrentVerseText->SetLabel(SwordApp.GetVerseRef(std::string(ScriptureComboBox->GetValue())));
+  TRACE_SCOPE("ui.UpdateWindows");
+  std::string scripture(ScriptureComboBox->GetValue());
+  std::string commentary(CommentaryComboBox->GetValue());
+  // Other translations render on the pool while this thread renders the
+  // current one and the commentary
+  std::vector<std::string> parallel;
+  for(const std::string & mod_name : ParallelModules)
+  {
+    if(mod_name != scripture) parallel.push_back(mod_name);
+  }
+  if(!parallel.empty()) Renderer->Start(verse, parallel);
+  std::string scripture_page = GetPage(verse, scripture, navigating);
+  ShowPage(CommentaryHtmlWindow, GetPage(verse, commentary, navigating));
+  if(parallel.empty()) ShowPage(ScriptureHtmlWindow, scripture_page);
+  else
+  {
+    std::vector<std::string> pages;
+    {
+      TRACE_SCOPE("ui.ParallelWait");
+      pages = Renderer->Wait();
+    }
+    parallel.insert(parallel.begin(), scripture);
+    pages.insert(pages.begin(), scripture_page);
+    ShowPage(ScriptureHtmlWindow, GetParallelPage(parallel, pages));
+  }
+  CurrentVerseText->SetLabel(SwordApp.GetVerseRef(scripture));
+  CancelPreview();
+  ShowPage(HoverHtmlWindow, GetCrossRefPage(
+    std::string(CurrentVerseText->GetLabel())));
+  // Start rendering the neighbouring verses for the arrow buttons
+  Prefetcher->Request(std::string(CurrentVerseText->GetLabel()),
+    {scripture, commentary});
+  if(navigating)
+  {
+    PrefetchStats stats = Prefetcher->GetStats();
+    SetStatusText(wxString::Format("Prefetch ready: %lu of %lu pages",
+      stats.Ready, stats.Lookups));
+  }
+}
+
+void MainFrame::ShowPage(wxHtmlWindow * window, const std::string & html)
+{
+  // Layout of long pages in wxHtmlWindow is often the slowest step
+  TRACE_SCOPE("wx.SetPage");
+  window->SetPage(html);
+}
+
+std::string MainFrame::GetPage(std::string verse, std::string mod_name,
+  bool navigating)
+{
+  // Pages rendered ahead of time still need the module key moved, since
+  // the current verse label is read back from the module
+  std::string html;
+  if(navigating && Prefetcher->Lookup(verse, mod_name, html))
+  {
+    TRACE_COUNT("prefetch.hits", 1);
+    SwordApp.SetVerseRef(mod_name, verse);
+    return html;
+  }
+  return SwordApp.GetPassage(verse, mod_name);
+}
+
+std::string MainFrame::GetParallelPage(const std::vector<std::string> & mod_names,
+  const std::vector<std::string> & pages)
+{
+  // One column per translation, in the order they were chosen
+  std::string width = std::to_string(100/mod_names.size()) + "%";
+  std::string page = "<table width=\"100%\" cellpadding=\"4\"><tr>";
+  for(const std::string & mod_name : mod_names)
+  {
+    page += "<th width=\"" + width + "\">" + mod_name + "</th>";
+  }
+  page += "</tr><tr>";
+  for(const std::string & html : pages)
+  {
+    page += "<td valign=\"top\">" + html + "</td>";
+  }
+  page += "</tr></table>";
+  return page;
 }
 
 void MainFrame::UpdateMiscDisplay(wxHtmlLinkEvent& event)
 {
   wxString ref(event.GetLinkInfo().GetHref());
   int f = ref.Find('_');
-  int l = ref.Find('_', true);
   wxString l_action(ref.SubString(0, f-1));
-  wxString l_type(ref.SubString(f+1, l-1));
-  wxString l_val(ref.Mid(l+1));
 
-  if(l_action == "showRef")
+  // A click looks up at once what a hover would after a pause (nothing more
+  // if the hover already did)
+  if(l_action == "showRef" || l_action == "showStrongs")
   {
-    HoverHtmlWindow->SetPage(SwordApp.GetText(std::string(l_val),
-      std::string(ScriptureComboBox->GetValue()))
-    );
+    RequestPreview(std::string(ref), false);
   }
-  if(l_action == "showStrongs")
+  if(l_action == "showDict")
   {
-    if(l_type == "Hebrew")
+    // Keys may hold underscores, so the key is everything after the module
+    size_t k = ref.find('_', f+1);
+    std::string html;
+    if(k != wxString::npos && SwordApp.GetLexiconEntry(
+      std::string(ref.SubString(f+1, k-1)), std::string(ref.Mid(k+1)), html))
     {
-      HoverHtmlWindow->SetPage(SwordApp.GetText(std::string(l_val),
-        "StrongsHebrew")
-      );
+      CancelPreview();
+      ShowPage(HoverHtmlWindow, html);
     }
-    if(l_type == "Greek")
+  }
+  SetStatusText(event.GetLinkInfo().GetHref());
+}
+
+void MainFrame::PreviewLink(wxHtmlCellEvent& event)
+{
+  // Links in the text are previewed on hover; links in the hover pane
+  // itself wait for a click, so the pane does not change under the pointer
+  event.Skip();
+  if(event.GetEventObject() == HoverHtmlWindow) return;
+  wxHtmlLinkInfo * link = event.GetCell()->GetLink(event.GetPoint().x,
+    event.GetPoint().y);
+  if(!link) return;
+  std::string href(link->GetHref());
+  if(href.compare(0, 8, "showRef_") == 0 ||
+    href.compare(0, 12, "showStrongs_") == 0)
+  {
+    RequestPreview(href, true);
+  }
+}
+
+void MainFrame::OnPreviewReady(wxThreadEvent& event)
+{
+  // A newer hover (or another page in the pane) may have come since
+  if((unsigned long)event.GetExtraLong() != Previewer->GetGeneration()) return;
+  ShowPage(HoverHtmlWindow, std::string(event.GetString()));
+}
+
+void MainFrame::RequestPreview(std::string link, bool debounced)
+{
+  TRACE_SCOPE("ui.RequestPreview");
+  if(link == PreviewedLink) return;
+  size_t f = link.find('_');
+  size_t l = link.rfind('_');
+  if(f == std::string::npos) return;
+  std::string action = link.substr(0, f);
+  std::string type = link.substr(f+1, l-f-1);
+  std::string value = link.substr(l+1);
+  std::string scripture(ScriptureComboBox->GetValue());
+  PreviewRenderer render;
+  if(action == "showRef")
+  {
+    render = [scripture, value](SwordReader & reader,
+      const std::function<bool()> & cancelled)
+    {
+      return reader.GetPassage(value, scripture, cancelled);
+    };
+  }
+  else if(action == "showStrongs")
+  {
+    // The lexicon and its key are found here, from the catalog and key
+    // index; SWORD is only read on the previewer's thread
+    std::string strongs_number = (type == "Hebrew" ? "H" : "G") + value;
+    std::string lexicon = SwordApp.GetStrongsLexicon(strongs_number[0]);
+    std::string entry_key;
+    bool found = lexicon != "" &&
+      SwordApp.FindLexiconKey(lexicon, value, entry_key);
+    render = [scripture, strongs_number, lexicon, entry_key, found](
+      SwordReader & reader, const std::function<bool()> & cancelled)
     {
-      HoverHtmlWindow->SetPage(SwordApp.GetText(std::string(l_val),
-        "StrongsGreek")
-      );
+      // Lexicon entry, then where the number occurs in the current Bible
+      std::string page;
+      if(found) page = reader.GetText(entry_key, lexicon);
+      else page = "<p>No lexicon entry for " + strongs_number + "</p>";
+      if(!cancelled()) page += GetStrongsSummary(scripture, strongs_number);
+      return page;
+    };
+  }
+  else return;
+  PreviewedLink = link;
+  Previewer->Request(scripture + '\x1f' + link, render, debounced);
+}
+
+void MainFrame::CancelPreview()
+{
+  PreviewedLink.clear();
+  Previewer->Cancel();
+}
+
+std::string MainFrame::GetStrongsSummary(std::string scripture,
+  std::string strongs_number)
+{
+  const size_t max_verses = 100;
+  const size_t max_words = 10;
+  StrongsOccurrences occurrences;
+  if(!SwordApp.GetStrongsOccurrences(scripture, strongs_number, occurrences,
+    max_verses))
+  {
+    return "";
+  }
+  std::string summary = "<hr><p><b>Occurs " +
+    std::to_string(occurrences.Occurrences) + " times in " +
+    std::to_string(occurrences.VerseCount) + " verses</b> (" + scripture + ")";
+  for(size_t n = 0; n < occurrences.Words.size() && n < max_words; n++)
+  {
+    summary += (n == 0) ? "<br>Translated: " : ", ";
+    summary += occurrences.Words[n].Text + " (" +
+      std::to_string(occurrences.Words[n].Count) + ")";
+  }
+  summary += "</p><p>";
+  for(size_t n = 0; n < occurrences.Verses.size(); n++)
+  {
+    if(n > 0) summary += ", ";
+    summary += "<a href=\"showRef_scripRef_" + occurrences.Verses[n] + "\">" +
+      occurrences.Verses[n] + "</a>";
+  }
+  if(occurrences.VerseCount > occurrences.Verses.size())
+  {
+    summary += " and " +
+      std::to_string(occurrences.VerseCount - occurrences.Verses.size()) +
+      " more";
+  }
+  summary += "</p>";
+  // Surface words may be non-ASCII, so entity-encode like rendered text
+  return PostProcessHtml(summary);
+}
+
+std::string MainFrame::GetCrossRefPage(std::string verse)
+{
+  // References to and from the current verse, from every indexed Bible and
+  // commentary
+  const size_t max_references = 100;
+  std::vector<CrossReference> outgoing;
+  std::vector<CrossReference> incoming;
+  if(!SwordApp.GetCrossReferences(verse, outgoing, incoming))
+  {
+    return "<p>No cross-references for " + verse + "</p>";
+  }
+  std::string page;
+  const std::vector<CrossReference> * lists[] = {&outgoing, &incoming};
+  const char * titles[] = {"References from ", "Referred to by "};
+  for(int l = 0; l < 2; l++)
+  {
+    if(lists[l]->empty()) continue;
+    page += "<p><b>" + std::string(titles[l]) + verse + "</b> (" +
+      std::to_string(lists[l]->size()) + ")<br>";
+    for(size_t n = 0; n < lists[l]->size() && n < max_references; n++)
+    {
+      const CrossReference & reference = (*lists[l])[n];
+      if(n > 0) page += ", ";
+      page += "<a href=\"showRef_scripRef_" + reference.Verse + "\">" +
+        reference.Verse + "</a> (" + reference.Module + ")";
     }
+    page += "</p>";
   }
-  SetStatusText(event.GetLinkInfo().GetHref());
+  return page;
+}
+
+void MainFrame::Search(wxCommandEvent& event)
+{
+  // Hits arrive in verse order and are listed as they come
+  const long max_hits = 5000;
+  std::string query(SearchTextCtrl->GetValue());
+  std::string error;
+  long hits = 0;
+  SearchListCtrl->DeleteAllItems();
+  bool ok = SwordApp.Search(query, [&](const SearchHit & hit)
+  {
+    SearchListCtrl->InsertItem(hits, hit.Module);
+    SearchListCtrl->SetItem(hits, 1, hit.Key);
+    hits++;
+    return hits < max_hits;
+  }, error);
+  if(!ok) SetStatusText(error);
+  else if(hits >= max_hits)
+  {
+    SetStatusText(wxString::Format("Showing the first %ld results", hits));
+  }
+  else SetStatusText(wxString::Format("%ld results", hits));
+}
+
+void MainFrame::LookupLexicons(wxCommandEvent& event)
+{
+  // Matching keys of every dictionary, read from their key indexes; an
+  // entry is rendered only when its link is clicked
+  const size_t max_keys = 20;
+  CancelPreview();
+  std::string prefix(LexiconTextCtrl->GetValue());
+  std::vector<LexiconMatch> matches = SwordApp.FindLexiconKeys(prefix, max_keys);
+  if(matches.empty())
+  {
+    if(prefix != "") ShowPage(HoverHtmlWindow, "<p>No dictionary keys match</p>");
+    return;
+  }
+  // Keys may be non-ASCII, so they are entity-encoded like rendered text
+  std::string page;
+  std::string last_module;
+  for(const LexiconMatch & match : matches)
+  {
+    if(match.Module != last_module)
+    {
+      page += last_module == "" ? "<p>" : "</p><p>";
+      page += "<b>" + match.Module + "</b>";
+      last_module = match.Module;
+    }
+    page += "<br><a href=\"showDict_" + match.Module + "_";
+    AppendEncodedHtml(match.Key.data(), match.Key.data() + match.Key.size(),
+      page);
+    page += "\">";
+    AppendEncodedHtml(match.Key.data(), match.Key.data() + match.Key.size(),
+      page);
+    page += "</a>";
+  }
+  page += "</p>";
+  ShowPage(HoverHtmlWindow, page);
+}
+
+void MainFrame::OpenSearchResult(wxListEvent& event)
+{
+  long item_index = event.GetIndex();
+  std::string mod_name(SearchListCtrl->GetItemText(item_index, 0));
+  std::string key(SearchListCtrl->GetItemText(item_index, 1));
+  std::vector<std::string> texts = SwordApp.GetBiblicalTexts();
+  std::vector<std::string> commentaries = SwordApp.GetCommentaries();
+  if(std::find(texts.begin(), texts.end(), mod_name) != texts.end() ||
+    std::find(commentaries.begin(), commentaries.end(), mod_name) !=
+    commentaries.end())
+  {
+    UpdateWindows(key);
+  }
+  else ShowPage(HoverHtmlWindow, SwordApp.GetText(key, mod_name));
+}
+
+void MainFrame::OnIndexDone(wxThreadEvent& event)
+{
+  // Strong's previews made before the concordance was ready lack its counts
+  Previewer->ClearPreviews();
+  SetStatusText("Search index ready");
+}
+
+void MainFrame::ToggleTimings(wxCommandEvent& event)
+{
+  // Timings started from the menu begin afresh; a session trace
+  // (MACHAIRA_TRACE_FILE) keeps recording when they are hidden
+  if(event.IsChecked())
+  {
+    if(!Tracer::IsEnabled()) Tracer::Reset();
+    Tracer::Enable(true);
+    TimingsTimer->Start(1000);
+    SetStatusText(GetDiagnostics());
+  }
+  else
+  {
+    TimingsTimer->Stop();
+    Tracer::Enable(std::getenv("MACHAIRA_TRACE_FILE") != 0);
+    SetStatusText("");
+  }
+}
+
+void MainFrame::ShowTimings(wxTimerEvent& event)
+{
+  SetStatusText(GetDiagnostics());
+}
+
+std::string MainFrame::GetDiagnostics()
+{
+  ResidencyStats residency = SwordApp.GetResidencyStats();
+  std::string text = Tracer::Summary(3);
+  text += " | " + std::to_string(residency.OpenModules) + " modules open";
+  if(residency.ResidentBytes > 0)
+  {
+    text += ", " + std::to_string(residency.ResidentBytes/(1024*1024)) +
+      " MB resident";
+  }
+  return text;
+}
+
+void MainFrame::ChangeDisplayOptions(wxCommandEvent& event)
+{
+  wxMenuBar * menuBar = GetMenuBar();
+  DisplayOptions options;
+  options.StrongsNumbers = menuBar->IsChecked(ID_StrongsNumbers);
+  options.Morphology = menuBar->IsChecked(ID_Morphology);
+  options.Footnotes = menuBar->IsChecked(ID_Footnotes);
+  options.CrossReferences = menuBar->IsChecked(ID_CrossReferences);
+  options.Headings = menuBar->IsChecked(ID_Headings);
+  options.RedLetter = menuBar->IsChecked(ID_RedLetter);
+  // Verses already shown are emitted again from their tokens (OSIS
+  // modules), not read and filtered by SWORD again
+  SwordApp.SetDisplayOptions(options);
+  Prefetcher->SetDisplayOptions(options);
+  Previewer->SetDisplayOptions(options);
+  if(Renderer) Renderer->SetDisplayOptions(options);
+  UpdateWindows(std::string(CurrentVerseText->GetLabel()));
 }
 
 InstallerFrame::InstallerFrame(const wxString& title, const wxPoint& pos,
@@ -323,30 +1011,78 @@ InstallerFrame::InstallerFrame(const wxString& title, const wxPoint& pos,
   SourceComboBox = new wxComboBox(panel, wxID_ANY, s_value,
     wxPoint(50, 30), wxSize(200, 30), s_choices, wxCB_READONLY);
 
+  // Button Control to Fetch the Source Catalog Even if the Cache is Fresh
+  RefreshSourceButton = new wxButton(panel, ID_RefreshSource, _T("Refresh"),
+    wxPoint(270, 30), wxSize(100, 30), 0);
+
+  // Button Control to Reinstall Modules that Have a Newer Version
+  UpdateButton = new wxButton(panel, ID_UpdateModules, _T("Update All"),
+    wxPoint(390, 30), wxSize(100, 30), 0);
+
   // Button Control to Install Modules
   LoadSourceButton = new wxButton(panel, ID_LoadSource, _T("Load Source"),
     wxPoint(50, 70), wxSize(100, 30), 0);
 
   // Button Control to Install Modules
-  InstallButton = new wxButton(panel, ID_Install, _T("Install Module"),
+  InstallButton = new wxButton(panel, ID_Install, _T("Install"),
     wxPoint(180, 70), wxSize(100, 30), 0);
 
+  // Button Control to Cancel the Running Job
+  CancelButton = new wxButton(panel, ID_CancelJob, _T("Cancel"),
+    wxPoint(310, 70), wxSize(100, 30), 0);
+  CancelButton->Disable();
+
+  // Progress of the Running Job
+  ProgressGauge = new wxGauge(panel, wxID_ANY, 100, wxPoint(440, 75),
+    wxSize(200, 20));
+
   // List Control for Modules
-  ModuleListCtrl = new wxListCtrl(panel, wxID_ANY, wxPoint(40, 120),
-    wxSize(480, 400), wxLC_REPORT | wxLC_HRULES | wxLC_SINGLE_SEL);
-  ModuleListCtrl->InsertColumn(0, "Name", wxLIST_FORMAT_LEFT, 120);
-  ModuleListCtrl->InsertColumn(1, "Type", wxLIST_FORMAT_LEFT, 200);
-  ModuleListCtrl->InsertColumn(2, "Lang", wxLIST_FORMAT_LEFT, 50);
-  ModuleListCtrl->InsertColumn(3, "Version", wxLIST_FORMAT_LEFT, 90);
+  ModuleListCtrl = new CatalogListCtrl(panel, ID_ModuleList, wxPoint(40, 120),
+    wxSize(480, 400));
 
   // Text Control for Description
   ModDescriptionTextCtrl = new wxTextCtrl(panel, wxID_ANY, "Module Description",
     wxPoint(530, 120), wxSize(250, 200), wxTE_READONLY | wxTE_MULTILINE);
 
+  // Filters for the Module List (text in name or description, language, type)
+  ModuleFilterTextCtrl = new wxTextCtrl(panel, ID_ModuleFilter, "",
+    wxPoint(530, 340), wxSize(250, 30));
+  ModuleFilterTextCtrl->SetToolTip("Filter by name or description");
+  wxArrayString no_choices;
+  LanguageComboBox = new wxComboBox(panel, ID_LanguageFilter, "",
+    wxPoint(530, 380), wxSize(250, 30), no_choices, wxCB_READONLY);
+  TypeComboBox = new wxComboBox(panel, ID_TypeFilter, "",
+    wxPoint(530, 420), wxSize(250, 30), no_choices, wxCB_READONLY);
+
   // Status Bar at Bottom
   CreateStatusBar();
   std::string initial_status("Module Installer");
   SetStatusText(initial_status);
+
+  // Background jobs; progress is forwarded from the transfer thread
+  Jobs.reset(new JobQueue());
+  Jobs->SetCancelHook([](){ SwordApp.CancelInstallerOperation(); });
+  SwordApp.SetInstallProgressCallback([this](const InstallProgress & progress)
+  {
+    wxThreadEvent * update = new wxThreadEvent(wxEVT_THREAD, ID_JobProgress);
+    int percent = 0;
+    if(progress.TotalBytes > 0)
+    {
+      percent = (int)(100.0 * progress.CompletedBytes / progress.TotalBytes);
+    }
+    update->SetInt(percent);
+    update->SetExtraLong(progress.FilesStarted);
+    update->SetString(progress.Message);
+    wxQueueEvent(this, update);
+  });
+}
+
+InstallerFrame::~InstallerFrame()
+{
+  // Stop the worker first so no callback can reach a destroyed frame
+  Jobs.reset();
+  SwordApp.SetInstallProgressCallback(
+    std::function<void(const InstallProgress &)>());
 }
 
 void InstallerFrame::OnExit(wxCommandEvent& event)
@@ -356,33 +1092,346 @@ void InstallerFrame::OnExit(wxCommandEvent& event)
 
 void InstallerFrame::LoadSource(wxCommandEvent& event)
 {
-  ModuleListCtrl->DeleteAllItems();
-  SwordApp.SelectRemoteSource(std::string(SourceComboBox->GetValue()));
-  std::vector<SwordModuleInfo> mod_list = SwordApp.GetRemoteSourceModules();
-  for(int n = 0; n < mod_list.size(); n++)
+  std::string src_name(SourceComboBox->GetValue());
+  bool force = event.GetId() == ID_RefreshSource;
+  SetBusy(true);
+  // List the cached catalog straight away; the job fetches it again only
+  // if it is stale (or Refresh was pressed)
+  if(SwordApp.LoadCachedSourceCatalog(src_name))
   {
-    ModuleListCtrl->InsertItem(n, mod_list[n].Name);
-    ModuleListCtrl->SetItem(n, 1, mod_list[n].Type);
-    ModuleListCtrl->SetItem(n, 2, mod_list[n].Language);
-    ModuleListCtrl->SetItem(n, 3, mod_list[n].Version);
+    FillModuleList();
+    SetStatusText("Checking " + src_name + " for updates...");
   }
+  else SetStatusText("Refreshing " + src_name + "...");
+  Jobs->Submit(src_name,
+    [src_name, force](JobContext & context)
+    {
+      return SwordApp.SelectRemoteSource(src_name, force);
+    },
+    [this](const JobResult & result)
+    {
+      wxThreadEvent * done = new wxThreadEvent(wxEVT_THREAD, ID_JobDone);
+      done->SetInt(result.Success && !result.Cancelled);
+      done->SetExtraLong(JOB_LoadSource);
+      done->SetString(result.Name);
+      wxQueueEvent(this, done);
+    });
 }
 
 void InstallerFrame::InstallModule(wxCommandEvent& event)
 {
+  // The list keeps the catalog it shows, even if a refresh has published
+  // a new one since
+  std::vector<std::string> mod_names;
   long int item_index = -1;
-  item_index = ModuleListCtrl->GetNextItem(item_index, wxLIST_NEXT_ALL,
-    wxLIST_STATE_SELECTED);
-  std::vector<SwordModuleInfo> mod_list = SwordApp.GetRemoteSourceModules();
-  SwordApp.InstallRemoteModule(mod_list[item_index].Name);
+  while((item_index = ModuleListCtrl->GetNextItem(item_index, wxLIST_NEXT_ALL,
+    wxLIST_STATE_SELECTED)) != -1)
+  {
+    const SwordModuleInfo * module = ModuleListCtrl->GetModule(item_index);
+    if(module) mod_names.push_back(module->Name);
+  }
+  if(mod_names.empty()) return;
+  std::string job_name = mod_names.size() == 1 ? mod_names[0] :
+    std::to_string(mod_names.size()) + " modules";
+  SetBusy(true);
+  SetStatusText("Installing " + job_name + "...");
+  // Several modules are transferred at once, then registered together
+  std::shared_ptr<std::vector<std::string>> installed =
+    std::make_shared<std::vector<std::string>>();
+  Jobs->Submit(job_name,
+    [mod_names, installed](JobContext & context)
+    {
+      return SwordApp.DownloadRemoteModules(mod_names, *installed);
+    },
+    [this, installed](const JobResult & result)
+    {
+      wxThreadEvent * done = new wxThreadEvent(wxEVT_THREAD, ID_JobDone);
+      done->SetInt(result.Success && !result.Cancelled);
+      done->SetExtraLong(JOB_Install);
+      done->SetString(result.Name);
+      done->SetPayload(*installed);
+      wxQueueEvent(this, done);
+    });
+}
+
+void InstallerFrame::UpdateModules(wxCommandEvent& event)
+{
+  // Checked here, since it reads the library catalog, against the catalogs
+  // cached by earlier loads of each source
+  std::vector<ModuleUpdate> updates = SwordApp.CheckForUpdates();
+  if(updates.empty())
+  {
+    SetStatusText("All modules are up to date");
+    return;
+  }
+  std::string job_name = updates.size() == 1 ? updates[0].Name :
+    std::to_string(updates.size()) + " modules";
+  SetBusy(true);
+  SetStatusText("Updating " + job_name + "...");
+  std::shared_ptr<std::vector<std::string>> updated =
+    std::make_shared<std::vector<std::string>>();
+  Jobs->Submit(job_name,
+    [updates, updated](JobContext & context)
+    {
+      return SwordApp.DownloadModuleUpdates(updates, *updated);
+    },
+    [this, updated](const JobResult & result)
+    {
+      wxThreadEvent * done = new wxThreadEvent(wxEVT_THREAD, ID_JobDone);
+      done->SetInt(result.Success && !result.Cancelled);
+      done->SetExtraLong(JOB_Update);
+      done->SetString(result.Name);
+      done->SetPayload(*updated);
+      wxQueueEvent(this, done);
+    });
+}
+
+void InstallerFrame::CancelJob(wxCommandEvent& event)
+{
+  Jobs->CancelAll();
+  SetStatusText("Cancelling...");
+}
+
+void InstallerFrame::OnJobProgress(wxThreadEvent& event)
+{
+  ProgressGauge->SetValue(event.GetInt());
+  if(!event.GetString().IsEmpty()) SetStatusText(event.GetString());
+}
+
+void InstallerFrame::OnJobDone(wxThreadEvent& event)
+{
+  bool success = event.GetInt() != 0;
+  std::string name(event.GetString());
+  if(event.GetExtraLong() == JOB_Index)
+  {
+    SetStatusText("Search index updated");
+  }
+  else if(event.GetExtraLong() == JOB_LoadSource)
+  {
+    // The catalog is swapped in whole, so a failed refresh keeps the old one
+    FillModuleList();
+    const SourceCatalog & info = ModuleListCtrl->GetCatalog()->GetCatalog();
+    if(!success) SetStatusText("Couldn't refresh source " + name);
+    else if(info.Downloaded) SetStatusText("Refreshed source " + name);
+    else
+    {
+      long age = (std::time(0) - info.FetchTime)/60;
+      std::string age_text = age < 120 ? std::to_string(age) + " minutes" :
+        std::to_string(age/60) + " hours";
+      SetStatusText("Loaded source " + name + " (catalog fetched " + age_text +
+        " ago)");
+    }
+  }
+  else
+  {
+    std::vector<std::string> installed =
+      event.GetPayload<std::vector<std::string>>();
+    if(installed.size() > 0)
+    {
+      // New modules are registered on the UI thread, where they are read,
+      // then indexed for search in the background
+      SwordApp.RegisterInstalledModules(installed);
+      std::string done_text = event.GetExtraLong() == JOB_Update ?
+        "Updated " : "Installed ";
+      if(success) done_text += name;
+      else done_text += std::to_string(installed.size()) + " of " + name;
+      if(event.GetExtraLong() == JOB_Update)
+      {
+        TransferStats transfer = SwordApp.GetTransferStats();
+        if(transfer.FilesSkipped > 0)
+        {
+          done_text += " (" + std::to_string(transfer.FilesSkipped) +
+            " unchanged files skipped)";
+        }
+      }
+      SetStatusText(done_text);
+      Jobs->Submit("Index " + name,
+        [](JobContext & context)
+        {
+          SwordApp.UpdateSearchIndex(0, false,
+            [&context]{ return context.IsCancelled(); });
+          return true;
+        },
+        [this](const JobResult & result)
+        {
+          wxThreadEvent * done = new wxThreadEvent(wxEVT_THREAD, ID_JobDone);
+          done->SetInt(result.Success && !result.Cancelled);
+          done->SetExtraLong(JOB_Index);
+          done->SetString(result.Name);
+          wxQueueEvent(this, done);
+        });
+    }
+    else if(event.GetExtraLong() == JOB_Update)
+    {
+      SetStatusText("Couldn't update " + name);
+    }
+    else SetStatusText("Couldn't install " + name);
+  }
+  SetBusy(Jobs->IsBusy());
+}
+
+void InstallerFrame::SetBusy(bool busy)
+{
+  LoadSourceButton->Enable(!busy);
+  RefreshSourceButton->Enable(!busy);
+  InstallButton->Enable(!busy);
+  UpdateButton->Enable(!busy);
+  CancelButton->Enable(busy);
+  if(!busy) ProgressGauge->SetValue(0);
+}
+
+void InstallerFrame::FillModuleList()
+{
+  // Filter choices come from the new catalog; the current ones are kept
+  // when it still has them
+  std::shared_ptr<const CatalogIndex> catalog = SwordApp.GetRemoteCatalog();
+  CatalogQuery query = ModuleListCtrl->GetQuery();
+  wxArrayString choices;
+  choices.Add("All languages");
+  int selection = 0;
+  for(const std::string & language : catalog->GetLanguages())
+  {
+    if(language == query.Language) selection = choices.GetCount();
+    choices.Add(language);
+  }
+  LanguageComboBox->Set(choices);
+  LanguageComboBox->SetSelection(selection);
+  if(selection == 0) query.Language = "";
+  choices.Clear();
+  choices.Add("All types");
+  selection = 0;
+  for(const std::string & type : catalog->GetTypes())
+  {
+    if(type == query.Type) selection = choices.GetCount();
+    choices.Add(type);
+  }
+  TypeComboBox->Set(choices);
+  TypeComboBox->SetSelection(selection);
+  if(selection == 0) query.Type = "";
+  ModDescriptionTextCtrl->Clear();
+  ModuleListCtrl->SetCatalog(catalog);
+  ModuleListCtrl->SetQuery(query);
 }
 
 void InstallerFrame::DisplayModuleInfo(wxListEvent& event)
 {
-  long int item_index = -1;
-  item_index = ModuleListCtrl->GetNextItem(item_index, wxLIST_NEXT_ALL,
-    wxLIST_STATE_SELECTED);
-  std::vector<SwordModuleInfo> mod_list = SwordApp.GetRemoteSourceModules();
+  const SwordModuleInfo * module = ModuleListCtrl->GetModule(event.GetIndex());
   ModDescriptionTextCtrl->Clear();
-  *ModDescriptionTextCtrl << wxString(mod_list[item_index].Description.c_str());
+  if(module) *ModDescriptionTextCtrl << wxString(module->Description.c_str());
+}
+
+void InstallerFrame::FilterModules(wxCommandEvent& event)
+{
+  CatalogQuery query = ModuleListCtrl->GetQuery();
+  query.Text = std::string(ModuleFilterTextCtrl->GetValue());
+  query.Language = LanguageComboBox->GetSelection() > 0 ?
+    std::string(LanguageComboBox->GetValue()) : "";
+  query.Type = TypeComboBox->GetSelection() > 0 ?
+    std::string(TypeComboBox->GetValue()) : "";
+  ModDescriptionTextCtrl->Clear();
+  ModuleListCtrl->SetQuery(query);
+  SetStatusText(std::to_string(ModuleListCtrl->GetRowCount()) + " of " +
+    std::to_string(ModuleListCtrl->GetCatalog()->GetModules().size()) +
+    " modules");
+}
+
+void InstallerFrame::SortModules(wxListEvent& event)
+{
+  // Clicking the sorted column again reverses it
+  CatalogQuery query = ModuleListCtrl->GetQuery();
+  CatalogSortKey key = CatalogSortKey(event.GetColumn());
+  if(key < SORT_Name || key > SORT_Version) return;
+  query.Ascending = query.SortKey == key ? !query.Ascending : true;
+  query.SortKey = key;
+  ModuleListCtrl->SetQuery(query);
+}
+
+CatalogListCtrl::CatalogListCtrl(wxWindow * parent, wxWindowID id,
+  const wxPoint& pos, const wxSize& size) :
+  wxListCtrl(parent, id, pos, size,
+    wxLC_REPORT | wxLC_HRULES | wxLC_VIRTUAL),
+  catalog(std::make_shared<const CatalogIndex>())
+{
+  InsertColumn(SORT_Name, "Name", wxLIST_FORMAT_LEFT, 120);
+  InsertColumn(SORT_Type, "Type", wxLIST_FORMAT_LEFT, 200);
+  InsertColumn(SORT_Language, "Lang", wxLIST_FORMAT_LEFT, 50);
+  InsertColumn(SORT_Version, "Version", wxLIST_FORMAT_LEFT, 90);
+}
+
+void CatalogListCtrl::SetCatalog(std::shared_ptr<const CatalogIndex> catalog)
+{
+  // A refreshed catalog of the same source keeps the selection
+  std::set<std::string> selected;
+  if(catalog->GetCatalog().Source == this->catalog->GetCatalog().Source)
+  {
+    selected = SelectedNames();
+  }
+  this->catalog = catalog;
+  UpdateRows(selected);
+}
+
+void CatalogListCtrl::SetQuery(const CatalogQuery & query)
+{
+  std::set<std::string> selected = SelectedNames();
+  this->query = query;
+  UpdateRows(selected);
+}
+
+const SwordModuleInfo * CatalogListCtrl::GetModule(long item)
+{
+  if(item < 0 || item >= (long)rows.size()) return 0;
+  return &catalog->GetModules()[rows[item]];
+}
+
+wxString CatalogListCtrl::OnGetItemText(long item, long column) const
+{
+  if(item < 0 || item >= (long)rows.size()) return "";
+  const SwordModuleInfo & module = catalog->GetModules()[rows[item]];
+  switch(column)
+  {
+    case SORT_Name: return module.Name;
+    case SORT_Type: return module.Type;
+    case SORT_Language: return module.Language;
+    case SORT_Version: return module.Version;
+  }
+  return "";
+}
+
+std::set<std::string> CatalogListCtrl::SelectedNames()
+{
+  std::set<std::string> names;
+  long item = -1;
+  while((item = GetNextItem(item, wxLIST_NEXT_ALL,
+    wxLIST_STATE_SELECTED)) != -1)
+  {
+    const SwordModuleInfo * module = GetModule(item);
+    if(module) names.insert(module->Name);
+  }
+  return names;
+}
+
+void CatalogListCtrl::UpdateRows(const std::set<std::string> & selected)
+{
+  // Every selected position is cleared, then the selected modules'
+  // new rows (if they still match) are selected again
+  long item = -1;
+  while((item = GetNextItem(item, wxLIST_NEXT_ALL,
+    wxLIST_STATE_SELECTED)) != -1)
+  {
+    SetItemState(item, 0, wxLIST_STATE_SELECTED);
+  }
+  catalog->Query(query, rows);
+  SetItemCount(rows.size());
+  if(!selected.empty())
+  {
+    const std::vector<SwordModuleInfo> & modules = catalog->GetModules();
+    for(size_t row = 0; row < rows.size(); row++)
+    {
+      if(selected.count(modules[rows[row]].Name))
+      {
+        SetItemState(row, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
+      }
+    }
+  }
+  Refresh();
 }
@@ -0,0 +1,138 @@
+// Machaira: MappedFile.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file maps a whole file read-only into memory (mmap on POSIX,
+// file mappings on Windows), for indexes and stores that are read in place,
+// and replaces such files safely
+// Current version: Pre-release
+
+#include "MappedFile.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :
+  data(0), size(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(0)
+{
+}
+
+bool MappedFile::Open(std::string file_name)
+{
+  Close();
+  file_handle = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ,
+    0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if(file_handle == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER file_size;
+  if(!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+  {
+    Close();
+    return false;
+  }
+  mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+  if(!mapping_handle)
+  {
+    Close();
+    return false;
+  }
+  data = static_cast<const char *>(
+    MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+  if(!data)
+  {
+    Close();
+    return false;
+  }
+  size = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(data) UnmapViewOfFile(data);
+  if(mapping_handle) CloseHandle(mapping_handle);
+  if(file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+  data = 0;
+  size = 0;
+  mapping_handle = 0;
+  file_handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : data(0), size(0), file_descriptor(-1)
+{
+}
+
+bool MappedFile::Open(std::string file_name)
+{
+  Close();
+  file_descriptor = open(file_name.c_str(), O_RDONLY);
+  if(file_descriptor < 0) return false;
+  struct stat file_stat;
+  // Empty files cannot be mapped; callers treat them as missing
+  if(fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+  {
+    Close();
+    return false;
+  }
+  void * mapping = mmap(0, file_stat.st_size, PROT_READ, MAP_SHARED,
+    file_descriptor, 0);
+  if(mapping == MAP_FAILED)
+  {
+    Close();
+    return false;
+  }
+  data = static_cast<const char *>(mapping);
+  size = static_cast<size_t>(file_stat.st_size);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(data) munmap(const_cast<char *>(data), size);
+  if(file_descriptor >= 0) close(file_descriptor);
+  data = 0;
+  size = 0;
+  file_descriptor = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+bool ReplaceFileContents(std::string file_name, const std::string & contents)
+{
+  std::string temp_name = file_name + ".tmp";
+  {
+    std::ofstream fout(temp_name.c_str(), std::ios::binary | std::ios::trunc);
+    fout.write(contents.data(), contents.size());
+    if(!fout)
+    {
+      std::cout << "Error writing " << temp_name << '\n';
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temp_name, file_name, error);
+  if(error)
+  {
+    std::cout << "Error replacing " << file_name << ": " << error.message() <<
+      '\n';
+    std::filesystem::remove(temp_name, error);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,44 @@
+// Machaira: MappedFile.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file maps a whole file read-only into memory (mmap on POSIX,
+// file mappings on Windows), for indexes and stores that are read in place,
+// and replaces such files safely
+// Current version: Pre-release
+
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <string>
+#include <cstddef>
+
+class MappedFile
+{
+  public:
+    // Constructor
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+    // Mapping
+    bool Open(std::string file_name);
+    void Close();
+    bool IsOpen(){ return data != 0; }
+    // Contents (valid until Close)
+    const char * Data() const { return data; }
+    size_t Size() const { return size; }
+  private:
+    const char * data;
+    size_t size;
+#ifdef _WIN32
+    void * file_handle;
+    void * mapping_handle;
+#else
+    int file_descriptor;
+#endif
+};
+
+// Writes the contents to a temporary file and renames it over file_name,
+// so readers never map a half-written file
+bool ReplaceFileContents(std::string file_name, const std::string & contents);
+
+#endif
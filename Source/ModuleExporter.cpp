@@ -0,0 +1,468 @@
+// Machaira: ModuleExporter.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file exports whole Bibles and commentaries to static HTML, one file
+// per chapter, through a pipeline: one thread reads the verses, a pool
+// renders them and one thread writes the chapters in order, with bounded
+// queues between them so memory stays flat however large the module
+// Current version: Pre-release
+
+#include "ModuleExporter.hpp"
+#include "HtmlPostProcess.hpp"
+#include "MappedFile.hpp"
+#include "SearchIndex.hpp"
+#include "Trace.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <filesystem>
+#include <cstdio>
+
+#include <versekey.h>
+#include <versificationmgr.h>
+
+namespace
+{
+  const char * progress_file_name = "export-progress.txt";
+
+  // Plain text (descriptions, book names) into markup, so a stray '&' or '<'
+  // in a module's .conf cannot break the page
+  void AppendText(const std::string & text, std::string & output)
+  {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for(char c : text)
+    {
+      if(c == '&') escaped += "&amp;";
+      else if(c == '<') escaped += "&lt;";
+      else if(c == '>') escaped += "&gt;";
+      else escaped += c;
+    }
+    AppendEncodedHtml(escaped.data(), escaped.data() + escaped.size(), output);
+  }
+}
+
+std::string ExportChapterFile(int book_number, const std::string & book,
+  int chapter)
+{
+  char file_name[64];
+  std::snprintf(file_name, sizeof(file_name), "%02d-%s-%03d.html", book_number,
+    book.c_str(), chapter);
+  return file_name;
+}
+
+void ModuleExporter::ChapterQueue::Push(std::unique_ptr<ExportChapter> chapter)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this]{ return items.size() < capacity; });
+  items.push_back(std::move(chapter));
+  changed.notify_all();
+}
+
+bool ModuleExporter::ChapterQueue::Pop(std::unique_ptr<ExportChapter> & chapter)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this]{ return closed || !items.empty(); });
+  if(items.empty()) return false;
+  chapter = std::move(items.front());
+  items.pop_front();
+  changed.notify_all();
+  return true;
+}
+
+void ModuleExporter::ChapterQueue::Close()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  closed = true;
+  changed.notify_all();
+}
+
+void ModuleExporter::ChapterWindow::Push(std::unique_ptr<ExportChapter> chapter)
+{
+  // The chapter the writer needs next is never held back, so the workers
+  // holding later ones always get their turn
+  std::unique_lock<std::mutex> lock(mutex);
+  size_t sequence = chapter->Sequence;
+  changed.wait(lock, [this, sequence]{ return sequence < next + capacity; });
+  slots[sequence % capacity] = std::move(chapter);
+  changed.notify_all();
+}
+
+bool ModuleExporter::ChapterWindow::Pop(std::unique_ptr<ExportChapter> & chapter)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this]{ return closed || slots[next % capacity]; });
+  if(!slots[next % capacity]) return false;
+  chapter = std::move(slots[next % capacity]);
+  next++;
+  changed.notify_all();
+  return true;
+}
+
+void ModuleExporter::ChapterWindow::Close()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  closed = true;
+  changed.notify_all();
+}
+
+ModuleExporter::ModuleExporter(std::string library_dir,
+  const ExportOptions & options) :
+  library_dir(library_dir), options(options), in_flight(0)
+{
+  if(this->options.Jobs <= 0)
+  {
+    this->options.Jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if(this->options.QueueDepth == 0) this->options.QueueDepth = 1;
+  // Readers are created here, on the caller's thread, because SWORD's
+  // global managers are not safe to initialize from two threads at once
+  for(int n = 0; n <= this->options.Jobs; n++)
+  {
+    readers.emplace_back(new SwordReader(library_dir));
+  }
+}
+
+bool ModuleExporter::PrepareModule(ExportModule & module)
+{
+  sword::SWModule * sword_module = readers[0]->GetModule(module.Name);
+  if(!sword_module)
+  {
+    std::cout << "Error: Couldn't find module " << module.Name << '\n';
+    return false;
+  }
+  if(!dynamic_cast<sword::VerseKey *>(sword_module->getKey()))
+  {
+    std::cout << "Error: Couldn't export " << module.Name
+      << " (only Bibles and commentaries are exported by chapter)\n";
+    return false;
+  }
+  module.Description = sword_module->getDescription();
+  module.Stamp = ModuleIndexStamp(library_dir, sword_module);
+  module.Dir = (std::filesystem::path(options.OutputDir) / module.Name).string();
+  std::error_code error;
+  std::filesystem::create_directories(module.Dir, error);
+  std::string progress_file = module.Dir + "/" + progress_file_name;
+
+  // Books recorded by an earlier run are kept only if the module has not
+  // changed since
+  std::ifstream fin(progress_file.c_str());
+  std::string line;
+  if(options.Resume && std::getline(fin, line) && line == "stamp\t" + module.Stamp)
+  {
+    while(std::getline(fin, line))
+    {
+      std::stringstream ss(line);
+      std::string kind, number, chapters, chapter;
+      ExportBook book;
+      if(!std::getline(ss, kind, '\t') || kind != "book" ||
+        !std::getline(ss, number, '\t') || !std::getline(ss, book.Book, '\t') ||
+        !std::getline(ss, book.Name, '\t'))
+      {
+        continue;
+      }
+      book.Number = std::atoi(number.c_str());
+      std::getline(ss, chapters);
+      std::stringstream cs(chapters);
+      while(std::getline(cs, chapter, ','))
+      {
+        book.Chapters.push_back(std::atoi(chapter.c_str()));
+      }
+      module.Books.push_back(book);
+      module.Resumed.insert(book.Book);
+    }
+    return true;
+  }
+  if(!ReplaceFileContents(progress_file, "stamp\t" + module.Stamp + "\n"))
+  {
+    std::cout << "Error: Couldn't write " << progress_file << '\n';
+    return false;
+  }
+  return true;
+}
+
+void ModuleExporter::ReadStage()
+{
+  // Walks each book verse by verse, as IncrementVerse does, reading the
+  // raw entries; chapters are handed on whole
+  SwordReader & reader = *readers[0];
+  size_t sequence = 0;
+  auto send = [this](std::unique_ptr<ExportChapter> chapter)
+  {
+    {
+      std::lock_guard<std::mutex> lock(stats_mutex);
+      in_flight++;
+      stats.PeakChapters = std::max(stats.PeakChapters, in_flight);
+    }
+    rendering->Push(std::move(chapter));
+  };
+  for(size_t m = 0; m < modules.size(); m++)
+  {
+    if(modules[m].Failed) continue;
+    sword::SWModule * module = reader.GetModule(modules[m].Name);
+    std::unique_ptr<sword::SWKey> key(module->createKey());
+    sword::VerseKey * vk = dynamic_cast<sword::VerseKey *>(key.get());
+    const sword::VersificationMgr::System * system =
+      sword::VersificationMgr::getSystemVersificationMgr()->
+        getVersificationSystem(vk->getVersificationSystem());
+    for(int b = 0; system && b < system->getBookCount(); b++)
+    {
+      const sword::VersificationMgr::Book * book = system->getBook(b);
+      std::string osis(book->getOSISName());
+      if(!options.Books.empty() && std::find(options.Books.begin(),
+        options.Books.end(), osis) == options.Books.end())
+      {
+        continue;
+      }
+      if(modules[m].Resumed.count(osis))
+      {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.BooksSkipped++;
+        continue;
+      }
+      vk->setText((osis + " 1:1").c_str());
+      if(vk->popError() || osis != vk->getOSISBookName()) continue;
+      std::unique_ptr<ExportChapter> chapter;
+      while(!vk->popError() && osis == vk->getOSISBookName())
+      {
+        if(!chapter || chapter->Chapter != vk->getChapter())
+        {
+          if(chapter) send(std::move(chapter));
+          chapter.reset(new ExportChapter());
+          chapter->Sequence = sequence++;
+          chapter->Module = m;
+          chapter->BookNumber = b + 1;
+          chapter->Book = osis;
+          chapter->BookName = book->getLongName();
+          chapter->Chapter = vk->getChapter();
+          chapter->LastOfBook = false;
+        }
+        module->setKey(*vk);
+        const char * raw;
+        {
+          TRACE_SCOPE("export.ReadEntry");
+          raw = module->getRawEntry();
+        }
+        // Commentaries have no entry for most verses
+        if(raw && *raw)
+        {
+          chapter->Verses.push_back(ExportVerse{vk->getIndex(), vk->getVerse(),
+            vk->getOSISRef(), raw});
+        }
+        vk->increment();
+      }
+      if(chapter)
+      {
+        chapter->LastOfBook = true;
+        send(std::move(chapter));
+      }
+    }
+  }
+  rendering->Close();
+}
+
+void ModuleExporter::RenderStage(SwordReader * reader)
+{
+  // SWORD's render filters and the post-processing run here, from the raw
+  // entries, so no worker reads the module files
+  std::unique_ptr<ExportChapter> chapter;
+  std::unique_ptr<sword::SWKey> key;
+  size_t key_module = SIZE_MAX;
+  std::string rendered;
+  while(rendering->Pop(chapter))
+  {
+    sword::SWModule * module = reader->GetModule(modules[chapter->Module].Name);
+    if(chapter->Module != key_module)
+    {
+      key.reset(module->createKey());
+      key_module = chapter->Module;
+    }
+    SetDefaultModuleOptions(module);
+    for(ExportVerse & verse : chapter->Verses)
+    {
+      // Filters may use the key (for links and verse numbers)
+      key->setIndex(verse.Index);
+      module->setKey(*key);
+      {
+        TRACE_SCOPE("sword.renderText");
+        rendered.assign(module->renderText(verse.Text.c_str()));
+      }
+      PostProcessHtml(rendered, verse.Text);
+    }
+    writing->Push(std::move(chapter));
+  }
+}
+
+bool ModuleExporter::WriteChapter(ExportModule & module,
+  const ExportChapter & chapter)
+{
+  std::string title = chapter.BookName + " " + std::to_string(chapter.Chapter);
+  std::string page = "<!DOCTYPE html>\n<html>\n<head>\n"
+    "<meta charset=\"utf-8\">\n<title>";
+  AppendText(module.Name + " - " + title, page);
+  page += "</title>\n</head>\n<body>\n<h1>";
+  AppendText(title, page);
+  page += "</h1>\n";
+  for(const ExportVerse & verse : chapter.Verses)
+  {
+    page += "<div class=\"verse\" id=\"";
+    page += verse.OsisRef;
+    page += "\"><sup>";
+    page += std::to_string(verse.Verse);
+    page += "</sup> ";
+    page += verse.Text;
+    page += "</div>\n";
+  }
+  page += "<p class=\"nav\"><a href=\"index.html\">";
+  AppendText(module.Description, page);
+  page += "</a></p>\n</body>\n</html>\n";
+
+  std::string file_name = module.Dir + "/" +
+    ExportChapterFile(chapter.BookNumber, chapter.Book, chapter.Chapter);
+  if(!ReplaceFileContents(file_name, page))
+  {
+    std::cout << "Error: Couldn't write " << file_name << '\n';
+    return false;
+  }
+  return true;
+}
+
+void ModuleExporter::RecordBook(ExportModule & module, const ExportBook & book)
+{
+  // One line per book, appended once all its chapters are written
+  std::string progress_file = module.Dir + "/" + progress_file_name;
+  std::ofstream fout(progress_file.c_str(), std::ios::app);
+  fout << "book\t" << book.Number << '\t' << book.Book << '\t' << book.Name
+    << '\t';
+  for(size_t n = 0; n < book.Chapters.size(); n++)
+  {
+    fout << (n > 0 ? "," : "") << book.Chapters[n];
+  }
+  fout << '\n';
+  module.Books.push_back(book);
+}
+
+void ModuleExporter::WriteStage(ExportProgress progress)
+{
+  std::unique_ptr<ExportChapter> chapter;
+  ExportBook book;
+  bool book_failed = false;
+  while(writing->Pop(chapter))
+  {
+    ExportModule & module = modules[chapter->Module];
+    if(book.Book == "")
+    {
+      book.Number = chapter->BookNumber;
+      book.Book = chapter->Book;
+      book.Name = chapter->BookName;
+    }
+    bool written = false;
+    if(!chapter->Verses.empty())
+    {
+      TRACE_SCOPE("export.WriteChapter");
+      written = WriteChapter(module, *chapter);
+      if(written) book.Chapters.push_back(chapter->Chapter);
+      else book_failed = true;
+    }
+    ExportStats progress_stats;
+    {
+      std::lock_guard<std::mutex> lock(stats_mutex);
+      in_flight--;
+      if(written)
+      {
+        stats.Chapters++;
+        stats.Verses += chapter->Verses.size();
+      }
+      // A book with a chapter not written is left for the next run
+      if(chapter->LastOfBook && !book_failed) stats.Books++;
+      stats.Seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - started).count();
+      progress_stats = stats;
+    }
+    if(!chapter->LastOfBook) continue;
+    if(book_failed) module.Failed = true;
+    else RecordBook(module, book);
+    if(progress) progress(module.Name, book.Book, progress_stats);
+    book = ExportBook();
+    book_failed = false;
+  }
+}
+
+bool ModuleExporter::WriteContents(const ExportModule & module)
+{
+  std::vector<ExportBook> books = module.Books;
+  std::stable_sort(books.begin(), books.end(),
+    [](const ExportBook & a, const ExportBook & b){ return a.Number < b.Number; });
+  std::string page = "<!DOCTYPE html>\n<html>\n<head>\n"
+    "<meta charset=\"utf-8\">\n<title>";
+  AppendText(module.Description, page);
+  page += "</title>\n</head>\n<body>\n<h1>";
+  AppendText(module.Description, page);
+  page += "</h1>\n";
+  for(const ExportBook & book : books)
+  {
+    if(book.Chapters.empty()) continue;
+    page += "<h2>";
+    AppendText(book.Name, page);
+    page += "</h2>\n<p>";
+    for(size_t n = 0; n < book.Chapters.size(); n++)
+    {
+      if(n > 0) page += ' ';
+      page += "<a href=\"" + ExportChapterFile(book.Number, book.Book,
+        book.Chapters[n]) + "\">" + std::to_string(book.Chapters[n]) + "</a>";
+    }
+    page += "</p>\n";
+  }
+  page += "</body>\n</html>\n";
+  std::string file_name = module.Dir + "/index.html";
+  if(!ReplaceFileContents(file_name, page))
+  {
+    std::cout << "Error: Couldn't write " << file_name << '\n';
+    return false;
+  }
+  return true;
+}
+
+bool ModuleExporter::Run(ExportStats & result, ExportProgress progress)
+{
+  TRACE_SCOPE("export.Run");
+  started = std::chrono::steady_clock::now();
+  stats = ExportStats();
+  in_flight = 0;
+  modules.clear();
+  for(const std::string & mod_name : options.Modules)
+  {
+    ExportModule module;
+    module.Name = mod_name;
+    if(!PrepareModule(module)) module.Failed = true;
+    modules.push_back(module);
+  }
+
+  rendering.reset(new ChapterQueue(options.QueueDepth));
+  writing.reset(new ChapterWindow(options.QueueDepth));
+  std::thread reader_thread(&ModuleExporter::ReadStage, this);
+  std::vector<std::thread> workers;
+  for(size_t n = 1; n < readers.size(); n++)
+  {
+    workers.emplace_back(&ModuleExporter::RenderStage, this, readers[n].get());
+  }
+  std::thread writer_thread(&ModuleExporter::WriteStage, this, progress);
+  reader_thread.join();
+  for(std::thread & worker : workers) worker.join();
+  writing->Close();
+  writer_thread.join();
+
+  bool ok = true;
+  for(ExportModule & module : modules)
+  {
+    if(!module.Failed && !WriteContents(module)) module.Failed = true;
+    if(module.Failed) ok = false;
+    else stats.Modules++;
+  }
+  stats.Seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - started).count();
+  result = stats;
+  return ok;
+}
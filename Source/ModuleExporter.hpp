@@ -0,0 +1,162 @@
+// Machaira: ModuleExporter.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file exports whole Bibles and commentaries to static HTML, one file
+// per chapter, through a pipeline: one thread reads the verses, a pool
+// renders them and one thread writes the chapters in order, with bounded
+// queues between them so memory stays flat however large the module
+// Current version: Pre-release
+
+#ifndef MODULEEXPORTER_HPP
+#define MODULEEXPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+#include "SwordReader.hpp"
+
+struct ExportOptions
+{
+  std::vector<std::string> Modules;
+  // OSIS names of the books to export (every book when empty)
+  std::vector<std::string> Books;
+  std::string OutputDir;
+  // Render workers (0 means one per core)
+  int Jobs = 0;
+  // Chapters each queue holds before the stage feeding it waits
+  size_t QueueDepth = 16;
+  // Skip books written by an earlier run against the same module version
+  bool Resume = true;
+};
+
+struct ExportStats
+{
+  unsigned long Modules = 0;
+  unsigned long Books = 0;
+  unsigned long BooksSkipped = 0;
+  unsigned long Chapters = 0;
+  unsigned long Verses = 0;
+  // Most chapters between the reader and the writer at any time
+  size_t PeakChapters = 0;
+  double Seconds = 0.0;
+  double VersesPerSecond() const { return Seconds > 0.0 ? Verses/Seconds : 0.0; }
+};
+
+// Called on the writer thread as each book is finished
+typedef std::function<void(const std::string & mod_name,
+  const std::string & book, const ExportStats & stats)> ExportProgress;
+
+// Output layout: OutputDir/Module/index.html lists the books and chapters,
+// OutputDir/Module/43-John-003.html holds John 3 (book number in the
+// module's versification), and export-progress.txt there records the books
+// finished, for Resume
+std::string ExportChapterFile(int book_number, const std::string & book,
+  int chapter);
+
+class ModuleExporter
+{
+  public:
+    // Constructor (readers are created here, one per stage thread)
+    ModuleExporter(std::string library_dir, const ExportOptions & options);
+    // Exports every module; false if any could not be read or written
+    bool Run(ExportStats & stats, ExportProgress progress = nullptr);
+  private:
+    struct ExportVerse
+    {
+      long Index;
+      int Verse;
+      std::string OsisRef;
+      // Raw entry from the reader, rendered HTML after the render stage
+      std::string Text;
+    };
+    struct ExportChapter
+    {
+      size_t Sequence;
+      size_t Module;
+      int BookNumber;
+      std::string Book;
+      std::string BookName;
+      int Chapter;
+      // Last chapter of its book, so the writer can record the book done
+      bool LastOfBook;
+      std::vector<ExportVerse> Verses;
+    };
+    struct ExportBook
+    {
+      int Number;
+      std::string Book;
+      std::string Name;
+      std::vector<int> Chapters;
+    };
+    struct ExportModule
+    {
+      std::string Name;
+      std::string Description;
+      std::string Dir;
+      std::string Stamp;
+      // Books finished (by an earlier run first), and those the reader skips
+      std::vector<ExportBook> Books;
+      std::set<std::string> Resumed;
+      bool Failed = false;
+    };
+    // Chapters from the reader to the render pool, first come first served
+    class ChapterQueue
+    {
+      public:
+        ChapterQueue(size_t capacity) : capacity(capacity), closed(false) {}
+        void Push(std::unique_ptr<ExportChapter> chapter);
+        bool Pop(std::unique_ptr<ExportChapter> & chapter);
+        void Close();
+      private:
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::unique_ptr<ExportChapter>> items;
+        size_t capacity;
+        bool closed;
+    };
+    // Rendered chapters to the writer, in sequence (slot Sequence %
+    // capacity); a worker that gets too far ahead of the writer waits
+    class ChapterWindow
+    {
+      public:
+        ChapterWindow(size_t capacity) :
+          slots(capacity), capacity(capacity), next(0), closed(false) {}
+        void Push(std::unique_ptr<ExportChapter> chapter);
+        bool Pop(std::unique_ptr<ExportChapter> & chapter);
+        void Close();
+      private:
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<std::unique_ptr<ExportChapter>> slots;
+        size_t capacity;
+        size_t next;
+        bool closed;
+    };
+    void ReadStage();
+    void RenderStage(SwordReader * reader);
+    void WriteStage(ExportProgress progress);
+    bool PrepareModule(ExportModule & module);
+    bool WriteChapter(ExportModule & module, const ExportChapter & chapter);
+    void RecordBook(ExportModule & module, const ExportBook & book);
+    bool WriteContents(const ExportModule & module);
+    std::string library_dir;
+    ExportOptions options;
+    std::vector<ExportModule> modules;
+    // readers[0] reads, the rest render
+    std::vector<std::unique_ptr<SwordReader>> readers;
+    std::unique_ptr<ChapterQueue> rendering;
+    std::unique_ptr<ChapterWindow> writing;
+    // Chapters read and not yet written (guarded by stats_mutex)
+    std::mutex stats_mutex;
+    size_t in_flight;
+    ExportStats stats;
+    std::chrono::steady_clock::time_point started;
+};
+
+#endif
@@ -0,0 +1,117 @@
+// Machaira: ParallelRenderer.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file renders one passage in several modules at once on a pool of
+// worker threads, each with its own SWORD manager, for the
+// parallel-translation view
+// Current version: Pre-release
+
+#include "ParallelRenderer.hpp"
+
+#include <algorithm>
+
+ParallelRenderer::ParallelRenderer(std::string library_dir, int workers) :
+  library_dir(library_dir), stopping(false), next_task(0), finished(0)
+{
+  if(workers <= 0)
+  {
+    workers = std::min(8, std::max(1, int(std::thread::hardware_concurrency())));
+  }
+  // Readers are created here, on the caller's thread, because SWORD's
+  // global managers are not safe to initialize from two threads at once
+  for(int n = 0; n < workers; n++)
+  {
+    readers.push_back(std::unique_ptr<SwordReader>(new SwordReader(library_dir)));
+  }
+  for(int n = 0; n < workers; n++)
+  {
+    this->workers.push_back(std::thread(&ParallelRenderer::Run, this, n));
+  }
+}
+
+ParallelRenderer::~ParallelRenderer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for(std::thread & worker : workers) worker.join();
+}
+
+void ParallelRenderer::Start(std::string key, std::vector<std::string> mod_names)
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    // Results of an unfinished batch are still being written
+    done.wait(lock, [this]{ return finished == task_mods.size(); });
+    task_key = key;
+    task_mods = mod_names;
+    task_options = display_options;
+    results.assign(task_mods.size(), std::string());
+    next_task = 0;
+    finished = 0;
+  }
+  wake.notify_all();
+}
+
+std::vector<std::string> ParallelRenderer::Wait()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]{ return finished == task_mods.size(); });
+  std::vector<std::string> pages;
+  pages.swap(results);
+  task_mods.clear();
+  finished = 0;
+  next_task = 0;
+  return pages;
+}
+
+std::vector<std::string> ParallelRenderer::Render(std::string key,
+  std::vector<std::string> mod_names)
+{
+  Start(key, mod_names);
+  return Wait();
+}
+
+void ParallelRenderer::SetDisplayOptions(const DisplayOptions & options)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  display_options = options;
+}
+
+void ParallelRenderer::ReloadLibrary()
+{
+  // Created on the caller's thread, as in the constructor
+  std::vector<std::unique_ptr<SwordReader>> fresh;
+  for(size_t n = 0; n < readers.size(); n++)
+  {
+    fresh.push_back(std::unique_ptr<SwordReader>(new SwordReader(library_dir)));
+  }
+  // Workers only touch their readers during a batch
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]{ return finished == task_mods.size(); });
+  readers.swap(fresh);
+}
+
+void ParallelRenderer::Run(int worker)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+  {
+    wake.wait(lock, [this]{ return stopping || next_task < task_mods.size(); });
+    if(stopping) return;
+    size_t task = next_task++;
+    std::string key = task_key;
+    std::string mod_name = task_mods[task];
+    SwordReader & reader = *readers[worker];
+    reader.SetDisplayOptions(task_options);
+    lock.unlock();
+
+    std::string html = reader.GetPassage(key, mod_name);
+
+    lock.lock();
+    results[task].swap(html);
+    finished++;
+    if(finished == task_mods.size()) done.notify_all();
+  }
+}
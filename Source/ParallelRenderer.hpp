@@ -0,0 +1,59 @@
+// Machaira: ParallelRenderer.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file renders one passage in several modules at once on a pool of
+// worker threads, each with its own SWORD manager, for the
+// parallel-translation view
+// Current version: Pre-release
+
+#ifndef PARALLELRENDERER_HPP
+#define PARALLELRENDERER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "SwordReader.hpp"
+
+class ParallelRenderer
+{
+  public:
+    // Constructor (0 workers means one per core, up to 8)
+    ParallelRenderer(std::string library_dir, int workers = 0);
+    ~ParallelRenderer();
+    // Starts rendering key in each module; waits for any earlier batch first
+    void Start(std::string key, std::vector<std::string> mod_names);
+    // Pages of the last batch, in the order the modules were given
+    std::vector<std::string> Wait();
+    std::vector<std::string> Render(std::string key,
+      std::vector<std::string> mod_names);
+    // Get/Set
+    int GetWorkerCount(){ return workers.size(); }
+    // Used by batches started after the call
+    void SetDisplayOptions(const DisplayOptions & options);
+    // After modules are installed or updated: waits for the batch in
+    // progress, then gives every worker a new reader (created here)
+    void ReloadLibrary();
+  private:
+    void Run(int worker);
+    // Worker state (each reader is only used on its own worker thread)
+    std::string library_dir;
+    std::vector<std::unique_ptr<SwordReader>> readers;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping;
+    // Current batch: modules are handed out in order, results stored by index
+    std::string task_key;
+    std::vector<std::string> task_mods;
+    DisplayOptions task_options;
+    DisplayOptions display_options;
+    std::vector<std::string> results;
+    size_t next_task;
+    size_t finished;
+};
+
+#endif
@@ -0,0 +1,574 @@
+// Machaira: ReferenceParser.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file parses typed verse references against the book names and
+// abbreviations of a versification, into the canonical keys the backend
+// is given, and completes partial references as they are typed
+// Current version: Pre-release
+
+#include "ReferenceParser.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <versificationmgr.h>
+
+namespace
+{
+  struct BookNames
+  {
+    const char * Osis;
+    const char * Name;
+    // Abbreviations and other names, '|'-separated
+    const char * Abbreviations;
+    // How often the book is looked up (3 most), to order equal matches
+    int Tier;
+  };
+
+  // English names of the books of every SWORD versification; books of a
+  // versification missing here use SWORD's own long name and abbreviation
+  constexpr BookNames book_names[] = {
+    {"Gen", "Genesis", "gen|ge|gn", 3},
+    {"Exod", "Exodus", "exod|exo|ex", 3},
+    {"Lev", "Leviticus", "lev|le|lv", 2},
+    {"Num", "Numbers", "num|nu|nm|nb", 2},
+    {"Deut", "Deuteronomy", "deut|deu|dt", 2},
+    {"Josh", "Joshua", "josh|jos|jsh", 2},
+    {"Judg", "Judges", "judg|jdg|jg|jdgs", 2},
+    {"Ruth", "Ruth", "rut|rth|ru", 2},
+    {"1Sam", "1 Samuel", "1 sam|1 sa|1 sm", 2},
+    {"2Sam", "2 Samuel", "2 sam|2 sa|2 sm", 2},
+    {"1Kgs", "1 Kings", "1 kgs|1 ki|1 kg", 2},
+    {"2Kgs", "2 Kings", "2 kgs|2 ki|2 kg", 2},
+    {"1Chr", "1 Chronicles", "1 chr|1 ch|1 chron", 2},
+    {"2Chr", "2 Chronicles", "2 chr|2 ch|2 chron", 2},
+    {"Ezra", "Ezra", "ezr", 2},
+    {"Neh", "Nehemiah", "neh|ne", 2},
+    {"Esth", "Esther", "esth|est|es", 2},
+    {"Job", "Job", "jb", 2},
+    {"Ps", "Psalms", "ps|psa|psalm|pss|psm|pslm", 3},
+    {"Prov", "Proverbs", "prov|pro|prv|pr", 3},
+    {"Eccl", "Ecclesiastes", "eccl|ecc|ec|qoh|qoheleth", 2},
+    {"Song", "Song of Solomon", "song|sos|so|song of songs|canticles|cant", 2},
+    {"Isa", "Isaiah", "isa|is", 3},
+    {"Jer", "Jeremiah", "jer|je|jr", 2},
+    {"Lam", "Lamentations", "lam|la", 2},
+    {"Ezek", "Ezekiel", "ezek|eze|ezk", 2},
+    {"Dan", "Daniel", "dan|da|dn", 2},
+    {"Hos", "Hosea", "hos|ho", 2},
+    {"Joel", "Joel", "joe|jl", 2},
+    {"Amos", "Amos", "am", 2},
+    {"Obad", "Obadiah", "obad|ob", 2},
+    {"Jonah", "Jonah", "jon|jnh", 2},
+    {"Mic", "Micah", "mic|mc", 2},
+    {"Nah", "Nahum", "nah|na", 2},
+    {"Hab", "Habakkuk", "hab|hb", 2},
+    {"Zeph", "Zephaniah", "zeph|zep|zp", 2},
+    {"Hag", "Haggai", "hag|hg", 2},
+    {"Zech", "Zechariah", "zech|zec|zc", 2},
+    {"Mal", "Malachi", "mal|ml", 2},
+    {"Matt", "Matthew", "matt|mat|mt", 3},
+    {"Mark", "Mark", "mrk|mk|mr", 3},
+    {"Luke", "Luke", "luk|lk", 3},
+    {"John", "John", "jn|jhn|joh", 3},
+    {"Acts", "Acts", "act|ac", 3},
+    {"Rom", "Romans", "rom|ro|rm", 3},
+    {"1Cor", "1 Corinthians", "1 cor|1 co", 3},
+    {"2Cor", "2 Corinthians", "2 cor|2 co", 2},
+    {"Gal", "Galatians", "gal|ga", 3},
+    {"Eph", "Ephesians", "eph|ephes", 3},
+    {"Phil", "Philippians", "phil|php|pp", 3},
+    {"Col", "Colossians", "col", 2},
+    {"1Thess", "1 Thessalonians", "1 thess|1 thes|1 th", 2},
+    {"2Thess", "2 Thessalonians", "2 thess|2 thes|2 th", 2},
+    {"1Tim", "1 Timothy", "1 tim|1 ti|1 tm", 2},
+    {"2Tim", "2 Timothy", "2 tim|2 ti|2 tm", 2},
+    {"Titus", "Titus", "tit", 2},
+    {"Phlm", "Philemon", "phlm|philem|phm", 2},
+    {"Heb", "Hebrews", "heb", 3},
+    {"Jas", "James", "jas|jm|jam", 2},
+    {"1Pet", "1 Peter", "1 pet|1 pe|1 pt", 2},
+    {"2Pet", "2 Peter", "2 pet|2 pe|2 pt", 2},
+    {"1John", "1 John", "1 jn|1 jo|1 jhn|1 joh", 2},
+    {"2John", "2 John", "2 jn|2 jo|2 jhn|2 joh", 2},
+    {"3John", "3 John", "3 jn|3 jo|3 jhn|3 joh", 2},
+    {"Jude", "Jude", "jud|jd", 2},
+    {"Rev", "Revelation", "rev|re|rv|apocalypse|revelations", 3},
+    {"Tob", "Tobit", "tob|tb", 1},
+    {"Jdt", "Judith", "jdt|jdth|jth", 1},
+    {"AddEsth", "Additions to Esther", "addesth|add esth|rest of esther", 1},
+    {"Wis", "Wisdom", "wis|ws|wisdom of solomon", 1},
+    {"Sir", "Sirach", "sir|ecclus|ecclesiasticus", 1},
+    {"Bar", "Baruch", "bar", 1},
+    {"EpJer", "Letter of Jeremiah", "epjer|ep jer|epistle of jeremiah", 1},
+    {"PrAzar", "Prayer of Azariah", "prazar|song of the three children", 1},
+    {"Sus", "Susanna", "sus", 1},
+    {"Bel", "Bel and the Dragon", "bel", 1},
+    {"PrMan", "Prayer of Manasseh", "prman|pr man|prayer of manasses", 1},
+    {"1Esd", "1 Esdras", "1 esd|1 es", 1},
+    {"2Esd", "2 Esdras", "2 esd|2 es", 1},
+    {"1Macc", "1 Maccabees", "1 macc|1 mac|1 ma", 1},
+    {"2Macc", "2 Maccabees", "2 macc|2 mac|2 ma", 1},
+    {"3Macc", "3 Maccabees", "3 macc|3 mac|3 ma", 1},
+    {"4Macc", "4 Maccabees", "4 macc|4 mac|4 ma", 1},
+  };
+
+  // Words that number a book ("I John", "Second Kings")
+  struct BookNumber
+  {
+    const char * Word;
+    char Digit;
+  };
+  constexpr BookNumber book_numbers[] = {
+    {"i", '1'}, {"first", '1'}, {"1st", '1'},
+    {"ii", '2'}, {"second", '2'}, {"2nd", '2'},
+    {"iii", '3'}, {"third", '3'}, {"3rd", '3'},
+    {"iv", '4'}, {"fourth", '4'}, {"4th", '4'},
+  };
+
+  bool StartsWith(const std::string & text, const std::string & prefix)
+  {
+    return text.compare(0, prefix.size(), prefix) == 0;
+  }
+
+  std::string Trim(const std::string & text)
+  {
+    size_t begin = text.find_first_not_of(" \t");
+    if(begin == std::string::npos) return "";
+    return text.substr(begin, text.find_last_not_of(" \t") + 1 - begin);
+  }
+
+  // Reads a number at pos (false when there is none)
+  bool ReadNumber(const std::string & text, size_t & pos, int & value)
+  {
+    if(pos >= text.size() || !std::isdigit((unsigned char)text[pos])) return false;
+    value = 0;
+    while(pos < text.size() && std::isdigit((unsigned char)text[pos]))
+    {
+      value = value*10 + (text[pos++] - '0');
+      if(value > 100000) return false;
+    }
+    return true;
+  }
+}
+
+ReferenceParser::ReferenceParser(std::string versification) :
+  versification(versification), latency_budget(1000)
+{
+  sword::VersificationMgr * mgr =
+    sword::VersificationMgr::getSystemVersificationMgr();
+  const sword::VersificationMgr::System * system =
+    mgr->getVersificationSystem(versification.c_str());
+  if(!system)
+  {
+    this->versification = "KJV";
+    system = mgr->getVersificationSystem("KJV");
+  }
+  if(!system) return;
+  for(int n = 0; n < system->getBookCount(); n++)
+  {
+    const sword::VersificationMgr::Book * sword_book = system->getBook(n);
+    Book book;
+    const BookNames * names = 0;
+    for(const BookNames & entry : book_names)
+    {
+      if(std::strcmp(entry.Osis, sword_book->getOSISName().c_str()) == 0)
+      {
+        names = &entry;
+        break;
+      }
+    }
+    std::string abbreviations;
+    if(names)
+    {
+      book.Name = names->Name;
+      book.Tier = names->Tier;
+      abbreviations = names->Abbreviations;
+    }
+    else
+    {
+      book.Name = sword_book->getLongName().c_str();
+      book.Tier = 0;
+      abbreviations = sword_book->getPreferredAbbreviation().c_str();
+    }
+    // The name comes first; it is what completions show
+    book.Aliases.push_back(NormalizeBookText(book.Name));
+    abbreviations = std::string(sword_book->getOSISName().c_str()) + "|" +
+      abbreviations;
+    size_t p = 0;
+    while(p <= abbreviations.size())
+    {
+      size_t q = abbreviations.find('|', p);
+      if(q == std::string::npos) q = abbreviations.size();
+      std::string alias = NormalizeBookText(abbreviations.substr(p, q - p));
+      if(alias != "" && std::find(book.Aliases.begin(), book.Aliases.end(),
+        alias) == book.Aliases.end())
+      {
+        book.Aliases.push_back(alias);
+      }
+      p = q + 1;
+    }
+    for(int chapter = 1; chapter <= sword_book->getChapterMax(); chapter++)
+    {
+      book.VerseMax.push_back(sword_book->getVerseMax(chapter));
+    }
+    books.push_back(book);
+  }
+}
+
+std::string ReferenceParser::NormalizeBookText(const std::string & text)
+{
+  std::string words;
+  for(char c : text)
+  {
+    unsigned char u = c;
+    if(c == '.') continue;
+    if(std::isspace(u))
+    {
+      if(words != "" && words.back() != ' ') words += ' ';
+      continue;
+    }
+    // "1John", "1jn": the number becomes its own word
+    if(words.size() == 1 && std::isdigit((unsigned char)words[0]) &&
+      std::isalpha(u))
+    {
+      words += ' ';
+    }
+    words += (u < 0x80) ? char(std::tolower(u)) : c;
+  }
+  if(words != "" && words.back() == ' ') words.pop_back();
+  // "I John", "Second Kings"
+  size_t space = words.find(' ');
+  if(space != std::string::npos)
+  {
+    std::string first = words.substr(0, space);
+    for(const BookNumber & number : book_numbers)
+    {
+      if(first == number.Word)
+      {
+        words = std::string(1, number.Digit) + words.substr(space);
+        break;
+      }
+    }
+  }
+  return words;
+}
+
+void ReferenceParser::SplitReference(const std::string & text,
+  std::string & book, std::string & numbers)
+{
+  // The book is everything before the chapter; a leading number followed
+  // by letters belongs to the book ("1 John 3", "2Kgs 4")
+  size_t start = text.find_first_not_of(" \t");
+  if(start == std::string::npos) start = text.size();
+  size_t pos = start;
+  while(pos < text.size() && std::isdigit((unsigned char)text[pos])) pos++;
+  if(pos > start)
+  {
+    size_t next = text.find_first_not_of(" \t", pos);
+    if(next == std::string::npos || !std::isalpha((unsigned char)text[next]))
+    {
+      // Numbers only: no book
+      book = text.substr(0, start);
+      numbers = text.substr(start);
+      return;
+    }
+  }
+  while(pos < text.size() && !std::isdigit((unsigned char)text[pos])) pos++;
+  book = text.substr(0, pos);
+  numbers = text.substr(pos);
+}
+
+void ReferenceParser::MatchBooks(const std::string & book_text,
+  std::vector<BookMatch> & matches)
+{
+  matches.clear();
+  if(book_text == "") return;
+  // Every test is on a prefix, so the books matching a longer name are
+  // among those matching the shorter one typed a keystroke earlier
+  std::vector<size_t> candidates;
+  if(last_book_text != "" && StartsWith(book_text, last_book_text))
+  {
+    for(const BookMatch & match : last_matches) candidates.push_back(match.Book);
+    stats.Incremental++;
+  }
+  else
+  {
+    for(size_t n = 0; n < books.size(); n++) candidates.push_back(n);
+  }
+  for(size_t n : candidates)
+  {
+    const Book & book = books[n];
+    int quality = 4;
+    for(size_t a = 0; a < book.Aliases.size(); a++)
+    {
+      const std::string & alias = book.Aliases[a];
+      if(alias == book_text) quality = 0;
+      else if(StartsWith(alias, book_text)) quality = std::min(quality, a == 0 ? 1 : 2);
+    }
+    // A later word of the name: "jo" in "1 john", "sol" in "song of solomon"
+    const std::string & name = book.Aliases[0];
+    for(size_t p = name.find(' '); quality > 3 && p != std::string::npos;
+      p = name.find(' ', p + 1))
+    {
+      if(name.compare(p + 1, book_text.size(), book_text) == 0) quality = 3;
+    }
+    if(quality < 4) matches.push_back(BookMatch{n, quality});
+  }
+  std::stable_sort(matches.begin(), matches.end(),
+    [this](const BookMatch & a, const BookMatch & b)
+    {
+      if(a.Quality != b.Quality) return a.Quality < b.Quality;
+      if(books[a.Book].Tier != books[b.Book].Tier)
+      {
+        return books[a.Book].Tier > books[b.Book].Tier;
+      }
+      return a.Book < b.Book;
+    });
+  last_book_text = book_text;
+  last_matches = matches;
+}
+
+bool ReferenceParser::FindBook(const std::string & book_text, size_t & book,
+  std::string & error)
+{
+  std::string normalized = NormalizeBookText(book_text);
+  std::vector<BookMatch> matches;
+  MatchBooks(normalized, matches);
+  if(matches.empty())
+  {
+    error = "Unknown book \"" + Trim(book_text) + "\"";
+    return false;
+  }
+  // An exact name or abbreviation, or the start of only one book's names
+  if(matches[0].Quality == 0 || matches.size() == 1 ||
+    (matches[0].Quality < matches[1].Quality && matches[0].Quality == 1))
+  {
+    book = matches[0].Book;
+    return true;
+  }
+  error = "\"" + Trim(book_text) + "\" could be ";
+  for(size_t n = 0; n < matches.size() && n < 4; n++)
+  {
+    if(n > 0) error += ", ";
+    error += books[matches[n].Book].Name;
+  }
+  if(matches.size() > 4) error += "...";
+  return false;
+}
+
+bool ReferenceParser::ParseNumbers(size_t book, const std::string & numbers,
+  std::vector<std::string> & keys, std::string & error)
+{
+  const Book & b = books[book];
+  std::string text;
+  for(char c : numbers)
+  {
+    if(c == '.') c = ':';
+    if(!std::isspace((unsigned char)c)) text += c;
+  }
+  auto check = [&](int chapter, int verse)
+  {
+    if(chapter < 1 || chapter > int(b.VerseMax.size()))
+    {
+      error = b.Name + " has " + std::to_string(b.VerseMax.size()) +
+        " chapters";
+      return false;
+    }
+    if(verse != 0 && (verse < 1 || verse > b.VerseMax[chapter - 1]))
+    {
+      error = b.Name + " " + std::to_string(chapter) + " has " +
+        std::to_string(b.VerseMax[chapter - 1]) + " verses";
+      return false;
+    }
+    return true;
+  };
+  // Books of one chapter are numbered by verse ("Jude 5")
+  bool verses_only = b.VerseMax.size() == 1;
+  int chapter = 0;
+  bool have_verse = false;
+  size_t pos = 0;
+  while(true)
+  {
+    int start_chapter = chapter, start_verse = 0, end_chapter = 0, end_verse = 0;
+    int value;
+    if(!ReadNumber(text, pos, value)) break;
+    if(pos < text.size() && text[pos] == ':')
+    {
+      pos++;
+      start_chapter = value;
+      if(!ReadNumber(text, pos, start_verse)) break;
+      have_verse = true;
+    }
+    else if(chapter == 0 && verses_only)
+    {
+      start_chapter = 1;
+      start_verse = value;
+      have_verse = true;
+    }
+    else if(have_verse) start_verse = value;
+    else start_chapter = value;
+    if(!check(start_chapter, start_verse)) return false;
+    chapter = start_chapter;
+
+    std::string key = b.Name + " " + std::to_string(start_chapter);
+    if(start_verse) key += ":" + std::to_string(start_verse);
+    if(pos < text.size() && text[pos] == '-')
+    {
+      pos++;
+      if(!ReadNumber(text, pos, value)) break;
+      if(pos < text.size() && text[pos] == ':')
+      {
+        pos++;
+        end_chapter = value;
+        if(!start_verse || !ReadNumber(text, pos, end_verse)) break;
+      }
+      else if(start_verse)
+      {
+        end_chapter = start_chapter;
+        end_verse = value;
+      }
+      else end_chapter = value;
+      if(!check(end_chapter, end_verse)) return false;
+      if(end_chapter < start_chapter ||
+        (end_chapter == start_chapter && end_verse <= start_verse))
+      {
+        error = "\"" + numbers + "\" ends before it starts";
+        return false;
+      }
+      key += "-";
+      if(end_chapter != start_chapter || !end_verse)
+      {
+        key += std::to_string(end_chapter);
+        if(end_verse) key += ":";
+      }
+      if(end_verse) key += std::to_string(end_verse);
+      chapter = end_chapter;
+    }
+    keys.push_back(key);
+    if(pos == text.size()) return true;
+    if(text[pos] != ',') break;
+    pos++;
+  }
+  error = "Cannot read \"" + Trim(numbers) + "\"";
+  return false;
+}
+
+ParsedReference ReferenceParser::Parse(const std::string & text)
+{
+  TRACE_SCOPE("refparser.Parse");
+  ParsedReference result;
+  std::vector<std::string> keys;
+  bool have_book = false;
+  size_t book = 0;
+  size_t p = 0;
+  while(p <= text.size())
+  {
+    size_t q = text.find(';', p);
+    if(q == std::string::npos) q = text.size();
+    std::string part = text.substr(p, q - p);
+    p = q + 1;
+    if(Trim(part) == "") continue;
+    std::string book_text, numbers;
+    SplitReference(part, book_text, numbers);
+    // Later references may leave out the book ("John 3:16; 4:1")
+    if(Trim(book_text) != "")
+    {
+      if(!FindBook(book_text, book, result.Error)) return result;
+      have_book = true;
+    }
+    else if(!have_book)
+    {
+      result.Error = "No book in \"" + Trim(part) + "\"";
+      return result;
+    }
+    if(Trim(numbers) == "") keys.push_back(books[book].Name + " 1");
+    else if(!ParseNumbers(book, numbers, keys, result.Error)) return result;
+  }
+  if(keys.empty())
+  {
+    result.Error = "No reference";
+    return result;
+  }
+  for(size_t n = 0; n < keys.size(); n++)
+  {
+    if(n > 0) result.Key += "; ";
+    result.Key += keys[n];
+  }
+  result.Valid = true;
+  return result;
+}
+
+std::vector<std::string> ReferenceParser::Suggest(const std::string & text,
+  size_t max_suggestions)
+{
+  TRACE_SCOPE("refparser.Suggest");
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + latency_budget;
+  stats.Suggestions++;
+  std::vector<std::string> suggestions;
+  // Only the last reference is completed; the text before it is kept
+  size_t last = text.rfind(';');
+  std::string head = (last == std::string::npos) ? "" :
+    text.substr(0, last + 1) + " ";
+  std::string tail = (last == std::string::npos) ? text : text.substr(last + 1);
+  std::string book_text, numbers;
+  SplitReference(tail, book_text, numbers);
+  if(Trim(book_text) == "") return suggestions;
+
+  if(Trim(numbers) == "")
+  {
+    // Books, best first
+    std::vector<BookMatch> matches;
+    MatchBooks(NormalizeBookText(book_text), matches);
+    for(size_t n = 0; n < matches.size() && suggestions.size() < max_suggestions;
+      n++)
+    {
+      suggestions.push_back(head + books[matches[n].Book].Name);
+    }
+    if(std::chrono::steady_clock::now() > deadline) stats.OverBudget++;
+    return suggestions;
+  }
+
+  // Chapters, or verses after "chapter:", that start with the digits typed
+  // so far (ranges and lists are not completed)
+  size_t book;
+  std::string error;
+  if(!FindBook(book_text, book, error)) return suggestions;
+  const Book & b = books[book];
+  std::string typed = Trim(numbers);
+  std::string digits = typed;
+  std::string prefix = head + Trim(book_text) + " ";
+  int limit = b.VerseMax.size();
+  size_t colon = typed.find_first_of(":.");
+  if(colon != std::string::npos)
+  {
+    int chapter = 0;
+    size_t pos = 0;
+    if(!ReadNumber(typed, pos, chapter) || pos != colon ||
+      chapter < 1 || chapter > int(b.VerseMax.size()))
+    {
+      return suggestions;
+    }
+    limit = b.VerseMax[chapter - 1];
+    prefix += typed.substr(0, colon + 1);
+    digits = typed.substr(colon + 1);
+  }
+  else if(b.VerseMax.size() == 1) limit = b.VerseMax[0];
+  if(digits.find_first_not_of("0123456789") != std::string::npos)
+  {
+    return suggestions;
+  }
+  for(int n = 1; n <= limit && suggestions.size() < max_suggestions; n++)
+  {
+    if((n & 31) == 0 && std::chrono::steady_clock::now() > deadline)
+    {
+      stats.OverBudget++;
+      break;
+    }
+    std::string number = std::to_string(n);
+    if(StartsWith(number, digits)) suggestions.push_back(prefix + number);
+  }
+  return suggestions;
+}
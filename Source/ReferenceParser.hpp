@@ -0,0 +1,90 @@
+// Machaira: ReferenceParser.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file parses typed verse references against the book names and
+// abbreviations of a versification, into the canonical keys the backend
+// is given, and completes partial references as they are typed
+// Current version: Pre-release
+
+#ifndef REFERENCEPARSER_HPP
+#define REFERENCEPARSER_HPP
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+struct ParsedReference
+{
+  // Canonical key ("1 John 3:16-18; Psalms 23"), or the reason the text
+  // could not be parsed
+  bool Valid = false;
+  std::string Key;
+  std::string Error;
+};
+
+struct ReferenceParserStats
+{
+  unsigned long Suggestions = 0;
+  // Keystrokes answered from the previous keystroke's book matches
+  unsigned long Incremental = 0;
+  // Suggestions cut short by the latency budget
+  unsigned long OverBudget = 0;
+};
+
+class ReferenceParser
+{
+  public:
+    // Books (and their chapter and verse counts) of a SWORD versification;
+    // unknown names fall back to KJV
+    ReferenceParser(std::string versification = "KJV");
+    std::string GetVersification(){ return versification; }
+    // Book names are matched without regard to case, spaces or a trailing
+    // '.', numbered books as "1 John", "1Jn", "I John" or "First John";
+    // several references are separated by ';' and verses of one chapter by
+    // ','; chapters and verses are checked against the versification
+    ParsedReference Parse(const std::string & text);
+    // Completions of the last reference in text, best first: books
+    // ("Jo" gives John, Joshua, Job...), then chapters and verses once the
+    // book is known; stops when the latency budget is spent
+    std::vector<std::string> Suggest(const std::string & text,
+      size_t max_suggestions = 10);
+    // Get/Set
+    void SetLatencyBudget(std::chrono::microseconds budget){ latency_budget = budget; }
+    ReferenceParserStats GetStats(){ return stats; }
+  private:
+    struct Book
+    {
+      std::string Name;
+      // Normalized name and abbreviations
+      std::vector<std::string> Aliases;
+      int Tier;
+      std::vector<int> VerseMax;
+    };
+    struct BookMatch
+    {
+      size_t Book;
+      // 0 exact, 1 start of the name, 2 start of an abbreviation, 3 start of
+      // a later word of the name ("jo" in "1 john")
+      int Quality;
+    };
+    // Lower case, single spaces, no dots, numbered books as "1 name"
+    static std::string NormalizeBookText(const std::string & text);
+    // Splits a reference into its book text and the chapter and verse text
+    static void SplitReference(const std::string & text, std::string & book,
+      std::string & numbers);
+    void MatchBooks(const std::string & book_text,
+      std::vector<BookMatch> & matches);
+    bool FindBook(const std::string & book_text, size_t & book,
+      std::string & error);
+    bool ParseNumbers(size_t book, const std::string & numbers,
+      std::vector<std::string> & keys, std::string & error);
+    std::string versification;
+    std::vector<Book> books;
+    // Book matches of the previous keystroke, narrowed as the book name
+    // grows
+    std::string last_book_text;
+    std::vector<BookMatch> last_matches;
+    std::chrono::microseconds latency_budget;
+    ReferenceParserStats stats;
+};
+
+#endif
@@ -0,0 +1,85 @@
+// Machaira: RenderCache.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a memory-bounded LRU cache of rendered passages, so that
+// repeat navigation does not have to go back through SWORD
+// Current version: Pre-release
+
+#include "RenderCache.hpp"
+
+RenderCache::RenderCache(size_t max_bytes) :
+  max_bytes(max_bytes), current_bytes(0)
+{
+}
+
+bool RenderCache::Get(const std::string & key, std::string & text)
+{
+  auto it = lookup.find(key);
+  if(it == lookup.end())
+  {
+    stats.Misses++;
+    return false;
+  }
+  // Move entry to the front of the list (most recently used)
+  entries.splice(entries.begin(), entries, it->second);
+  text = it->second->Text;
+  stats.Hits++;
+  return true;
+}
+
+void RenderCache::Put(const std::string & key, const std::string & text)
+{
+  size_t bytes = EntryBytes(key, text);
+  auto it = lookup.find(key);
+  if(it != lookup.end())
+  {
+    current_bytes -= EntryBytes(it->second->Key, it->second->Text);
+    entries.erase(it->second);
+    lookup.erase(it);
+  }
+  // Entries larger than the whole budget are never cached
+  if(bytes > max_bytes) return;
+
+  entries.push_front(Entry{key, text});
+  lookup[key] = entries.begin();
+  current_bytes += bytes;
+  EvictToFit();
+}
+
+void RenderCache::Clear()
+{
+  entries.clear();
+  lookup.clear();
+  current_bytes = 0;
+}
+
+void RenderCache::SetMaxBytes(size_t max_bytes)
+{
+  this->max_bytes = max_bytes;
+  EvictToFit();
+}
+
+RenderCacheStats RenderCache::GetStats()
+{
+  stats.Entries = entries.size();
+  stats.Bytes = current_bytes;
+  stats.MaxBytes = max_bytes;
+  return stats;
+}
+
+size_t RenderCache::EntryBytes(const std::string & key, const std::string & text)
+{
+  // Key is stored twice (list entry and lookup table), plus bookkeeping
+  return 2*key.size() + text.size() + sizeof(Entry) + 64;
+}
+
+void RenderCache::EvictToFit()
+{
+  while(current_bytes > max_bytes && !entries.empty())
+  {
+    Entry & oldest = entries.back();
+    current_bytes -= EntryBytes(oldest.Key, oldest.Text);
+    lookup.erase(oldest.Key);
+    entries.pop_back();
+    stats.Evictions++;
+  }
+}
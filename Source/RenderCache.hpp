@@ -0,0 +1,53 @@
+// Machaira: RenderCache.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a memory-bounded LRU cache of rendered passages, so that
+// repeat navigation does not have to go back through SWORD
+// Current version: Pre-release
+
+#ifndef RENDERCACHE_HPP
+#define RENDERCACHE_HPP
+
+#include <string>
+#include <list>
+#include <unordered_map>
+
+struct RenderCacheStats
+{
+  unsigned long Hits = 0;
+  unsigned long Misses = 0;
+  unsigned long Evictions = 0;
+  size_t Entries = 0;
+  size_t Bytes = 0;
+  size_t MaxBytes = 0;
+};
+
+class RenderCache
+{
+  public:
+    // Constructor
+    RenderCache(size_t max_bytes = 16*1024*1024);
+    // Cache Access
+    bool Get(const std::string & key, std::string & text);
+    void Put(const std::string & key, const std::string & text);
+    void Clear();
+    // Get/Set
+    void SetMaxBytes(size_t max_bytes);
+    size_t GetMaxBytes(){ return max_bytes; }
+    RenderCacheStats GetStats();
+  private:
+    struct Entry
+    {
+      std::string Key;
+      std::string Text;
+    };
+    size_t EntryBytes(const std::string & key, const std::string & text);
+    void EvictToFit();
+    // Most recently used entries are at the front of the list
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> lookup;
+    size_t max_bytes;
+    size_t current_bytes;
+    RenderCacheStats stats;
+};
+
+#endif
@@ -0,0 +1,455 @@
+// Machaira: RenderMain.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the machaira-render program, which batch-renders whole books
+// or Bibles from the local library to HTML or JSON without the UI, or
+// exports whole modules as one HTML file per chapter
+// Current version: Pre-release
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <cstdio>
+
+#include <swmodule.h>
+#include <versekey.h>
+
+#include "SwordReader.hpp"
+#include "SearchIndex.hpp"
+#include "VerseStore.hpp"
+#include "ModuleExporter.hpp"
+
+struct BookRef
+{
+  std::string OSIS;
+  std::string Name;
+  int Testament;
+};
+
+struct RenderTask
+{
+  std::string Module;
+  BookRef Book;
+  int BookNumber;
+};
+
+struct RenderOptions
+{
+  std::string LibraryDir = "./Res/.sword";
+  std::vector<std::string> Modules;
+  std::string Range = "Bible";
+  std::string Format = "html";
+  std::string Output = "-";
+  int Jobs = 0;
+  bool Store = false;
+  bool Export = false;
+};
+
+// Every book of the default (KJV) versification, in canonical order
+std::vector<BookRef> ListBooks()
+{
+  std::vector<BookRef> books;
+  sword::VerseKey vk;
+  for(char t = 1; t <= 2; t++)
+  {
+    vk.setTestament(t);
+    for(char b = 1; b <= vk.getBookMax(); b++)
+    {
+      vk.setBook(b);
+      books.push_back(BookRef{vk.getOSISBookName(), vk.getBookName(), t});
+    }
+  }
+  return books;
+}
+
+std::string LowerCase(std::string s)
+{
+  for(char & c : s) c = tolower(static_cast<unsigned char>(c));
+  return s;
+}
+
+int FindBook(std::string name, const std::vector<BookRef> & books)
+{
+  std::string lower = LowerCase(name);
+  for(size_t n = 0; n < books.size(); n++)
+  {
+    if(LowerCase(books[n].OSIS) == lower || LowerCase(books[n].Name) == lower)
+    {
+      return n;
+    }
+  }
+  // Fall back to SWORD's abbreviation parser ("Jn", "1 Cor", ...)
+  sword::VerseKey vk;
+  vk.setText((name + " 1:1").c_str());
+  if(vk.popError()) return -1;
+  std::string osis(vk.getOSISBookName());
+  for(size_t n = 0; n < books.size(); n++)
+  {
+    if(books[n].OSIS == osis) return n;
+  }
+  return -1;
+}
+
+// Range is a comma-separated list of "Bible", "OT", "NT", a book, or a
+// span of books ("Gen-Deut")
+bool ParseRange(std::string range, const std::vector<BookRef> & books,
+  std::vector<int> & selected)
+{
+  std::stringstream ss(range);
+  std::string item;
+  while(std::getline(ss, item, ','))
+  {
+    std::string lower = LowerCase(item);
+    int first = -1, last = -1;
+    if(lower == "bible" || lower == "all") { first = 0; last = books.size()-1; }
+    else if(lower == "ot" || lower == "nt")
+    {
+      int t = (lower == "ot") ? 1 : 2;
+      for(size_t n = 0; n < books.size(); n++)
+      {
+        if(books[n].Testament != t) continue;
+        if(first < 0) first = n;
+        last = n;
+      }
+    }
+    else
+    {
+      size_t dash = item.find('-', 1);
+      first = FindBook(item.substr(0, dash), books);
+      last = (dash == std::string::npos) ? first :
+        FindBook(item.substr(dash+1), books);
+    }
+    if(first < 0 || last < first)
+    {
+      std::cerr << "Error: Couldn't parse book range \"" << item << "\"\n";
+      return false;
+    }
+    for(int n = first; n <= last; n++) selected.push_back(n);
+  }
+  return selected.size() > 0;
+}
+
+void AppendJSONString(std::string & out, const std::string & s)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+  out += '"';
+  for(char c : s)
+  {
+    switch(c)
+    {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if(static_cast<unsigned char>(c) < 0x20)
+        {
+          out += "\\u00";
+          out += hex_digits[(c >> 4) & 0xf];
+          out += hex_digits[c & 0xf];
+        }
+        else out += c;
+    }
+  }
+  out += '"';
+}
+
+// Output for one task; flushed to its destination whenever the buffer
+// grows past a fixed size. Tasks sharing stdout only flush while they are
+// at the head of the output order, and otherwise hold their book in memory
+class TaskWriter
+{
+  public:
+    TaskWriter(std::FILE * file, const std::atomic<size_t> * head = 0,
+      size_t id = 0) : file(file), head(head), id(id)
+    {
+      buffer.reserve(flush_size);
+    }
+    std::string & Buffer(){ return buffer; }
+    void MaybeFlush()
+    {
+      if(buffer.size() >= flush_size && (!head || *head == id)) Flush();
+    }
+    void Flush()
+    {
+      std::fwrite(buffer.data(), 1, buffer.size(), file);
+      buffer.clear();
+    }
+  private:
+    static const size_t flush_size = 1 << 16;
+    std::FILE * file;
+    const std::atomic<size_t> * head;
+    size_t id;
+    std::string buffer;
+};
+
+// Render every verse of one book of one module; returns the verse count
+long RenderBook(SwordReader & reader, const RenderTask & task,
+  const RenderOptions & options, TaskWriter & writer)
+{
+  sword::SWModule * module = reader.GetModule(task.Module);
+  std::unique_ptr<sword::SWKey> key(module->createKey());
+  sword::VerseKey * vk = dynamic_cast<sword::VerseKey *>(key.get());
+  if(!vk) return 0;
+  vk->setText((task.Book.OSIS + " 1:1").c_str());
+  // Module versification may not contain this book
+  if(vk->popError() || task.Book.OSIS != vk->getOSISBookName()) return 0;
+
+  bool json = (options.Format == "json");
+  std::string html;
+  long verses = 0;
+  if(!json)
+  {
+    writer.Buffer() += "<div class=\"book\" id=\"" + task.Book.OSIS +
+      "\" data-module=\"" + task.Module + "\">\n<h1>" + task.Book.Name +
+      "</h1>\n";
+  }
+  while(!vk->popError() && task.Book.OSIS == vk->getOSISBookName())
+  {
+    module->setKey(*vk);
+    reader.RenderCurrentEntry(module, html);
+    std::string & out = writer.Buffer();
+    if(json)
+    {
+      out += "{\"module\":"; AppendJSONString(out, task.Module);
+      out += ",\"key\":"; AppendJSONString(out, vk->getText());
+      out += ",\"osis\":"; AppendJSONString(out, vk->getOSISRef());
+      out += ",\"html\":"; AppendJSONString(out, html);
+      out += "}\n";
+    }
+    else
+    {
+      out += "<div class=\"verse\" id=\"";
+      out += vk->getOSISRef();
+      out += "\"><span class=\"ref\">";
+      out += vk->getText();
+      out += "</span> ";
+      out += html;
+      out += "</div>\n";
+    }
+    writer.MaybeFlush();
+    verses++;
+    vk->increment();
+  }
+  if(!json) writer.Buffer() += "</div>\n";
+  return verses;
+}
+
+void PrintUsage()
+{
+  std::cerr << "Usage: machaira-render --modules MOD[,MOD...] [options]\n"
+    "  --library DIR    SWORD library directory (default ./Res/.sword)\n"
+    "  --range RANGE    Bible, OT, NT, a book or books, e.g. Gen-Deut,John\n"
+    "  --format FMT     html (default) or json (one object per verse)\n"
+    "  --output DEST    - for stdout (default) or a directory, one file\n"
+    "                   per module and book\n"
+    "  --jobs N         worker threads (default: hardware threads)\n"
+    "  --store          write the modules' pre-rendered verse stores to the\n"
+    "                   library instead of rendering\n"
+    "  --export         write one HTML file per chapter, and a contents page,\n"
+    "                   for each module to the --output directory; books\n"
+    "                   already exported are skipped (every Bible and\n"
+    "                   commentary when --modules is not given)\n";
+}
+
+int main(int argc, char ** argv)
+{
+  RenderOptions options;
+  for(int n = 1; n < argc; n++)
+  {
+    std::string arg(argv[n]);
+    if(arg == "--library" && n+1 < argc) options.LibraryDir = argv[++n];
+    else if(arg == "--range" && n+1 < argc) options.Range = argv[++n];
+    else if(arg == "--format" && n+1 < argc) options.Format = argv[++n];
+    else if(arg == "--output" && n+1 < argc) options.Output = argv[++n];
+    else if(arg == "--jobs" && n+1 < argc) options.Jobs = std::stoi(argv[++n]);
+    else if(arg == "--store") options.Store = true;
+    else if(arg == "--export") options.Export = true;
+    else if(arg == "--modules" && n+1 < argc)
+    {
+      std::stringstream ss(argv[++n]);
+      std::string mod;
+      while(std::getline(ss, mod, ',')) if(mod != "") options.Modules.push_back(mod);
+    }
+    else
+    {
+      PrintUsage();
+      return 1;
+    }
+  }
+  if((options.Modules.empty() && !options.Export) ||
+    (options.Export && options.Output == "-") ||
+    (options.Format != "html" && options.Format != "json"))
+  {
+    PrintUsage();
+    return 1;
+  }
+  if(options.Jobs <= 0) options.Jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  // Rendered text owns stdout; SWORD and backend messages go to stderr
+  std::cout.rdbuf(std::cerr.rdbuf());
+  bool to_stdout = (options.Output == "-");
+
+  std::vector<BookRef> books = ListBooks();
+  std::vector<int> selected;
+  if(!ParseRange(options.Range, books, selected)) return 1;
+
+  if(options.Export)
+  {
+    // Reader, render and writer stages with their own SWORD managers;
+    // a range other than the whole Bible selects books by OSIS name
+    ExportOptions export_options;
+    export_options.Modules = options.Modules;
+    export_options.OutputDir = options.Output;
+    export_options.Jobs = options.Jobs;
+    std::string range = LowerCase(options.Range);
+    if(range != "bible" && range != "all")
+    {
+      for(int b : selected) export_options.Books.push_back(books[b].OSIS);
+    }
+    if(export_options.Modules.empty())
+    {
+      SwordReader lister(options.LibraryDir);
+      export_options.Modules = lister.GetModules("Biblical Texts");
+      std::vector<std::string> commentaries = lister.GetModules("Commentaries");
+      export_options.Modules.insert(export_options.Modules.end(),
+        commentaries.begin(), commentaries.end());
+    }
+    ModuleExporter exporter(options.LibraryDir, export_options);
+    ExportStats stats;
+    bool ok = exporter.Run(stats,
+      [](const std::string & mod_name, const std::string & book,
+        const ExportStats & progress)
+      {
+        std::cerr << "Exported " << mod_name << ' ' << book << " ("
+          << progress.VersesPerSecond() << " verses/s)\n";
+      });
+    std::cerr << "Exported " << stats.Verses << " verses in " << stats.Chapters
+      << " chapters from " << stats.Books << " books of " << stats.Modules
+      << " modules in " << stats.Seconds << " s (" << stats.VersesPerSecond()
+      << " verses/s, " << options.Jobs << " render workers, at most "
+      << stats.PeakChapters << " chapters in memory";
+    if(stats.BooksSkipped) std::cerr << ", " << stats.BooksSkipped
+      << " books already exported";
+    std::cerr << ")\n";
+    return ok ? 0 : 1;
+  }
+
+  // One reader (and SWORD manager) per worker, created up front because
+  // SWORD's global managers are not safe to initialize concurrently
+  std::vector<std::unique_ptr<SwordReader>> readers;
+  for(int n = 0; n < options.Jobs; n++)
+  {
+    readers.emplace_back(new SwordReader(options.LibraryDir));
+  }
+  std::vector<RenderTask> tasks;
+  for(const std::string & mod : options.Modules)
+  {
+    if(!readers[0]->GetModule(mod))
+    {
+      std::cerr << "Error: Couldn't find module " << mod << " in "
+        << options.LibraryDir << '\n';
+      return 1;
+    }
+    for(int b : selected) tasks.push_back(RenderTask{mod, books[b], b+1});
+  }
+
+  if(options.Store)
+  {
+    // One store per module, built by whichever worker is free
+    std::atomic<size_t> next_module(0);
+    std::atomic<int> failures(0);
+    auto builder = [&](SwordReader * reader)
+    {
+      size_t m;
+      while((m = next_module++) < options.Modules.size())
+      {
+        const std::string & mod = options.Modules[m];
+        sword::SWModule * module = reader->GetModule(mod);
+        std::string file_name = VerseStoreFile(options.LibraryDir, mod);
+        if(BuildVerseStore(module, ModuleIndexStamp(options.LibraryDir, module),
+          file_name))
+        {
+          std::cerr << "Wrote " << file_name << '\n';
+        }
+        else
+        {
+          std::cerr << "Error: Couldn't write a verse store for " << mod << '\n';
+          failures++;
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for(int n = 0; n < options.Jobs; n++) threads.emplace_back(builder, readers[n].get());
+    for(std::thread & t : threads) t.join();
+    return failures ? 1 : 0;
+  }
+
+  std::atomic<size_t> next_task(0);
+  std::atomic<long> total_verses(0);
+  // Ordered stdout: a finished task waits until all earlier ones are written
+  std::mutex write_mutex;
+  std::condition_variable write_cv;
+  std::atomic<size_t> next_to_write(0);
+
+  auto worker = [&](SwordReader * reader)
+  {
+    size_t t;
+    while((t = next_task++) < tasks.size())
+    {
+      const RenderTask & task = tasks[t];
+      if(to_stdout)
+      {
+        TaskWriter writer(stdout, &next_to_write, t);
+        total_verses += RenderBook(*reader, task, options, writer);
+        std::unique_lock<std::mutex> lock(write_mutex);
+        write_cv.wait(lock, [&]{ return next_to_write == t; });
+        writer.Flush();
+        next_to_write++;
+        write_cv.notify_all();
+      }
+      else
+      {
+        std::filesystem::path dir = std::filesystem::path(options.Output) / task.Module;
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        char file_name[64];
+        std::snprintf(file_name, sizeof(file_name), "%02d-%s.%s", task.BookNumber,
+          task.Book.OSIS.c_str(), options.Format == "json" ? "jsonl" : "html");
+        std::FILE * file = std::fopen((dir / file_name).string().c_str(), "wb");
+        if(!file)
+        {
+          std::cerr << "Error: Couldn't write " << (dir / file_name) << '\n';
+          continue;
+        }
+        TaskWriter writer(file);
+        total_verses += RenderBook(*reader, task, options, writer);
+        writer.Flush();
+        std::fclose(file);
+      }
+    }
+  };
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for(int n = 0; n < options.Jobs; n++) threads.emplace_back(worker, readers[n].get());
+  for(std::thread & t : threads) t.join();
+  std::fflush(stdout);
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - t0).count();
+
+  std::cerr << "Rendered " << total_verses << " entries from " << tasks.size()
+    << " module books in " << seconds << " s ("
+    << (seconds > 0.0 ? total_verses/seconds : 0.0) << " entries/s, "
+    << options.Jobs << " workers)\n";
+  return 0;
+}
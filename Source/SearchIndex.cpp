@@ -0,0 +1,1042 @@
+// Machaira: SearchIndex.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the full-text search index: one memory-mapped inverted index
+// file per installed module, with positional postings for word, phrase and
+// boolean queries, built alongside the Strong's concordances and
+// cross-reference graphs
+// Current version: Pre-release
+
+#include "SearchIndex.hpp"
+#include "SwordReader.hpp"
+#include "Varint.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cctype>
+
+#include <swoptfilter.h>
+
+// Index file layout (host byte order; the magic and version reject foreign
+// or older files, which are then rebuilt):
+//   IndexHeader, stamp text, padding to 8 bytes
+//   TermEntry[term_count] sorted by term text, then the term text
+//   postings: per entry, varint(entry delta), varint(count), count varint
+//     position deltas
+//   uint32 key offsets[entry_count+1], then the key text
+struct IndexHeader
+{
+  char Magic[4];
+  uint32_t Version;
+  uint32_t EntryCount;
+  uint32_t TermCount;
+  uint32_t StampLength;
+  uint32_t Reserved;
+  uint64_t StampOffset;
+  uint64_t TermsOffset;
+  uint64_t TermTextOffset;
+  uint64_t PostingsOffset;
+  uint64_t KeysOffset;
+  uint64_t KeyTextOffset;
+  uint64_t FileSize;
+};
+
+struct IndexTermEntry
+{
+  uint32_t TextOffset;
+  uint32_t TextLength;
+  uint64_t PostingsOffset;
+  uint32_t PostingsLength;
+  uint32_t EntryCount;
+};
+
+static const char index_magic[4] = {'M', 'X', 'I', 'X'};
+static const uint32_t index_version = 1;
+
+void TokenizeSearchText(const char * text,
+  std::function<void(const std::string &, uint32_t)> on_term)
+{
+  // Terms are runs of ASCII letters and digits (lowercased) and non-ASCII
+  // UTF-8 characters, except General Punctuation (U+2000-U+206F: curly
+  // quotes, dashes), which separates terms like ASCII punctuation does
+  std::string term;
+  uint32_t position = 0;
+  const unsigned char * c = reinterpret_cast<const unsigned char *>(text);
+  while(true)
+  {
+    bool in_term = false;
+    int length = 1;
+    if(*c >= 'A' && *c <= 'Z')
+    {
+      term += char(*c - 'A' + 'a');
+      in_term = true;
+    }
+    else if((*c >= 'a' && *c <= 'z') || (*c >= '0' && *c <= '9'))
+    {
+      term += char(*c);
+      in_term = true;
+    }
+    else if(*c >= 0x80)
+    {
+      if(*c == 0xe2 && (c[1] == 0x80 || c[1] == 0x81) && c[2]) length = 3;
+      else
+      {
+        term += char(*c);
+        in_term = true;
+      }
+    }
+    if(!in_term && !term.empty())
+    {
+      on_term(term, position++);
+      term.clear();
+    }
+    if(*c == 0) break;
+    c += length;
+  }
+}
+
+ModuleIndex::ModuleIndex() :
+  entry_count(0), term_count(0), terms(0), term_text(0), postings(0), keys(0),
+  key_text(0), stamp(0), stamp_length(0)
+{
+}
+
+bool ModuleIndex::Open(std::string file_name)
+{
+  if(!file.Open(file_name)) return false;
+  if(file.Size() < sizeof(IndexHeader))
+  {
+    file.Close();
+    return false;
+  }
+  const IndexHeader * header =
+    reinterpret_cast<const IndexHeader *>(file.Data());
+  // A file cut short (e.g. by a crash while copying) is treated as missing
+  if(std::memcmp(header->Magic, index_magic, 4) != 0 ||
+    header->Version != index_version || header->FileSize != file.Size() ||
+    header->KeyTextOffset > file.Size() ||
+    header->KeysOffset + 4*(uint64_t(header->EntryCount)+1) > file.Size() ||
+    header->TermsOffset + sizeof(IndexTermEntry)*uint64_t(header->TermCount) >
+      file.Size())
+  {
+    file.Close();
+    return false;
+  }
+  entry_count = header->EntryCount;
+  term_count = header->TermCount;
+  stamp = file.Data() + header->StampOffset;
+  stamp_length = header->StampLength;
+  terms = reinterpret_cast<const IndexTermEntry *>(file.Data() + header->TermsOffset);
+  term_text = file.Data() + header->TermTextOffset;
+  postings = file.Data() + header->PostingsOffset;
+  keys = reinterpret_cast<const uint32_t *>(file.Data() + header->KeysOffset);
+  key_text = file.Data() + header->KeyTextOffset;
+  return true;
+}
+
+std::string ModuleIndex::GetStamp()
+{
+  if(!stamp) return "";
+  return std::string(stamp, stamp_length);
+}
+
+std::string ModuleIndex::GetEntryKey(uint32_t entry)
+{
+  if(entry >= entry_count) return "";
+  return std::string(key_text + keys[entry], keys[entry+1] - keys[entry]);
+}
+
+const IndexTermEntry * ModuleIndex::FindTerm(const std::string & term)
+{
+  // Binary search of the sorted term table
+  uint32_t low = 0;
+  uint32_t high = term_count;
+  while(low < high)
+  {
+    uint32_t middle = low + (high - low)/2;
+    const IndexTermEntry & entry = terms[middle];
+    int order = term.compare(0, std::string::npos, term_text + entry.TextOffset,
+      entry.TextLength);
+    if(order == 0) return &entry;
+    if(order < 0) high = middle;
+    else low = middle + 1;
+  }
+  return 0;
+}
+
+bool ModuleIndex::GetPostings(const std::string & term,
+  std::vector<uint32_t> & entries, std::vector<std::vector<uint32_t>> * positions)
+{
+  entries.clear();
+  if(positions) positions->clear();
+  const IndexTermEntry * found = FindTerm(term);
+  if(!found) return false;
+  entries.reserve(found->EntryCount);
+  if(positions) positions->resize(found->EntryCount);
+  const unsigned char * in =
+    reinterpret_cast<const unsigned char *>(postings + found->PostingsOffset);
+  uint32_t entry = 0;
+  for(uint32_t n = 0; n < found->EntryCount; n++)
+  {
+    entry += ReadVarint(in);
+    entries.push_back(entry);
+    uint32_t count = ReadVarint(in);
+    uint32_t position = 0;
+    for(uint32_t p = 0; p < count; p++)
+    {
+      position += ReadVarint(in);
+      if(positions) (*positions)[n].push_back(position);
+    }
+  }
+  return true;
+}
+
+bool BuildModuleIndex(sword::SWModule * module, std::string stamp,
+  std::string file_name)
+{
+  // Index the plain text only: Strong's numbers, notes and the like off
+  for(sword::OptionFilterList::const_iterator it =
+    module->getOptionFilters().begin();
+    it != module->getOptionFilters().end(); ++it)
+  {
+    (*it)->setOptionValue("Off");
+  }
+
+  struct TermBuild
+  {
+    std::string Postings;
+    uint32_t LastEntry = 0;
+    uint32_t EntryCount = 0;
+  };
+  std::unordered_map<std::string, uint32_t> term_ids;
+  std::vector<std::string> term_texts;
+  std::vector<TermBuild> term_builds;
+  std::vector<uint32_t> key_offsets;
+  std::string key_texts;
+  // (term id, position) pairs of the current entry
+  std::vector<std::pair<uint32_t, uint32_t>> entry_terms;
+
+  uint32_t entry = 0;
+  module->setPosition(TOP);
+  for(; !module->popError(); module->increment(1))
+  {
+    entry_terms.clear();
+    TokenizeSearchText(module->stripText(),
+      [&](const std::string & term, uint32_t position)
+      {
+        auto found = term_ids.find(term);
+        uint32_t id;
+        if(found == term_ids.end())
+        {
+          id = term_texts.size();
+          term_ids.emplace(term, id);
+          term_texts.push_back(term);
+          term_builds.emplace_back();
+        }
+        else id = found->second;
+        entry_terms.push_back(std::make_pair(id, position));
+      });
+    // Empty entries are not given an entry number
+    if(entry_terms.empty()) continue;
+    std::sort(entry_terms.begin(), entry_terms.end());
+    for(size_t n = 0; n < entry_terms.size();)
+    {
+      size_t end = n;
+      while(end < entry_terms.size() && entry_terms[end].first == entry_terms[n].first)
+      {
+        end++;
+      }
+      TermBuild & build = term_builds[entry_terms[n].first];
+      WriteVarint(build.Postings, entry - build.LastEntry);
+      WriteVarint(build.Postings, end - n);
+      uint32_t last_position = 0;
+      for(size_t p = n; p < end; p++)
+      {
+        WriteVarint(build.Postings, entry_terms[p].second - last_position);
+        last_position = entry_terms[p].second;
+      }
+      build.LastEntry = entry;
+      build.EntryCount++;
+      n = end;
+    }
+    key_offsets.push_back(key_texts.size());
+    key_texts += module->getKeyText();
+    entry++;
+  }
+  key_offsets.push_back(key_texts.size());
+
+  // Lay the file out in memory, then write it in one go
+  std::vector<uint32_t> order(term_texts.size());
+  for(uint32_t n = 0; n < order.size(); n++) order[n] = n;
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+  {
+    return term_texts[a] < term_texts[b];
+  });
+  auto pad = [](std::string & out)
+  {
+    while(out.size() % 8) out += '\0';
+  };
+  IndexHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, index_magic, 4);
+  header.Version = index_version;
+  header.EntryCount = entry;
+  header.TermCount = order.size();
+  header.StampLength = stamp.size();
+
+  std::string body(sizeof(IndexHeader), '\0');
+  header.StampOffset = body.size();
+  body += stamp;
+  pad(body);
+  header.TermsOffset = body.size();
+  body.append(sizeof(IndexTermEntry)*order.size(), '\0');
+  header.TermTextOffset = body.size();
+  std::string term_block;
+  std::string postings_block;
+  for(uint32_t n = 0; n < order.size(); n++)
+  {
+    const std::string & text = term_texts[order[n]];
+    const TermBuild & build = term_builds[order[n]];
+    IndexTermEntry term;
+    term.TextOffset = term_block.size();
+    term.TextLength = text.size();
+    term.PostingsOffset = postings_block.size();
+    term.PostingsLength = build.Postings.size();
+    term.EntryCount = build.EntryCount;
+    std::memcpy(&body[header.TermsOffset + n*sizeof(IndexTermEntry)], &term,
+      sizeof(term));
+    term_block += text;
+    postings_block += build.Postings;
+  }
+  body += term_block;
+  header.PostingsOffset = body.size();
+  body += postings_block;
+  pad(body);
+  header.KeysOffset = body.size();
+  body.append(reinterpret_cast<const char *>(key_offsets.data()),
+    4*key_offsets.size());
+  header.KeyTextOffset = body.size();
+  body += key_texts;
+  header.FileSize = body.size();
+  std::memcpy(&body[0], &header, sizeof(header));
+
+  return ReplaceFileContents(file_name, body);
+}
+
+std::string ModuleIndexStamp(std::string library_dir, sword::SWModule * module)
+{
+  std::stringstream stamp;
+  const char * version = module->getConfigEntry("Version");
+  stamp << "Version=" << (version ? version : "") << ';';
+  const char * data_path = module->getConfigEntry("DataPath");
+  if(data_path)
+  {
+    std::string path(data_path);
+    if(path.compare(0, 2, "./") == 0) path = path.substr(2);
+    std::filesystem::path data_dir = std::filesystem::path(library_dir) / path;
+    std::error_code error;
+    // Lexicons give a file prefix rather than a directory
+    if(!std::filesystem::is_directory(data_dir, error))
+    {
+      data_dir = data_dir.parent_path();
+    }
+    uintmax_t bytes = 0;
+    long long newest = 0;
+    for(std::filesystem::directory_iterator it(data_dir, error), end;
+      !error && it != end; it.increment(error))
+    {
+      if(!it->is_regular_file(error)) continue;
+      bytes += it->file_size(error);
+      newest = std::max<long long>(newest,
+        it->last_write_time(error).time_since_epoch().count());
+    }
+    stamp << "Bytes=" << bytes << ";Modified=" << newest << ';';
+  }
+  return stamp.str();
+}
+
+// Query syntax tree; single words are one-term phrases
+struct QueryNode
+{
+  enum NodeType { Phrase, And, Or, Not };
+  NodeType Type;
+  std::vector<std::string> Terms;
+  std::vector<std::unique_ptr<QueryNode>> Children;
+};
+
+class QueryParser
+{
+  public:
+    QueryParser(const std::string & query) : query(query), pos(0) {}
+    std::unique_ptr<QueryNode> Parse(std::string & error);
+  private:
+    enum TokenType { Word, Quoted, Open, Close, OpAnd, OpOr, OpNot, End };
+    TokenType Peek(std::string * text = 0);
+    void Next(){ Peek(); pos = token_end; }
+    std::unique_ptr<QueryNode> ParseOr(std::string & error);
+    std::unique_ptr<QueryNode> ParseAnd(std::string & error);
+    std::unique_ptr<QueryNode> ParseUnary(std::string & error);
+    std::unique_ptr<QueryNode> MakePhrase(const std::string & text);
+    const std::string & query;
+    size_t pos;
+    size_t token_end;
+};
+
+QueryParser::TokenType QueryParser::Peek(std::string * text)
+{
+  size_t start = pos;
+  while(start < query.size() && std::isspace((unsigned char)query[start])) start++;
+  token_end = start + 1;
+  if(start >= query.size())
+  {
+    token_end = start;
+    return End;
+  }
+  char c = query[start];
+  if(c == '(') return Open;
+  if(c == ')') return Close;
+  if(c == '-') return OpNot;
+  if(c == '"')
+  {
+    size_t close = query.find('"', start + 1);
+    if(close == std::string::npos) close = query.size();
+    if(text) *text = query.substr(start + 1, close - start - 1);
+    token_end = std::min(close + 1, query.size());
+    return Quoted;
+  }
+  size_t end = start;
+  while(end < query.size() && !std::isspace((unsigned char)query[end]) &&
+    query[end] != '(' && query[end] != ')' && query[end] != '"')
+  {
+    end++;
+  }
+  token_end = end;
+  std::string word = query.substr(start, end - start);
+  if(word == "AND") return OpAnd;
+  if(word == "OR") return OpOr;
+  if(word == "NOT") return OpNot;
+  if(text) *text = word;
+  return Word;
+}
+
+std::unique_ptr<QueryNode> QueryParser::MakePhrase(const std::string & text)
+{
+  std::unique_ptr<QueryNode> node(new QueryNode);
+  node->Type = QueryNode::Phrase;
+  TokenizeSearchText(text.c_str(), [&](const std::string & term, uint32_t)
+  {
+    node->Terms.push_back(term);
+  });
+  return node;
+}
+
+std::unique_ptr<QueryNode> QueryParser::Parse(std::string & error)
+{
+  std::unique_ptr<QueryNode> root = ParseOr(error);
+  if(root && Peek() != End)
+  {
+    error = "Unexpected ')' in search";
+    return nullptr;
+  }
+  return root;
+}
+
+std::unique_ptr<QueryNode> QueryParser::ParseOr(std::string & error)
+{
+  std::unique_ptr<QueryNode> left = ParseAnd(error);
+  if(!left) return nullptr;
+  while(Peek() == OpOr)
+  {
+    Next();
+    std::unique_ptr<QueryNode> right = ParseAnd(error);
+    if(!right) return nullptr;
+    std::unique_ptr<QueryNode> node(new QueryNode);
+    node->Type = QueryNode::Or;
+    node->Children.push_back(std::move(left));
+    node->Children.push_back(std::move(right));
+    left = std::move(node);
+  }
+  return left;
+}
+
+std::unique_ptr<QueryNode> QueryParser::ParseAnd(std::string & error)
+{
+  std::unique_ptr<QueryNode> left = ParseUnary(error);
+  if(!left) return nullptr;
+  while(true)
+  {
+    TokenType next = Peek();
+    if(next == OpAnd) Next();
+    else if(next != Word && next != Quoted && next != Open && next != OpNot)
+    {
+      break;
+    }
+    std::unique_ptr<QueryNode> right = ParseUnary(error);
+    if(!right) return nullptr;
+    std::unique_ptr<QueryNode> node(new QueryNode);
+    node->Type = QueryNode::And;
+    node->Children.push_back(std::move(left));
+    node->Children.push_back(std::move(right));
+    left = std::move(node);
+  }
+  return left;
+}
+
+std::unique_ptr<QueryNode> QueryParser::ParseUnary(std::string & error)
+{
+  std::string text;
+  TokenType next = Peek(&text);
+  if(next == OpNot)
+  {
+    Next();
+    std::unique_ptr<QueryNode> child = ParseUnary(error);
+    if(!child) return nullptr;
+    std::unique_ptr<QueryNode> node(new QueryNode);
+    node->Type = QueryNode::Not;
+    node->Children.push_back(std::move(child));
+    return node;
+  }
+  if(next == Open)
+  {
+    Next();
+    std::unique_ptr<QueryNode> inner = ParseOr(error);
+    if(!inner) return nullptr;
+    if(Peek() != Close)
+    {
+      error = "Missing ')' in search";
+      return nullptr;
+    }
+    Next();
+    return inner;
+  }
+  if(next == Word || next == Quoted)
+  {
+    Next();
+    return MakePhrase(text);
+  }
+  error = "Incomplete search";
+  return nullptr;
+}
+
+// Sorted entry numbers, or their complement when Negated is set
+struct EntrySet
+{
+  std::vector<uint32_t> Entries;
+  bool Negated = false;
+};
+
+static std::vector<uint32_t> Intersect(const std::vector<uint32_t> & a,
+  const std::vector<uint32_t> & b)
+{
+  std::vector<uint32_t> result;
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+    std::back_inserter(result));
+  return result;
+}
+
+static std::vector<uint32_t> Unite(const std::vector<uint32_t> & a,
+  const std::vector<uint32_t> & b)
+{
+  std::vector<uint32_t> result;
+  std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+    std::back_inserter(result));
+  return result;
+}
+
+static std::vector<uint32_t> Subtract(const std::vector<uint32_t> & a,
+  const std::vector<uint32_t> & b)
+{
+  std::vector<uint32_t> result;
+  std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+    std::back_inserter(result));
+  return result;
+}
+
+static EntrySet MatchPhrase(ModuleIndex & index, const std::vector<std::string> & terms)
+{
+  EntrySet result;
+  if(terms.empty()) return result;
+  if(terms.size() == 1)
+  {
+    index.GetPostings(terms[0], result.Entries);
+    return result;
+  }
+  std::vector<std::vector<uint32_t>> entries(terms.size());
+  std::vector<std::vector<std::vector<uint32_t>>> positions(terms.size());
+  for(size_t t = 0; t < terms.size(); t++)
+  {
+    if(!index.GetPostings(terms[t], entries[t], &positions[t])) return result;
+  }
+  // Walk the first term's entries; every other term must appear in the
+  // same entry at the following positions
+  std::vector<size_t> cursor(terms.size(), 0);
+  for(size_t n = 0; n < entries[0].size(); n++)
+  {
+    uint32_t entry = entries[0][n];
+    bool in_all = true;
+    for(size_t t = 1; t < terms.size() && in_all; t++)
+    {
+      std::vector<uint32_t> & list = entries[t];
+      cursor[t] = std::lower_bound(list.begin() + cursor[t], list.end(), entry) -
+        list.begin();
+      in_all = cursor[t] < list.size() && list[cursor[t]] == entry;
+    }
+    if(!in_all) continue;
+    for(uint32_t start : positions[0][n])
+    {
+      bool adjacent = true;
+      for(size_t t = 1; t < terms.size() && adjacent; t++)
+      {
+        const std::vector<uint32_t> & at = positions[t][cursor[t]];
+        adjacent = std::binary_search(at.begin(), at.end(), uint32_t(start + t));
+      }
+      if(adjacent)
+      {
+        result.Entries.push_back(entry);
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+static EntrySet Evaluate(ModuleIndex & index, const QueryNode & node)
+{
+  if(node.Type == QueryNode::Phrase) return MatchPhrase(index, node.Terms);
+  EntrySet a = Evaluate(index, *node.Children[0]);
+  if(node.Type == QueryNode::Not)
+  {
+    a.Negated = !a.Negated;
+    return a;
+  }
+  EntrySet b = Evaluate(index, *node.Children[1]);
+  EntrySet result;
+  if(node.Type == QueryNode::And)
+  {
+    if(!a.Negated && !b.Negated) result.Entries = Intersect(a.Entries, b.Entries);
+    else if(!a.Negated) result.Entries = Subtract(a.Entries, b.Entries);
+    else if(!b.Negated) result.Entries = Subtract(b.Entries, a.Entries);
+    else
+    {
+      result.Entries = Unite(a.Entries, b.Entries);
+      result.Negated = true;
+    }
+  }
+  else
+  {
+    if(!a.Negated && !b.Negated) result.Entries = Unite(a.Entries, b.Entries);
+    else if(!a.Negated)
+    {
+      result.Entries = Subtract(b.Entries, a.Entries);
+      result.Negated = true;
+    }
+    else if(!b.Negated)
+    {
+      result.Entries = Subtract(a.Entries, b.Entries);
+      result.Negated = true;
+    }
+    else
+    {
+      result.Entries = Intersect(a.Entries, b.Entries);
+      result.Negated = true;
+    }
+  }
+  return result;
+}
+
+SearchIndex::SearchIndex(std::string index_dir) : index_dir(index_dir)
+{
+}
+
+void SearchIndex::SetIndexDir(std::string index_dir)
+{
+  std::lock_guard<std::mutex> lock(indexes_mutex);
+  this->index_dir = index_dir;
+  indexes.clear();
+  concordances.clear();
+  graphs.clear();
+  lexicons.clear();
+}
+
+std::string SearchIndex::IndexFileName(std::string mod_name)
+{
+  return (std::filesystem::path(index_dir) / (mod_name + ".mxi")).string();
+}
+
+std::string SearchIndex::ConcordanceFileName(std::string mod_name)
+{
+  return (std::filesystem::path(index_dir) / (mod_name + ".mxs")).string();
+}
+
+std::string SearchIndex::CrossRefFileName(std::string mod_name)
+{
+  return (std::filesystem::path(index_dir) / (mod_name + ".mxg")).string();
+}
+
+std::string SearchIndex::LexiconFileName(std::string mod_name)
+{
+  return (std::filesystem::path(index_dir) / (mod_name + ".mxl")).string();
+}
+
+int SearchIndex::Update(std::string library_dir, int jobs, bool rebuild,
+  const std::function<bool()> & cancelled)
+{
+  std::lock_guard<std::mutex> update_lock(update_mutex);
+  std::error_code error;
+  std::filesystem::create_directories(index_dir, error);
+  if(error)
+  {
+    std::cout << "Error creating search index directory " << index_dir << '\n';
+    return 0;
+  }
+
+  // Readers are created here, before any worker starts, because SWORD's
+  // global managers are not safe to initialize from two threads at once
+  std::vector<std::unique_ptr<SwordReader>> readers;
+  readers.emplace_back(new SwordReader(library_dir));
+  std::vector<std::string> mod_names;
+  const char * types[] = {"Biblical Texts", "Commentaries",
+    "Lexicons / Dictionaries"};
+  for(const char * type : types)
+  {
+    std::vector<std::string> names = readers[0]->GetModules(type);
+    mod_names.insert(mod_names.end(), names.begin(), names.end());
+  }
+
+  // Load the files that are current (text indexes of every module, Strong's
+  // concordances of tagged Bibles, cross-reference graphs of Bibles and
+  // commentaries, key indexes of dictionaries); queue the rest
+  enum BuildKind { TextIndex, Concordance, CrossRefs, LexiconKeys };
+  struct BuildTask
+  {
+    std::string Module;
+    std::string Stamp;
+    BuildKind Kind;
+  };
+  std::vector<BuildTask> pending;
+  // Files the installed modules have (any other index file is removed)
+  std::set<std::string> wanted;
+  for(const std::string & mod_name : mod_names)
+  {
+    sword::SWModule * module = readers[0]->GetModule(mod_name);
+    std::string stamp = ModuleIndexStamp(library_dir, module);
+    std::string type(module->getType());
+    wanted.insert(IndexFileName(mod_name));
+    // Stale files are dropped first so they can be replaced
+    std::shared_ptr<ModuleIndex> index(new ModuleIndex);
+    bool current = !rebuild && index->Open(IndexFileName(mod_name)) &&
+      index->GetStamp() == stamp;
+    {
+      std::lock_guard<std::mutex> lock(indexes_mutex);
+      if(current) indexes[mod_name] = index;
+      else indexes.erase(mod_name);
+    }
+    if(!current) pending.push_back(BuildTask{mod_name, stamp, TextIndex});
+
+    if(type == "Biblical Texts" && HasStrongsNumbers(module))
+    {
+      std::shared_ptr<StrongsConcordance> concordance(new StrongsConcordance);
+      current = !rebuild && concordance->Open(ConcordanceFileName(mod_name)) &&
+        concordance->GetStamp() == stamp;
+      {
+        std::lock_guard<std::mutex> lock(indexes_mutex);
+        if(current) concordances[mod_name] = concordance;
+        else concordances.erase(mod_name);
+      }
+      if(!current) pending.push_back(BuildTask{mod_name, stamp, Concordance});
+      wanted.insert(ConcordanceFileName(mod_name));
+    }
+
+    if(type == "Biblical Texts" || type == "Commentaries")
+    {
+      std::shared_ptr<CrossRefGraph> graph(new CrossRefGraph);
+      current = !rebuild && graph->Open(CrossRefFileName(mod_name)) &&
+        graph->GetStamp() == stamp;
+      {
+        std::lock_guard<std::mutex> lock(indexes_mutex);
+        if(current) graphs[mod_name] = graph;
+        else graphs.erase(mod_name);
+      }
+      if(!current) pending.push_back(BuildTask{mod_name, stamp, CrossRefs});
+      wanted.insert(CrossRefFileName(mod_name));
+    }
+
+    if(type == "Lexicons / Dictionaries")
+    {
+      std::shared_ptr<LexiconIndex> lexicon(new LexiconIndex);
+      current = !rebuild && lexicon->Open(LexiconFileName(mod_name)) &&
+        lexicon->GetStamp() == stamp;
+      {
+        std::lock_guard<std::mutex> lock(indexes_mutex);
+        if(current) lexicons[mod_name] = lexicon;
+        else lexicons.erase(mod_name);
+      }
+      if(!current) pending.push_back(BuildTask{mod_name, stamp, LexiconKeys});
+      wanted.insert(LexiconFileName(mod_name));
+    }
+  }
+  PruneIndexes(wanted);
+  if(pending.empty() || (cancelled && cancelled())) return 0;
+  // Key indexes take moments to build and serve every hover, so they go
+  // first
+  std::stable_partition(pending.begin(), pending.end(),
+    [](const BuildTask & task){ return task.Kind == LexiconKeys; });
+
+  if(jobs <= 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+  jobs = std::min<int>(jobs, pending.size());
+  while((int)readers.size() < jobs)
+  {
+    readers.emplace_back(new SwordReader(library_dir));
+  }
+  std::atomic<size_t> next_task(0);
+  std::atomic<int> built(0);
+  std::vector<std::thread> workers;
+  for(int w = 0; w < jobs; w++)
+  {
+    workers.emplace_back([&, w]()
+    {
+      size_t n;
+      while((n = next_task++) < pending.size())
+      {
+        if(cancelled && cancelled()) break;
+        const BuildTask & task = pending[n];
+        sword::SWModule * module = readers[w]->GetModule(task.Module);
+        if(!module) continue;
+        bool done = false;
+        if(task.Kind == TextIndex)
+        {
+          done = BuildModuleIndex(module, task.Stamp, IndexFileName(task.Module));
+        }
+        else if(task.Kind == Concordance)
+        {
+          done = BuildStrongsConcordance(module, task.Stamp,
+            ConcordanceFileName(task.Module));
+        }
+        else if(task.Kind == CrossRefs)
+        {
+          done = BuildCrossRefGraph(module, task.Stamp,
+            CrossRefFileName(task.Module));
+        }
+        else
+        {
+          done = BuildLexiconIndex(module, task.Stamp,
+            LexiconFileName(task.Module));
+          std::shared_ptr<LexiconIndex> lexicon(new LexiconIndex);
+          if(done && lexicon->Open(LexiconFileName(task.Module)))
+          {
+            std::lock_guard<std::mutex> lock(indexes_mutex);
+            lexicons[task.Module] = lexicon;
+          }
+        }
+        if(done) built++;
+      }
+    });
+  }
+  for(std::thread & worker : workers) worker.join();
+
+  // A cancelled update leaves some files stale, so only files with the
+  // module's current stamp are loaded
+  for(const BuildTask & task : pending)
+  {
+    std::lock_guard<std::mutex> lock(indexes_mutex);
+    if(task.Kind == TextIndex)
+    {
+      std::shared_ptr<ModuleIndex> index(new ModuleIndex);
+      if(index->Open(IndexFileName(task.Module)) &&
+        index->GetStamp() == task.Stamp)
+      {
+        indexes[task.Module] = index;
+      }
+    }
+    else if(task.Kind == Concordance)
+    {
+      std::shared_ptr<StrongsConcordance> concordance(new StrongsConcordance);
+      if(concordance->Open(ConcordanceFileName(task.Module)) &&
+        concordance->GetStamp() == task.Stamp)
+      {
+        concordances[task.Module] = concordance;
+      }
+    }
+    else if(task.Kind == CrossRefs)
+    {
+      std::shared_ptr<CrossRefGraph> graph(new CrossRefGraph);
+      if(graph->Open(CrossRefFileName(task.Module)) &&
+        graph->GetStamp() == task.Stamp)
+      {
+        graphs[task.Module] = graph;
+      }
+    }
+  }
+  std::cout << "Search index: built " << built << " of " << pending.size() <<
+    " index files" << (cancelled && cancelled() ? " (cancelled)" : "") << '\n';
+  return built;
+}
+
+void SearchIndex::PruneIndexes(const std::set<std::string> & wanted)
+{
+  // Indexes of removed modules (or of kinds a module no longer has) stop
+  // answering queries at once; searches in progress keep their copies
+  {
+    std::lock_guard<std::mutex> lock(indexes_mutex);
+    for(auto it = indexes.begin(); it != indexes.end();)
+    {
+      if(wanted.count(IndexFileName(it->first))) ++it;
+      else it = indexes.erase(it);
+    }
+    for(auto it = concordances.begin(); it != concordances.end();)
+    {
+      if(wanted.count(ConcordanceFileName(it->first))) ++it;
+      else it = concordances.erase(it);
+    }
+    for(auto it = graphs.begin(); it != graphs.end();)
+    {
+      if(wanted.count(CrossRefFileName(it->first))) ++it;
+      else it = graphs.erase(it);
+    }
+    for(auto it = lexicons.begin(); it != lexicons.end();)
+    {
+      if(wanted.count(LexiconFileName(it->first))) ++it;
+      else it = lexicons.erase(it);
+    }
+  }
+  std::error_code error;
+  for(const auto & entry :
+    std::filesystem::directory_iterator(index_dir, error))
+  {
+    std::string extension = entry.path().extension().string();
+    if(extension != ".mxi" && extension != ".mxs" && extension != ".mxg" &&
+      extension != ".mxl")
+    {
+      continue;
+    }
+    if(wanted.count((std::filesystem::path(index_dir) /
+      entry.path().filename()).string()))
+    {
+      continue;
+    }
+    std::error_code remove_error;
+    std::filesystem::remove(entry.path(), remove_error);
+  }
+}
+
+void SearchIndex::GetCrossReferences(uint32_t verse_id,
+  std::vector<CrossReference> & outgoing, std::vector<CrossReference> & incoming)
+{
+  outgoing.clear();
+  incoming.clear();
+  std::vector<std::pair<std::string, std::shared_ptr<CrossRefGraph>>> targets;
+  {
+    std::lock_guard<std::mutex> lock(indexes_mutex);
+    targets.assign(graphs.begin(), graphs.end());
+  }
+  const uint32_t * begin;
+  const uint32_t * end;
+  for(auto & target : targets)
+  {
+    if(target.second->GetOutgoing(verse_id, begin, end))
+    {
+      for(; begin != end; ++begin)
+      {
+        outgoing.push_back(CrossReference{target.first, *begin, ""});
+      }
+    }
+    if(target.second->GetIncoming(verse_id, begin, end))
+    {
+      for(; begin != end; ++begin)
+      {
+        incoming.push_back(CrossReference{target.first, *begin, ""});
+      }
+    }
+  }
+}
+
+bool SearchIndex::LookupStrongs(std::string mod_name, std::string strongs_number,
+  StrongsOccurrences & result, size_t max_verses)
+{
+  std::shared_ptr<StrongsConcordance> concordance;
+  {
+    std::lock_guard<std::mutex> lock(indexes_mutex);
+    auto found = concordances.find(mod_name);
+    if(found == concordances.end()) return false;
+    concordance = found->second;
+  }
+  return concordance->Lookup(strongs_number, result, max_verses);
+}
+
+std::shared_ptr<LexiconIndex> SearchIndex::GetLexiconIndex(std::string mod_name)
+{
+  std::lock_guard<std::mutex> lock(indexes_mutex);
+  auto found = lexicons.find(mod_name);
+  if(found == lexicons.end()) return std::shared_ptr<LexiconIndex>();
+  return found->second;
+}
+
+std::vector<std::string> SearchIndex::GetIndexedModules()
+{
+  std::lock_guard<std::mutex> lock(indexes_mutex);
+  std::vector<std::string> mod_names;
+  for(auto & index : indexes) mod_names.push_back(index.first);
+  return mod_names;
+}
+
+bool SearchIndex::Search(std::string query, std::vector<std::string> mod_names,
+  std::function<bool(const SearchHit &)> on_hit, std::string & error)
+{
+  QueryParser parser(query);
+  std::unique_ptr<QueryNode> root = parser.Parse(error);
+  if(!root) return false;
+
+  // Take references to the indexes, so updates can run alongside
+  std::vector<std::pair<std::string, std::shared_ptr<ModuleIndex>>> targets;
+  {
+    std::lock_guard<std::mutex> lock(indexes_mutex);
+    if(mod_names.empty())
+    {
+      for(auto & index : indexes) mod_names.push_back(index.first);
+    }
+    for(const std::string & mod_name : mod_names)
+    {
+      auto found = indexes.find(mod_name);
+      if(found != indexes.end()) targets.push_back(*found);
+    }
+  }
+
+  SearchHit hit;
+  for(auto & target : targets)
+  {
+    ModuleIndex & index = *target.second;
+    EntrySet matches = Evaluate(index, *root);
+    hit.Module = target.first;
+    // Entry numbers follow the module's own order, i.e. verse order
+    if(matches.Negated)
+    {
+      size_t skip = 0;
+      for(uint32_t entry = 0; entry < index.GetEntryCount(); entry++)
+      {
+        if(skip < matches.Entries.size() && matches.Entries[skip] == entry)
+        {
+          skip++;
+          continue;
+        }
+        hit.Entry = entry;
+        hit.Key = index.GetEntryKey(entry);
+        if(!on_hit(hit)) return true;
+      }
+    }
+    else
+    {
+      for(uint32_t entry : matches.Entries)
+      {
+        hit.Entry = entry;
+        hit.Key = index.GetEntryKey(entry);
+        if(!on_hit(hit)) return true;
+      }
+    }
+  }
+  return true;
+}
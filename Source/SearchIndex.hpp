@@ -0,0 +1,127 @@
+// Machaira: SearchIndex.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the full-text search index: one memory-mapped inverted index
+// file per installed module, with positional postings for word, phrase and
+// boolean queries, built alongside the Strong's concordances,
+// cross-reference graphs and dictionary key indexes
+// Current version: Pre-release
+
+#ifndef SEARCHINDEX_HPP
+#define SEARCHINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+#include <swmodule.h>
+
+#include "MappedFile.hpp"
+#include "StrongsConcordance.hpp"
+#include "CrossRefGraph.hpp"
+#include "LexiconIndex.hpp"
+
+struct SearchHit
+{
+  std::string Module;
+  std::string Key;
+  // Position of the entry among the module's indexed entries
+  uint32_t Entry;
+};
+
+// Splits text into lowercase search terms; positions count terms
+void TokenizeSearchText(const char * text,
+  std::function<void(const std::string &, uint32_t)> on_term);
+
+// Term table record of an index file (defined with the file layout)
+struct IndexTermEntry;
+
+// One module's index file, read in place
+class ModuleIndex
+{
+  public:
+    // Constructor
+    ModuleIndex();
+    bool Open(std::string file_name);
+    // Contents
+    std::string GetStamp();
+    uint32_t GetEntryCount(){ return entry_count; }
+    std::string GetEntryKey(uint32_t entry);
+    // Sorted entries containing the term (positions optional)
+    bool GetPostings(const std::string & term, std::vector<uint32_t> & entries,
+      std::vector<std::vector<uint32_t>> * positions = 0);
+  private:
+    const IndexTermEntry * FindTerm(const std::string & term);
+    MappedFile file;
+    uint32_t entry_count;
+    uint32_t term_count;
+    const IndexTermEntry * terms;
+    const char * term_text;
+    const char * postings;
+    const uint32_t * keys;
+    const char * key_text;
+    const char * stamp;
+    uint32_t stamp_length;
+};
+
+// Identifies the installed copy of a module (version, data file sizes and
+// times), so reinstalled or updated modules are indexed again
+std::string ModuleIndexStamp(std::string library_dir, sword::SWModule * module);
+
+// Writes a module's index file (to a temporary name, then renamed)
+bool BuildModuleIndex(sword::SWModule * module, std::string stamp,
+  std::string file_name);
+
+class SearchIndex
+{
+  public:
+    // Constructor
+    SearchIndex(std::string index_dir = "");
+    void SetIndexDir(std::string index_dir);
+    // Building: (re)indexes modules whose files are missing or stale, in
+    // parallel, and returns how many files were built (text indexes,
+    // concordances of Strong's-tagged Bibles, cross-reference graphs,
+    // dictionary key indexes). Workers stop taking files once cancelled
+    // returns true; files not yet built are left for the next update
+    int Update(std::string library_dir, int jobs = 0, bool rebuild = false,
+      const std::function<bool()> & cancelled = nullptr);
+    std::vector<std::string> GetIndexedModules();
+    // Queries: words, "quoted phrases", AND/OR/NOT (or -word) and
+    // parentheses; adjacent terms are ANDed. Hits are passed to on_hit in
+    // verse order, module by module, until it returns false
+    bool Search(std::string query, std::vector<std::string> mod_names,
+      std::function<bool(const SearchHit &)> on_hit, std::string & error);
+    // Strong's concordance of a tagged Bible ("H07225", "G3056"...)
+    bool LookupStrongs(std::string mod_name, std::string strongs_number,
+      StrongsOccurrences & result, size_t max_verses = SIZE_MAX);
+    // References from and to a verse (see CrossRefVerseId), in every graph;
+    // Verse is left empty
+    void GetCrossReferences(uint32_t verse_id,
+      std::vector<CrossReference> & outgoing,
+      std::vector<CrossReference> & incoming);
+    // Key index of a dictionary (none until it is loaded or built; key
+    // indexes are built first and published as soon as each is written)
+    std::shared_ptr<LexiconIndex> GetLexiconIndex(std::string mod_name);
+  private:
+    std::string IndexFileName(std::string mod_name);
+    std::string ConcordanceFileName(std::string mod_name);
+    std::string CrossRefFileName(std::string mod_name);
+    std::string LexiconFileName(std::string mod_name);
+    // Drops loaded indexes and index files not among wanted (file names)
+    void PruneIndexes(const std::set<std::string> & wanted);
+    std::string index_dir;
+    // Loaded indexes are shared with running searches, so an index can be
+    // replaced while a search still reads the old one
+    std::map<std::string, std::shared_ptr<ModuleIndex>> indexes;
+    std::map<std::string, std::shared_ptr<StrongsConcordance>> concordances;
+    std::map<std::string, std::shared_ptr<CrossRefGraph>> graphs;
+    std::map<std::string, std::shared_ptr<LexiconIndex>> lexicons;
+    std::mutex indexes_mutex;
+    std::mutex update_mutex;
+};
+
+#endif
@@ -0,0 +1,150 @@
+// Machaira: SourceCatalog.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the on-disk cache of each install source's parsed module
+// catalog, with when it was fetched and validators for deciding whether it
+// has to be fetched again
+// Current version: Pre-release
+
+#include "SourceCatalog.hpp"
+#include "MappedFile.hpp"
+#include "BinaryRecord.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+
+// Cache file layout (host byte order):
+//   magic, uint32 version, string source, int64 fetch time, strings source
+//   and content validators
+//   uint32 module count, then per module: strings name, type, language,
+//     description and version
+static const char source_catalog_magic[4] = {'M', 'X', 'R', 'C'};
+static const uint32_t source_catalog_version = 1;
+
+namespace
+{
+  // 64-bit FNV-1a, printed in hex
+  class ValidatorHash
+  {
+    public:
+      void Add(const std::string & text)
+      {
+        for(unsigned char c : text)
+        {
+          hash ^= c;
+          hash *= 1099511628211ULL;
+        }
+        // Separator, so "ab"+"c" and "a"+"bc" differ
+        hash ^= 0xff;
+        hash *= 1099511628211ULL;
+      }
+      std::string Text()
+      {
+        std::ostringstream out;
+        out << std::hex << hash;
+        return out.str();
+      }
+    private:
+      uint64_t hash = 14695981039346656037ULL;
+  };
+
+  std::vector<std::filesystem::path> ConfFiles(const std::filesystem::path & dir)
+  {
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for(const std::filesystem::directory_entry & entry :
+      std::filesystem::directory_iterator(dir, error))
+    {
+      if(entry.path().extension() == ".conf") files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+  }
+}
+
+bool ReadSourceCatalog(std::string file_name, SourceCatalog & catalog)
+{
+  catalog = SourceCatalog();
+  MappedFile file;
+  if(!file.Open(file_name)) return false;
+  RecordReader in = {file.Data(), file.Data() + file.Size()};
+  uint32_t version, count;
+  if(!in.Magic(source_catalog_magic) || !in.Number(version) ||
+    version != source_catalog_version || !in.String(catalog.Source) ||
+    !in.Number(catalog.FetchTime) || !in.String(catalog.SourceValidator) ||
+    !in.String(catalog.ContentValidator) || !in.Number(count))
+  {
+    return false;
+  }
+  catalog.Modules.resize(count);
+  for(SwordModuleInfo & module : catalog.Modules)
+  {
+    if(!in.String(module.Name) || !in.String(module.Type) ||
+      !in.String(module.Language) || !in.String(module.Description) ||
+      !in.String(module.Version))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteSourceCatalog(std::string file_name, const SourceCatalog & catalog)
+{
+  std::error_code error;
+  std::filesystem::create_directories(
+    std::filesystem::path(file_name).parent_path(), error);
+  std::string body(source_catalog_magic, 4);
+  AppendNumber(body, source_catalog_version);
+  AppendString(body, catalog.Source);
+  AppendNumber(body, catalog.FetchTime);
+  AppendString(body, catalog.SourceValidator);
+  AppendString(body, catalog.ContentValidator);
+  AppendNumber<uint32_t>(body, catalog.Modules.size());
+  for(const SwordModuleInfo & module : catalog.Modules)
+  {
+    AppendString(body, module.Name);
+    AppendString(body, module.Type);
+    AppendString(body, module.Language);
+    AppendString(body, module.Description);
+    AppendString(body, module.Version);
+  }
+  return ReplaceFileContents(file_name, body);
+}
+
+std::string DirSourceValidator(std::string source_dir)
+{
+  ValidatorHash hash;
+  std::error_code error;
+  std::filesystem::path dir(source_dir);
+  // SWORD fetches the archive when there is one, else the directory
+  std::vector<std::filesystem::path> files;
+  if(std::filesystem::is_regular_file(dir / "mods.d.tar.gz", error))
+  {
+    files.push_back(dir / "mods.d.tar.gz");
+  }
+  else files = ConfFiles(dir / "mods.d");
+  for(const std::filesystem::path & file : files)
+  {
+    hash.Add(file.filename().string());
+    hash.Add(std::to_string(std::filesystem::file_size(file, error)));
+    hash.Add(std::to_string(
+      std::filesystem::last_write_time(file, error).time_since_epoch().count()));
+  }
+  return hash.Text();
+}
+
+std::string CatalogContentValidator(std::string mods_dir)
+{
+  ValidatorHash hash;
+  for(const std::filesystem::path & file : ConfFiles(mods_dir))
+  {
+    std::ifstream fin(file, std::ios::binary);
+    std::ostringstream contents;
+    contents << fin.rdbuf();
+    hash.Add(file.filename().string());
+    hash.Add(contents.str());
+  }
+  return hash.Text();
+}
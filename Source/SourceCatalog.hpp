@@ -0,0 +1,56 @@
+// Machaira: SourceCatalog.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the on-disk cache of each install source's parsed module
+// catalog, with when it was fetched and validators for deciding whether it
+// has to be fetched again
+// Current version: Pre-release
+
+#ifndef SOURCECATALOG_HPP
+#define SOURCECATALOG_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct SwordModuleInfo
+{
+  std::string Name;
+  std::string Type;
+  std::string Language;
+  std::string Description;
+  std::string Version;
+};
+
+struct SourceCatalog
+{
+  std::string Source;
+  // Seconds since the epoch
+  int64_t FetchTime = 0;
+  // Config files on a local directory source (checked before fetching),
+  // and the fetched configs themselves (checked after fetching)
+  std::string SourceValidator;
+  std::string ContentValidator;
+  std::vector<SwordModuleInfo> Modules;
+  // True when the catalog was fetched by the last refresh, false when it
+  // was served from the cache (not saved)
+  bool Downloaded = false;
+};
+
+// Installed module for which a source offers a newer version
+struct ModuleUpdate
+{
+  std::string Name;
+  std::string Source;
+  std::string InstalledVersion;
+  std::string AvailableVersion;
+};
+
+bool ReadSourceCatalog(std::string file_name, SourceCatalog & catalog);
+bool WriteSourceCatalog(std::string file_name, const SourceCatalog & catalog);
+// Validators are hashes of the .conf files in a mods.d directory (or of the
+// mods.d.tar.gz beside it): names, sizes and times for a source directory,
+// names and contents for a fetched catalog
+std::string DirSourceValidator(std::string source_dir);
+std::string CatalogContentValidator(std::string mods_dir);
+
+#endif
@@ -0,0 +1,326 @@
+// Machaira: StrongsConcordance.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the Strong's number concordance of a tagged Bible: for every
+// Hebrew and Greek number, the verses it occurs in and the words it is
+// translated by, in a memory-mapped file indexed directly by number
+// Current version: Pre-release
+
+#include "StrongsConcordance.hpp"
+#include "Varint.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cctype>
+
+#include <swoptfilter.h>
+
+// Concordance file layout (host byte order):
+//   StrongsHeader, stamp text, padding to 8 bytes
+//   StrongsSlot[hebrew_count + greek_count], Hebrew numbers first, indexed
+//     by number
+//   data: per slot, varint verse deltas, then per word varint(count),
+//     varint(length) and the word text
+//   uint32 key offsets[entry_count+1], then the key text
+struct StrongsHeader
+{
+  char Magic[4];
+  uint32_t Version;
+  uint32_t EntryCount;
+  uint32_t HebrewCount;
+  uint32_t GreekCount;
+  uint32_t StampLength;
+  uint64_t StampOffset;
+  uint64_t SlotsOffset;
+  uint64_t DataOffset;
+  uint64_t KeysOffset;
+  uint64_t KeyTextOffset;
+  uint64_t FileSize;
+};
+
+struct StrongsSlot
+{
+  uint32_t Occurrences;
+  uint32_t VerseCount;
+  uint32_t WordCount;
+  uint32_t Reserved;
+  uint64_t DataOffset;
+};
+
+static const char concordance_magic[4] = {'M', 'X', 'S', 'C'};
+static const uint32_t concordance_version = 1;
+
+bool ParseStrongsNumber(std::string text, char & testament, uint32_t & number)
+{
+  size_t colon = text.find(':');
+  if(colon != std::string::npos) text = text.substr(colon + 1);
+  if(text.empty()) return false;
+  testament = std::toupper((unsigned char)text[0]);
+  if(testament != 'H' && testament != 'G') return false;
+  size_t n = 1;
+  number = 0;
+  while(n < text.size() && text[n] >= '0' && text[n] <= '9')
+  {
+    number = number*10 + (text[n] - '0');
+    // Larger numbers are not Strong's numbers
+    if(number > 99999) return false;
+    n++;
+  }
+  return n > 1;
+}
+
+bool HasStrongsNumbers(sword::SWModule * module)
+{
+  for(sword::OptionFilterList::const_iterator it =
+    module->getOptionFilters().begin();
+    it != module->getOptionFilters().end(); ++it)
+  {
+    if(std::string((*it)->getOptionName()) == "Strong's Numbers") return true;
+  }
+  return false;
+}
+
+StrongsConcordance::StrongsConcordance() :
+  entry_count(0), hebrew_count(0), greek_count(0), slots(0), data(0), keys(0),
+  key_text(0), stamp(0), stamp_length(0)
+{
+}
+
+bool StrongsConcordance::Open(std::string file_name)
+{
+  if(!file.Open(file_name)) return false;
+  if(file.Size() < sizeof(StrongsHeader))
+  {
+    file.Close();
+    return false;
+  }
+  const StrongsHeader * header =
+    reinterpret_cast<const StrongsHeader *>(file.Data());
+  uint64_t slot_count = uint64_t(header->HebrewCount) + header->GreekCount;
+  if(std::memcmp(header->Magic, concordance_magic, 4) != 0 ||
+    header->Version != concordance_version ||
+    header->FileSize != file.Size() || header->KeyTextOffset > file.Size() ||
+    header->KeysOffset + 4*(uint64_t(header->EntryCount)+1) > file.Size() ||
+    header->SlotsOffset + sizeof(StrongsSlot)*slot_count > file.Size())
+  {
+    file.Close();
+    return false;
+  }
+  entry_count = header->EntryCount;
+  hebrew_count = header->HebrewCount;
+  greek_count = header->GreekCount;
+  stamp = file.Data() + header->StampOffset;
+  stamp_length = header->StampLength;
+  slots = reinterpret_cast<const StrongsSlot *>(file.Data() + header->SlotsOffset);
+  data = file.Data() + header->DataOffset;
+  keys = reinterpret_cast<const uint32_t *>(file.Data() + header->KeysOffset);
+  key_text = file.Data() + header->KeyTextOffset;
+  return true;
+}
+
+std::string StrongsConcordance::GetStamp()
+{
+  if(!stamp) return "";
+  return std::string(stamp, stamp_length);
+}
+
+bool StrongsConcordance::Lookup(char testament, uint32_t number,
+  StrongsOccurrences & result, size_t max_verses)
+{
+  result = StrongsOccurrences();
+  const StrongsSlot * slot = 0;
+  if(testament == 'H' && number < hebrew_count) slot = &slots[number];
+  if(testament == 'G' && number < greek_count) slot = &slots[hebrew_count + number];
+  if(!slot || slot->Occurrences == 0) return false;
+
+  result.Occurrences = slot->Occurrences;
+  result.VerseCount = slot->VerseCount;
+  const unsigned char * in =
+    reinterpret_cast<const unsigned char *>(data + slot->DataOffset);
+  uint32_t entry = 0;
+  for(uint32_t n = 0; n < slot->VerseCount; n++)
+  {
+    entry += ReadVarint(in);
+    if(result.Verses.size() < max_verses && entry < entry_count)
+    {
+      result.Verses.push_back(std::string(key_text + keys[entry],
+        keys[entry+1] - keys[entry]));
+    }
+  }
+  for(uint32_t n = 0; n < slot->WordCount; n++)
+  {
+    StrongsWord word;
+    word.Count = ReadVarint(in);
+    uint32_t length = ReadVarint(in);
+    word.Text.assign(reinterpret_cast<const char *>(in), length);
+    in += length;
+    result.Words.push_back(word);
+  }
+  return true;
+}
+
+bool StrongsConcordance::Lookup(std::string strongs_number,
+  StrongsOccurrences & result, size_t max_verses)
+{
+  char testament;
+  uint32_t number;
+  if(!ParseStrongsNumber(strongs_number, testament, number)) return false;
+  return Lookup(testament, number, result, max_verses);
+}
+
+bool BuildStrongsConcordance(sword::SWModule * module, std::string stamp,
+  std::string file_name)
+{
+  // Strong's numbers on (they are read from the entry attributes), every
+  // other option off
+  for(sword::OptionFilterList::const_iterator it =
+    module->getOptionFilters().begin();
+    it != module->getOptionFilters().end(); ++it)
+  {
+    if(std::string((*it)->getOptionName()) == "Strong's Numbers")
+    {
+      (*it)->setOptionValue("On");
+    }
+    else (*it)->setOptionValue("Off");
+  }
+  module->setProcessEntryAttributes(true);
+
+  struct NumberBuild
+  {
+    std::vector<uint32_t> Verses;
+    uint32_t Occurrences = 0;
+    std::unordered_map<std::string, uint32_t> Words;
+  };
+  // Index 0 is Hebrew, 1 is Greek
+  std::vector<NumberBuild> numbers[2];
+  std::vector<uint32_t> key_offsets;
+  std::string key_texts;
+
+  uint32_t entry = 0;
+  module->setPosition(TOP);
+  for(; !module->popError(); module->increment(1))
+  {
+    module->stripText();
+    bool tagged = false;
+    sword::AttributeList & words = module->getEntryAttributes()["Word"];
+    for(sword::AttributeList::iterator word = words.begin(); word != words.end();
+      ++word)
+    {
+      std::string text;
+      sword::AttributeValue::iterator text_it = word->second.find("Text");
+      if(text_it != word->second.end()) text = text_it->second.c_str();
+      // "Lemma", or "Lemma.1", "Lemma.2"... for words with several parts
+      for(sword::AttributeValue::iterator value = word->second.begin();
+        value != word->second.end(); ++value)
+      {
+        std::string name(value->first.c_str());
+        if(name.compare(0, 5, "Lemma") != 0 ||
+          name.compare(0, 10, "LemmaClass") == 0)
+        {
+          continue;
+        }
+        std::string lemmas(value->second.c_str());
+        size_t start = 0;
+        while(start < lemmas.size())
+        {
+          size_t end = lemmas.find_first_of(" |", start);
+          if(end == std::string::npos) end = lemmas.size();
+          char testament;
+          uint32_t number;
+          if(ParseStrongsNumber(lemmas.substr(start, end - start), testament,
+            number))
+          {
+            std::vector<NumberBuild> & list = numbers[testament == 'G'];
+            if(list.size() <= number) list.resize(number + 1);
+            NumberBuild & build = list[number];
+            if(build.Verses.empty() || build.Verses.back() != entry)
+            {
+              build.Verses.push_back(entry);
+            }
+            build.Occurrences++;
+            if(!text.empty()) build.Words[text]++;
+            tagged = true;
+          }
+          start = end + 1;
+        }
+      }
+    }
+    // Only verses with tagged words get an entry number
+    if(!tagged) continue;
+    key_offsets.push_back(key_texts.size());
+    key_texts += module->getKeyText();
+    entry++;
+  }
+  key_offsets.push_back(key_texts.size());
+
+  auto pad = [](std::string & out)
+  {
+    while(out.size() % 8) out += '\0';
+  };
+  StrongsHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, concordance_magic, 4);
+  header.Version = concordance_version;
+  header.EntryCount = entry;
+  header.HebrewCount = numbers[0].size();
+  header.GreekCount = numbers[1].size();
+  header.StampLength = stamp.size();
+
+  std::string body(sizeof(StrongsHeader), '\0');
+  header.StampOffset = body.size();
+  body += stamp;
+  pad(body);
+  header.SlotsOffset = body.size();
+  body.append(sizeof(StrongsSlot)*(numbers[0].size() + numbers[1].size()), '\0');
+  std::string data_block;
+  size_t slot_index = 0;
+  for(int t = 0; t < 2; t++)
+  {
+    for(NumberBuild & build : numbers[t])
+    {
+      StrongsSlot slot;
+      std::memset(&slot, 0, sizeof(slot));
+      slot.Occurrences = build.Occurrences;
+      slot.VerseCount = build.Verses.size();
+      slot.WordCount = build.Words.size();
+      slot.DataOffset = data_block.size();
+      uint32_t last = 0;
+      for(uint32_t verse : build.Verses)
+      {
+        WriteVarint(data_block, verse - last);
+        last = verse;
+      }
+      std::vector<std::pair<std::string, uint32_t>> words(build.Words.begin(),
+        build.Words.end());
+      std::sort(words.begin(), words.end(),
+        [](const std::pair<std::string, uint32_t> & a,
+          const std::pair<std::string, uint32_t> & b)
+        {
+          if(a.second != b.second) return a.second > b.second;
+          return a.first < b.first;
+        });
+      for(const std::pair<std::string, uint32_t> & word : words)
+      {
+        WriteVarint(data_block, word.second);
+        WriteVarint(data_block, word.first.size());
+        data_block += word.first;
+      }
+      std::memcpy(&body[header.SlotsOffset + slot_index*sizeof(StrongsSlot)],
+        &slot, sizeof(slot));
+      slot_index++;
+    }
+  }
+  header.DataOffset = body.size();
+  body += data_block;
+  pad(body);
+  header.KeysOffset = body.size();
+  body.append(reinterpret_cast<const char *>(key_offsets.data()),
+    4*key_offsets.size());
+  header.KeyTextOffset = body.size();
+  body += key_texts;
+  header.FileSize = body.size();
+  std::memcpy(&body[0], &header, sizeof(header));
+
+  return ReplaceFileContents(file_name, body);
+}
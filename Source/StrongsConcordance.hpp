@@ -0,0 +1,72 @@
+// Machaira: StrongsConcordance.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the Strong's number concordance of a tagged Bible: for every
+// Hebrew and Greek number, the verses it occurs in and the words it is
+// translated by, in a memory-mapped file indexed directly by number
+// Current version: Pre-release
+
+#ifndef STRONGSCONCORDANCE_HPP
+#define STRONGSCONCORDANCE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <swmodule.h>
+
+#include "MappedFile.hpp"
+
+struct StrongsWord
+{
+  std::string Text;
+  uint32_t Count;
+};
+
+struct StrongsOccurrences
+{
+  // Tagged words, and the verses holding them (in verse order)
+  uint32_t Occurrences = 0;
+  uint32_t VerseCount = 0;
+  std::vector<std::string> Verses;
+  // Surface words, most frequent first
+  std::vector<StrongsWord> Words;
+};
+
+// Slot of one Strong's number (defined with the file layout)
+struct StrongsSlot;
+
+class StrongsConcordance
+{
+  public:
+    // Constructor
+    StrongsConcordance();
+    bool Open(std::string file_name);
+    std::string GetStamp();
+    // testament is 'H' or 'G'; at most max_verses verse keys are returned
+    bool Lookup(char testament, uint32_t number, StrongsOccurrences & result,
+      size_t max_verses = SIZE_MAX);
+    bool Lookup(std::string strongs_number, StrongsOccurrences & result,
+      size_t max_verses = SIZE_MAX);
+  private:
+    MappedFile file;
+    uint32_t entry_count;
+    uint32_t hebrew_count;
+    uint32_t greek_count;
+    const StrongsSlot * slots;
+    const char * data;
+    const uint32_t * keys;
+    const char * key_text;
+    const char * stamp;
+    uint32_t stamp_length;
+};
+
+// Parses "H07225", "strong:G3056", "g3056" and the like (letter suffixes
+// such as "H1254a" fold into the number)
+bool ParseStrongsNumber(std::string text, char & testament, uint32_t & number);
+// True when the module carries Strong's numbers
+bool HasStrongsNumbers(sword::SWModule * module);
+// Writes a module's concordance file (to a temporary name, then renamed)
+bool BuildStrongsConcordance(sword::SWModule * module, std::string stamp,
+  std::string file_name);
+
+#endif
@@ -7,37 +7,78 @@
 // Current version: Pre-release
 
 #include "SwordBackend.hpp"
+#include "HtmlPostProcess.hpp"
+#include "SwordReader.hpp"
+#include "Trace.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <ctime>
+#include <cctype>
+#include <algorithm>
 
 #include <swversion.h>
 #include <filemgr.h>
 #include <markupfiltmgr.h>
-#include <swoptfilter.h>
+#include <versekey.h>
+#include <listkey.h>
+
+SwordBackendSettings::SwordBackendSettings()
+{
+  LibraryDir = "./Res/.sword";
+  InstallDir = "./Res/.sword/InstallMgr";
+  DefaultSource = "CrossWire";
+  CatalogMaxAgeHours = 24;
+  InstallJobs = 4;
+  MaxOpenModules = 32;
+  MaxResidentMB = 0;
+}
 
 SwordBackend::SwordBackend() :
-  library_mgr("./Res/.sword", true, new sword::MarkupFilterMgr(sword::FMT_XHTML)),
-  install_mgr("./Res/.sword/InstallMgr")
+  library_mgr("./Res/.sword", new sword::MarkupFilterMgr(sword::FMT_XHTML)),
+  verse_stores("./Res/.sword"),
+  lexicon_cache(4*1024*1024),
+  install_mgr("./Res/.sword/InstallMgr", &install_status)
 {
   library_dir = "./Res/.sword";
   install_manager_dir = "./Res/.sword/InstallMgr";
   default_source = "CrossWire";
+  catalog_max_age = 24*3600;
+  install_jobs = 4;
+  remote_catalog = std::make_shared<const CatalogIndex>();
+  search_index.SetIndexDir(library_dir + "/machaira-index");
+  InitializeStaging();
+  ResidencyLimits limits;
+  limits.MaxModules = 32;
+  library_mgr.SetResidencyLimits(limits);
 
   InitializeInstaller();
   InitializeLibrary();
 }
 
 SwordBackend::SwordBackend(SwordBackendSettings settings) :
-  library_mgr(settings.LibraryDir.c_str(), true,
-    new sword::MarkupFilterMgr(sword::FMT_XHTML)),
-  install_mgr(settings.InstallDir.c_str())
+  library_mgr(settings.LibraryDir, new sword::MarkupFilterMgr(sword::FMT_XHTML)),
+  verse_stores(settings.LibraryDir),
+  lexicon_cache(4*1024*1024),
+  install_mgr(settings.InstallDir.c_str(), &install_status)
 {
   library_dir = settings.LibraryDir;
   install_manager_dir = settings.InstallDir;
   default_source = settings.DefaultSource;
+  catalog_max_age = int64_t(settings.CatalogMaxAgeHours)*3600;
+  install_jobs = settings.InstallJobs;
+  remote_catalog = std::make_shared<const CatalogIndex>();
+  search_index.SetIndexDir(library_dir + "/machaira-index");
+  InitializeStaging();
+  ResidencyLimits limits;
+  limits.MaxModules = settings.MaxOpenModules;
+  limits.MaxResidentBytes = settings.MaxResidentMB*1024*1024;
+  library_mgr.SetResidencyLimits(limits);
 
   InitializeInstaller();
   InitializeLibrary();
@@ -102,6 +143,17 @@ void SwordBackend::AddRemoteSourcesCSV(std::string csv_file_name)
     // Save and re-read soucre list from config file
     install_mgr.saveInstallConf();
     install_mgr.readInstallConf();
+    install_mgr.ReadDirSources();
+  }
+}
+
+void SwordBackend::AddLocalSource(std::string src_name, std::string path)
+{
+  install_mgr.AddDirSource(src_name, path);
+  remote_sources.clear();
+  for(const auto & [key, value] : install_mgr.sources)
+  {
+    remote_sources.push_back(std::string(key));
   }
 }
 
@@ -120,8 +172,11 @@ void SwordBackend::InitializeInstaller()
   }
 }
 
-void SwordBackend::SelectRemoteSource(std::string src_name)
+bool SwordBackend::SelectRemoteSource(std::string src_name, bool force)
 {
+  std::lock_guard<std::mutex> installer_lock(installer_mutex);
+  install_mgr.ResetCancel();
+  install_status.Reset();
   if(src_name == "") selected_source = default_source;
   else selected_source = src_name;
   sword::InstallSourceMap::iterator source =
@@ -129,21 +184,99 @@ void SwordBackend::SelectRemoteSource(std::string src_name)
   if(source == install_mgr.sources.end())
   {
     std::cout << "Error: Couldn't find remote source " << selected_source << '\n';
+    return false;
+  }
+  std::cout << "Found source " << selected_source << '\n';
+  sword::InstallSource * is = source->second;
+
+  // Serve the cached catalog first; it stays in place if the refresh fails
+  std::string cache_file = RemoteCatalogFile(selected_source);
+  SourceCatalog cached;
+  bool have_cache = ReadSourceCatalog(cache_file, cached) &&
+    cached.Source == selected_source;
+  if(have_cache) PublishRemoteCatalog(cached);
+
+  // Directory sources are cheap to check, so they are fetched again only
+  // when their configs changed; remote sources once the cache is too old
+  std::string source_validator;
+  bool stale = !have_cache;
+  if(DirInstallMgr::IsDirSource(is))
+  {
+    source_validator = DirSourceValidator(is->directory.c_str());
+    if(source_validator != cached.SourceValidator) stale = true;
   }
-  else
+  else if(int64_t(std::time(0)) - cached.FetchTime > catalog_max_age) stale = true;
+  if(!stale && !force)
   {
-    std::cout << "Found source " << selected_source << '\n';
-    if(!install_mgr.refreshRemoteSource(source->second))
+    std::cout << "Using cached catalog of " << selected_source << '\n';
+    return true;
+  }
+
+  if(install_mgr.refreshRemoteSource(is))
+  {
+    std::cout << "Error refreshing remote source " << selected_source << "\n";
+    return false;
+  }
+  std::cout << "Remote source " << selected_source << " refreshed\n";
+
+  // Build the new catalog aside and swap it in, so readers never see it
+  // half filled; an unchanged catalog only gets its fetch time updated
+  SourceCatalog catalog;
+  catalog.Source = selected_source;
+  catalog.FetchTime = std::time(0);
+  catalog.SourceValidator = source_validator;
+  catalog.ContentValidator = CatalogContentValidator(
+    std::string(is->localShadow.c_str()) + "/mods.d");
+  catalog.Downloaded = true;
+  if(have_cache && catalog.ContentValidator == cached.ContentValidator)
+  {
+    catalog.Modules.swap(cached.Modules);
+  }
+  else BuildRemoteCatalog(is, catalog);
+  WriteSourceCatalog(cache_file, catalog);
+  PublishRemoteCatalog(std::move(catalog));
+  return true;
+}
+
+bool SwordBackend::LoadCachedSourceCatalog(std::string src_name)
+{
+  SourceCatalog cached;
+  if(!ReadSourceCatalog(RemoteCatalogFile(src_name), cached) ||
+    cached.Source != src_name)
+  {
+    return false;
+  }
+  PublishRemoteCatalog(std::move(cached));
+  return true;
+}
+
+void SwordBackend::PublishRemoteCatalog(SourceCatalog catalog)
+{
+  {
+    // The cache the UI already listed is not indexed a second time
+    std::lock_guard<std::mutex> catalog_lock(catalog_mutex);
+    const SourceCatalog & current = remote_catalog->GetCatalog();
+    if(!catalog.Downloaded && current.Source == catalog.Source &&
+      current.FetchTime == catalog.FetchTime &&
+      current.ContentValidator == catalog.ContentValidator)
     {
-      std::cout << "Remote source " << selected_source << " refreshed\n";
+      return;
     }
-    else std::cout << "Error refreshing remote source " << selected_source << "\n";
   }
+  // The index is built outside the lock; readers keep the old one until
+  // the pointer is swapped
+  std::shared_ptr<const CatalogIndex> index =
+    std::make_shared<const CatalogIndex>(std::move(catalog));
+  std::lock_guard<std::mutex> catalog_lock(catalog_mutex);
+  remote_catalog.swap(index);
+}
 
-  remote_module_info_list.clear();
-  sword::ModMap::iterator list_it = source->second->getMgr()->Modules.begin();
-  sword::ModMap::iterator list_end = source->second->getMgr()->Modules.end();
-  for(list_it; list_it != list_end; list_it++)
+void SwordBackend::BuildRemoteCatalog(sword::InstallSource * is,
+  SourceCatalog & catalog)
+{
+  sword::ModMap::iterator list_it = is->getMgr()->Modules.begin();
+  sword::ModMap::iterator list_end = is->getMgr()->Modules.end();
+  for(; list_it != list_end; list_it++)
   {
     SwordModuleInfo temp_module;
   	sword::SWModule * module = (*list_it).second;
@@ -153,147 +286,781 @@ void SwordBackend::SelectRemoteSource(std::string src_name)
     temp_module.Description = module->getDescription();
     if(module->getConfigEntry("Version") == 0) temp_module.Version = "NA";
     else temp_module.Version = module->getConfigEntry("Version");
-    remote_module_info_list.push_back(temp_module);
+    catalog.Modules.push_back(temp_module);
   }
 }
 
-std::vector<SwordModuleInfo> SwordBackend::GetRemoteSourceModules()
+std::string SwordBackend::RemoteCatalogFile(std::string src_name)
+{
+  for(char & c : src_name) if(!isalnum(static_cast<unsigned char>(c))) c = '_';
+  return install_manager_dir + "/catalogs/" + src_name + ".mxr";
+}
+
+std::shared_ptr<const CatalogIndex> SwordBackend::GetRemoteCatalog()
 {
-  return remote_module_info_list;
+  std::lock_guard<std::mutex> catalog_lock(catalog_mutex);
+  return remote_catalog;
 }
 
 void SwordBackend::InstallRemoteModule(std::string mod_name)
 {
+  if(DownloadRemoteModule(mod_name))
+  {
+    RegisterInstalledModules(std::vector<std::string>(1, mod_name));
+    UpdateSearchIndex();
+  }
+}
+
+void SwordBackend::InstallRemoteModules(std::vector<std::string> mod_names,
+  int jobs)
+{
+  std::vector<std::string> installed;
+  DownloadRemoteModules(mod_names, installed, jobs);
+  if(installed.size() > 0)
+  {
+    RegisterInstalledModules(installed);
+    UpdateSearchIndex();
+  }
+}
+
+bool SwordBackend::DownloadRemoteModule(std::string mod_name)
+{
+  std::lock_guard<std::mutex> installer_lock(installer_mutex);
+  install_mgr.ResetCancel();
+  install_mgr.ResetTransferStats();
+  install_status.Reset();
   sword::InstallSourceMap::iterator source =
     install_mgr.sources.find(selected_source.c_str());
   if(source == install_mgr.sources.end())
   {
     std::cout << "Error: Couldn't find selected remote source " <<
       selected_source << '\n';
+    return false;
   }
   else std::cout << "Found source " << selected_source << '\n';
 
   sword::InstallSource * is = source->second;
   sword::SWModule * module = is->getMgr()->getModule(mod_name.c_str());
+  if(!module && !install_mgr.refreshRemoteSource(is))
+  {
+    // The catalog was served from the cache but the fetched configs are
+    // gone (or out of date), so fetch them before giving up
+    module = is->getMgr()->getModule(mod_name.c_str());
+  }
   if (!module) {
     std::cout << "Remote source " << selected_source <<
       " does not make available module [" << mod_name << "]\n";
+    return false;
   }
 
-  int error = install_mgr.installModule(&library_mgr, 0, module->getName(), is);
+  // Files go to the module's staging library, so the loaded modules keep
+  // rendering the installed copy until RegisterInstalledModules
+  std::unique_ptr<sword::SWMgr> staging(CreateStagingMgr(module->getName()));
+  int error = install_mgr.installModule(staging.get(), 0, module->getName(), is);
+  transfer_stats = install_mgr.GetTransferStats();
   if(error)
   {
+    DiscardStagedModule(module->getName());
     std::cout << "\nError installing module: [" << module->getName() <<
       "] (write permissions?)\n";
+    return false;
   }
-  else
+  std::cout << "\nInstalled module: [" << module->getName() << "]\n";
+  return true;
+}
+
+bool SwordBackend::DownloadRemoteModules(std::vector<std::string> mod_names,
+  std::vector<std::string> & installed, int jobs)
+{
+  installed.clear();
+  if(mod_names.size() == 1)
+  {
+    // One module keeps the byte-level progress of a single transfer
+    if(!DownloadRemoteModule(mod_names[0])) return false;
+    installed.push_back(mod_names[0]);
+    return true;
+  }
+  std::string src_name;
   {
-    std::cout << "\nInstalled module: [" << module->getName() << "]\n";
-    library_mgr.augmentModules(library_dir.c_str());
+    std::lock_guard<std::mutex> installer_lock(installer_mutex);
+    src_name = selected_source;
   }
+  return DownloadFromSource(src_name, mod_names, installed, jobs);
 }
 
-void SwordBackend::InitializeLibrary()
+std::vector<ModuleUpdate> SwordBackend::CheckForUpdates()
 {
-  if(!library_mgr.config) std::cout << "Warning: SWORD configuration not found.\n";
+  // One pass over every source's cached catalog, keeping the newest
+  // version of each module; nothing is fetched
+  std::map<std::string, ModuleUpdate> newest;
+  for(const std::string & src_name : remote_sources)
+  {
+    SourceCatalog catalog;
+    if(!ReadSourceCatalog(RemoteCatalogFile(src_name), catalog) ||
+      catalog.Source != src_name)
+    {
+      continue;
+    }
+    for(const SwordModuleInfo & module : catalog.Modules)
+    {
+      if(module.Version == "NA") continue;
+      std::map<std::string, ModuleUpdate>::iterator it =
+        newest.find(module.Name);
+      if(it != newest.end() && !(sword::SWVersion(module.Version.c_str()) >
+        sword::SWVersion(it->second.AvailableVersion.c_str())))
+      {
+        continue;
+      }
+      ModuleUpdate & update = newest[module.Name];
+      update.Name = module.Name;
+      update.Source = src_name;
+      update.AvailableVersion = module.Version;
+    }
+  }
 
-  biblical_texts.clear();
-  commentaries.clear();
-  dictionaries.clear();
+  // Modules without a Version entry count as 1.0, as in SWORD
+  std::vector<ModuleUpdate> updates;
+  for(const CatalogModule & module : library_mgr.GetCatalog())
+  {
+    std::map<std::string, ModuleUpdate>::iterator it = newest.find(module.Name);
+    if(it == newest.end()) continue;
+    std::string installed = module.Version != "" ? module.Version : "1.0";
+    if(sword::SWVersion(it->second.AvailableVersion.c_str()) >
+      sword::SWVersion(installed.c_str()))
+    {
+      it->second.InstalledVersion = installed;
+      updates.push_back(it->second);
+    }
+  }
+  return updates;
+}
 
-  sword::ModMap::iterator modIterator;
-  for(modIterator = library_mgr.Modules.begin();
-    modIterator != library_mgr.Modules.end(); modIterator++)
+bool SwordBackend::DownloadModuleUpdates(
+  const std::vector<ModuleUpdate> & updates,
+  std::vector<std::string> & updated, int jobs)
+{
+  // Grouped by source; each group is a batch install over the installed
+  // files, which only copies the files that changed
+  std::map<std::string, std::vector<std::string>> by_source;
+  for(const ModuleUpdate & update : updates)
   {
-    sword::SWModule * module = (*modIterator).second;
-    // Assign module to group
-    if(std::string(module->Type()) == "Biblical Texts")
+    by_source[update.Source].push_back(update.Name);
+  }
+  updated.clear();
+  TransferStats totals;
+  for(const auto & [src_name, names] : by_source)
+  {
+    std::vector<std::string> installed;
+    DownloadFromSource(src_name, names, installed, jobs);
+    updated.insert(updated.end(), installed.begin(), installed.end());
+    TransferStats stats = GetTransferStats();
+    totals.FilesCopied += stats.FilesCopied;
+    totals.FilesSkipped += stats.FilesSkipped;
+    totals.BytesCopied += stats.BytesCopied;
+    totals.BytesSkipped += stats.BytesSkipped;
+  }
+  std::lock_guard<std::mutex> installer_lock(installer_mutex);
+  transfer_stats = totals;
+  return updated.size() == updates.size();
+}
+
+void SwordBackend::UpdateModules(int jobs)
+{
+  std::vector<std::string> updated;
+  DownloadModuleUpdates(CheckForUpdates(), updated, jobs);
+  if(updated.size() > 0)
+  {
+    RegisterInstalledModules(updated);
+    UpdateSearchIndex();
+  }
+}
+
+TransferStats SwordBackend::GetTransferStats()
+{
+  std::lock_guard<std::mutex> installer_lock(installer_mutex);
+  return transfer_stats;
+}
+
+bool SwordBackend::DownloadFromSource(std::string src_name,
+  std::vector<std::string> mod_names, std::vector<std::string> & installed,
+  int jobs)
+{
+  installed.clear();
+  std::lock_guard<std::mutex> installer_lock(installer_mutex);
+  install_mgr.ResetCancel();
+  install_status.Reset();
+  transfer_stats = TransferStats();
+  sword::InstallSourceMap::iterator source =
+    install_mgr.sources.find(src_name.c_str());
+  if(source == install_mgr.sources.end())
+  {
+    std::cout << "Error: Couldn't find remote source " << src_name << '\n';
+    return false;
+  }
+  sword::InstallSource * is = source->second;
+  std::vector<std::string> names;
+  bool refreshed = false;
+  for(const std::string & mod_name : mod_names)
+  {
+    sword::SWModule * module = is->getMgr()->getModule(mod_name.c_str());
+    if(!module && !refreshed)
     {
-      biblical_texts.push_back(module->Name());
+      // The cached catalog's configs are fetched again, once for the batch
+      refreshed = true;
+      if(!install_mgr.refreshRemoteSource(is))
+      {
+        module = is->getMgr()->getModule(mod_name.c_str());
+      }
     }
-    else if(std::string(module->Type()) == "Commentaries")
+    if(!module)
     {
-      commentaries.push_back(module->Name());
+      std::cout << "Remote source " << src_name <<
+        " does not make available module [" << mod_name << "]\n";
+      continue;
     }
-    else if(std::string(module->Type()) == "Lexicons / Dictionaries")
+    names.push_back(module->getName());
+  }
+  if(names.empty()) return false;
+
+  // Each transfer has an install manager of its own, and each module a
+  // staging library, created here because SWORD's shared state is not safe
+  // to set up from several threads
+  std::vector<std::unique_ptr<sword::SWMgr>> staging;
+  for(const std::string & name : names)
+  {
+    staging.emplace_back(CreateStagingMgr(name));
+  }
+  if(jobs <= 0) jobs = install_jobs;
+  size_t workers = std::min(size_t(std::max(jobs, 1)), names.size());
+  std::vector<std::unique_ptr<DirInstallMgr>> mgrs;
+  {
+    std::lock_guard<std::mutex> batch_lock(batch_mutex);
+    for(size_t w = 0; w < workers; w++)
+    {
+      mgrs.emplace_back(new DirInstallMgr(install_manager_dir.c_str()));
+      mgrs.back()->setUserDisclaimerConfirmed(true);
+      mgrs.back()->SetInstalledLibrary(library_dir);
+      batch_install_mgrs.push_back(mgrs.back().get());
+    }
+  }
+  std::vector<char> succeeded(names.size(), 0);
+  std::atomic<size_t> next(0);
+  std::mutex progress_mutex;
+  unsigned long finished = 0;
+  std::vector<std::thread> threads;
+  for(size_t w = 0; w < workers; w++)
+  {
+    threads.emplace_back([&, w]()
+    {
+      DirInstallMgr & mgr = *mgrs[w];
+      sword::InstallSourceMap::iterator worker_source =
+        mgr.sources.find(src_name.c_str());
+      size_t n;
+      while(worker_source != mgr.sources.end() &&
+        !install_mgr.IsCancelled() && (n = next++) < names.size())
+      {
+        int error = mgr.installModule(staging[n].get(), 0, names[n].c_str(),
+          worker_source->second);
+        succeeded[n] = !error;
+        if(error) DiscardStagedModule(names[n]);
+        std::lock_guard<std::mutex> progress_lock(progress_mutex);
+        finished++;
+        if(error)
+        {
+          std::cout << "Error installing module: [" << names[n] <<
+            "] (write permissions?)\n";
+        }
+        else std::cout << "Installed module: [" << names[n] << "]\n";
+        install_status.Report(names.size(), finished,
+          (error ? "Couldn't install " : "Installed ") + names[n] + " (" +
+          std::to_string(finished) + " of " + std::to_string(names.size()) +
+          ")");
+      }
+    });
+  }
+  for(std::thread & thread : threads) thread.join();
+  {
+    std::lock_guard<std::mutex> batch_lock(batch_mutex);
+    batch_install_mgrs.clear();
+  }
+  for(const std::unique_ptr<DirInstallMgr> & mgr : mgrs)
+  {
+    TransferStats stats = mgr->GetTransferStats();
+    transfer_stats.FilesCopied += stats.FilesCopied;
+    transfer_stats.FilesSkipped += stats.FilesSkipped;
+    transfer_stats.BytesCopied += stats.BytesCopied;
+    transfer_stats.BytesSkipped += stats.BytesSkipped;
+  }
+  for(size_t n = 0; n < names.size(); n++)
+  {
+    if(succeeded[n]) installed.push_back(names[n]);
+  }
+  return installed.size() == mod_names.size();
+}
+
+void SwordBackend::RegisterInstalledModules(std::vector<std::string> mod_names)
+{
+  // The downloaded files replace the installed copies only now, with the
+  // modules closed; the workers' readers are reloaded below
+  CommitStagedModules(mod_names);
+  std::vector<CatalogModule> registered;
+  if(mod_names.empty() || !library_mgr.RegisterModules(mod_names, registered))
+  {
+    // Only the new and changed module configs are parsed again
+    InitializeLibrary();
+    if(library_changed) library_changed();
+    return;
+  }
+  // Reinstalled modules may have pages of their old version cached
+  bool replaced = false;
+  for(const CatalogModule & module : registered)
+  {
+    for(const std::vector<std::string> * group :
+      {&biblical_texts, &commentaries, &dictionaries})
+    {
+      if(std::find(group->begin(), group->end(), module.Name) != group->end())
+      {
+        replaced = true;
+      }
+    }
+  }
+  if(replaced)
+  {
+    render_cache.Clear();
+    verse_stores.Clear();
+    token_cache.Clear();
+    lexicon_cache.Clear();
+  }
+  ListModules();
+  if(library_changed) library_changed();
+}
+
+void SwordBackend::InitializeStaging()
+{
+  // Beside the library, so staged files are moved in by renaming; modules
+  // left from an earlier run were never registered, and are dropped
+  staging_dir = library_dir + "/machaira-staging";
+  std::error_code error;
+  std::filesystem::remove_all(staging_dir, error);
+  install_mgr.SetInstalledLibrary(library_dir);
+}
+
+sword::SWMgr * SwordBackend::CreateStagingMgr(std::string mod_name)
+{
+  std::string dir = staging_dir + "/" + mod_name;
+  std::error_code error;
+  std::filesystem::remove_all(dir, error);
+  std::filesystem::create_directories(dir + "/mods.d", error);
+  return new sword::SWMgr(dir.c_str(), false);
+}
+
+void SwordBackend::DiscardStagedModule(std::string mod_name)
+{
+  std::error_code error;
+  std::filesystem::remove_all(staging_dir + "/" + mod_name, error);
+}
+
+void SwordBackend::CommitStagedModules(std::vector<std::string> mod_names)
+{
+  namespace fs = std::filesystem;
+  std::error_code error;
+  if(mod_names.empty())
+  {
+    for(const auto & entry : fs::directory_iterator(staging_dir, error))
     {
-      dictionaries.push_back(module->Name());
+      if(entry.is_directory()) mod_names.push_back(entry.path().filename().string());
     }
-    else std::cout << "Module " << module->Name() << " not included in app.\n";
-    // Set default options for modules
-    for(sword::OptionFilterList::const_iterator it =
-      module->getOptionFilters().begin();
-      it != module->getOptionFilters().end(); ++it)
+  }
+  for(const std::string & mod_name : mod_names)
+  {
+    fs::path staged = fs::path(staging_dir) / mod_name;
+    if(!fs::is_directory(staged, error)) continue;
+    library_mgr.CloseModule(mod_name);
+    // Renamed over the installed files, so a reader that still has one
+    // open keeps reading the old copy until it is reloaded
+    for(const auto & entry : fs::recursive_directory_iterator(staged, error))
     {
-      if((std::string((*it)->getOptionName()) == "Strong's Numbers") &&
-        (std::string(module->Type()) == "Biblical Texts"))
+      if(!entry.is_regular_file()) continue;
+      fs::path target = fs::path(library_dir) /
+        fs::relative(entry.path(), staged);
+      fs::create_directories(target.parent_path(), error);
+      fs::rename(entry.path(), target, error);
+      if(error)
       {
-        (*it)->setOptionValue("On");
+        fs::copy_file(entry.path(), target,
+          fs::copy_options::overwrite_existing, error);
+      }
+      if(error)
+      {
+        std::cout << "Error moving " << target << " into the library: " <<
+          error.message() << '\n';
       }
-      else (*it)->setOptionValue("Off");
     }
+    fs::remove_all(staged, error);
+  }
+}
+
+void SwordBackend::SetInstallProgressCallback(
+  std::function<void(const InstallProgress &)> callback)
+{
+  install_status.SetCallback(callback);
+}
+
+void SwordBackend::CancelInstallerOperation()
+{
+  install_mgr.terminate();
+  std::lock_guard<std::mutex> batch_lock(batch_mutex);
+  for(DirInstallMgr * mgr : batch_install_mgrs) mgr->terminate();
+}
+
+void SwordBackend::InitializeLibrary()
+{
+  render_cache.Clear();
+  verse_stores.Clear();
+  token_cache.Clear();
+  lexicon_cache.Clear();
+
+  // Modules are classified from the catalog snapshot; they are opened (and
+  // given their default options) when first used
+  library_mgr.LoadCatalog();
+  if(!library_mgr.config) std::cout << "Warning: SWORD configuration not found.\n";
+  ListModules();
+  LibraryLoadStats stats = library_mgr.GetLoadStats();
+  std::cout << "Library loaded in " << stats.Milliseconds << " ms (" <<
+    stats.ConfsParsed << " configs parsed, " << stats.ModulesOpened <<
+    " modules opened)\n";
+}
+
+void SwordBackend::ListModules()
+{
+  biblical_texts.clear();
+  commentaries.clear();
+  dictionaries.clear();
+  for(const CatalogModule & module : library_mgr.GetCatalog())
+  {
+    // Assign module to group
+    if(module.Type == "Biblical Texts") biblical_texts.push_back(module.Name);
+    else if(module.Type == "Commentaries") commentaries.push_back(module.Name);
+    else if(module.Type == "Lexicons / Dictionaries")
+    {
+      dictionaries.push_back(module.Name);
+    }
+    else std::cout << "Module " << module.Name << " not included in app.\n";
   }
 }
 
 std::string SwordBackend::GetText(std::string key, std::string mod_name)
 {
-  std::stringstream ss;
+  TRACE_SCOPE("backend.GetText");
+  LibraryMgr::ModuleScope scope(library_mgr);
   // Get text from SWORD (raw data)
   sword::SWKey myKey(key.c_str());
-  sword::SWModule * module = library_mgr.getModule(mod_name.c_str());
+  sword::SWModule * module = library_mgr.GetModule(mod_name);
   module->setKey(myKey);
-  std::string input(module->renderText());
+  if(UsesVerseTokens(module))
+  {
+    std::string output;
+    RenderEntry(module, output);
+    return output;
+  }
+  ApplyDisplayOptions(module, display_options);
+  // Verses of modules with a current store are read from the mapped file
+  const char * stored_text;
+  size_t stored_length;
+  if(verse_stores.GetCurrentEntry(module, stored_text, stored_length))
+  {
+    TRACE_COUNT("verse_store.hits", 1);
+    return std::string(stored_text, stored_length);
+  }
+  // Serve passages that were already rendered from the cache
+  std::string cache_key = RenderCacheKey(module);
+  std::string cached_text;
+  if(render_cache.Get(cache_key, cached_text))
+  {
+    TRACE_COUNT("render_cache.hits", 1);
+    return cached_text;
+  }
+  TRACE_COUNT("render_cache.misses", 1);
+  std::string input;
+  {
+    TRACE_SCOPE("sword.renderText");
+    input.assign(module->renderText());
+  }
   // Convert all non-ASCII characters to HTML entities (hexadecimal format)
-  std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> ucs4conv;
-  std::u32string ucs4 = ucs4conv.from_bytes(input);
-  for(char32_t c : ucs4)
+  // and condense links, in one pass
+  std::string output = PostProcessHtml(input);
+
+  render_cache.Put(cache_key, output);
+  return output;
+}
+
+std::string SwordBackend::GetPassage(std::string ref, std::string mod_name)
+{
+  TRACE_SCOPE("backend.GetPassage");
+  LibraryMgr::ModuleScope scope(library_mgr);
+  sword::SWModule * module = library_mgr.GetModule(mod_name);
+  sword::ListKey passage;
+  if(!module || !ParsePassage(module, ref, passage))
   {
-    if(static_cast<uint32_t>(c) <= static_cast<uint32_t>(0x7e)) ss << char(c);
-    else
-    {
-      ss << "&#x" << std::hex << std::setw(4) << std::setfill('0')
-        << static_cast<uint32_t>(c) << '\n';
-    }
+    return GetText(ref, mod_name);
+  }
+  auto render_entry = [this](sword::SWModule * verse_module,
+    std::string & verse_html)
+  {
+    RenderEntry(verse_module, verse_html);
+  };
+  std::string output;
+  // Pages emitted from tokens are cheap to build again, so they are not
+  // cached under every combination of options
+  if(UsesVerseTokens(module))
+  {
+    RenderPassage(module, passage, output, render_entry);
+    return output;
+  }
+  ApplyDisplayOptions(module, display_options);
+  std::string cache_key = RenderCacheKey(module, passage.getRangeText());
+  if(render_cache.Get(cache_key, output))
+  {
+    TRACE_COUNT("render_cache.hits", 1);
+    return output;
+  }
+  TRACE_COUNT("render_cache.misses", 1);
+  RenderPassage(module, passage, output, render_entry);
+  render_cache.Put(cache_key, output);
+  return output;
+}
+
+bool SwordBackend::UsesVerseTokens(sword::SWModule * module)
+{
+  // The default options keep the rendering every store and cache entry was
+  // made with
+  return !display_options.IsDefault() && HasVerseTokens(module);
+}
+
+void SwordBackend::RenderEntry(sword::SWModule * module, std::string & output)
+{
+  if(UsesVerseTokens(module))
+  {
+    EmitVerseHtml(token_cache.Get(module), display_options, output);
+    return;
+  }
+  const char * stored_text;
+  size_t stored_length;
+  if(verse_stores.GetCurrentEntry(module, stored_text, stored_length))
+  {
+    TRACE_COUNT("verse_store.hits", 1);
+    output.assign(stored_text, stored_length);
+    return;
   }
-  input = ss.str();
-  ss.clear();
-  ss.str("");
-  // Condense links
-  size_t a_begin = 0, a_end, p1, p2;
-  while(input.find("<a", a_begin) != std::string::npos)
+  std::string input;
   {
-    a_begin = input.find("<a", a_begin);
-    a_end = input.find("</a>", a_begin); a_end += 4;
-    std::string link = input.substr(a_begin, a_end-a_begin);
+    TRACE_SCOPE("sword.renderText");
+    input.assign(module->renderText());
+  }
+  PostProcessHtml(input, output);
+}
 
-    p1 = link.find("action=", 0); p1 += 7;
-    p2 = link.find('&', p1);
-    std::string l_action = link.substr(p1, p2-p1);
+ReferenceParser & SwordBackend::GetReferenceParser(std::string mod_name)
+{
+  std::string versification("KJV");
+  LibraryMgr::ModuleScope scope(library_mgr);
+  sword::SWModule * module = library_mgr.GetModule(mod_name);
+  sword::VerseKey * key =
+    module ? dynamic_cast<sword::VerseKey *>(module->getKey()) : 0;
+  if(key) versification = key->getVersificationSystem();
+  std::unique_ptr<ReferenceParser> & parser = reference_parsers[versification];
+  if(!parser) parser.reset(new ReferenceParser(versification));
+  return *parser;
+}
 
-    p1 = link.find("type=", 0); p1 += 5;
-    p2 = link.find('&', p1);
-    std::string l_type = link.substr(p1, p2-p1);
+ParsedReference SwordBackend::ParseReference(std::string text,
+  std::string mod_name)
+{
+  return GetReferenceParser(mod_name).Parse(text);
+}
 
-    p1 = link.find("value=", 0); p1 += 6;
-    p2 = std::min(link.find('\"', p1), link.find('&', p1));
-    std::string l_val = link.substr(p1, p2-p1);
+std::vector<std::string> SwordBackend::SuggestReferences(std::string text,
+  std::string mod_name, size_t max_suggestions)
+{
+  return GetReferenceParser(mod_name).Suggest(text, max_suggestions);
+}
 
-    p1 = link.find('>', 0); p1 += 1;
-    p2 = link.find('<', p1);
-    std::string l_text = link.substr(p1, p2-p1);
+ReferenceParserStats SwordBackend::GetReferenceParserStats()
+{
+  ReferenceParserStats total;
+  for(auto & parser : reference_parsers)
+  {
+    ReferenceParserStats stats = parser.second->GetStats();
+    total.Suggestions += stats.Suggestions;
+    total.Incremental += stats.Incremental;
+    total.OverBudget += stats.OverBudget;
+  }
+  return total;
+}
 
-    ss << "<a href=\"" << l_action << '_' << l_type << '_' << l_val << "\">"
-      << l_text << "</a>";
+bool SwordBackend::ExportVerseStore(std::string mod_name)
+{
+  SwordReader reader(library_dir);
+  sword::SWModule * module = reader.GetModule(mod_name);
+  if(!module)
+  {
+    std::cout << "Error: Couldn't find module " << mod_name << '\n';
+    return false;
+  }
+  return BuildVerseStore(module, ModuleIndexStamp(library_dir, module),
+    VerseStoreFile(library_dir, mod_name));
+}
+
+bool SwordBackend::ExportModules(ExportOptions options, ExportStats & stats,
+  ExportProgress progress)
+{
+  if(options.Modules.empty())
+  {
+    options.Modules = biblical_texts;
+    options.Modules.insert(options.Modules.end(), commentaries.begin(),
+      commentaries.end());
+  }
+  ModuleExporter exporter(library_dir, options);
+  return exporter.Run(stats, progress);
+}
+
+int SwordBackend::UpdateSearchIndex(int jobs, bool rebuild,
+  const std::function<bool()> & cancelled)
+{
+  // Only modules that are new or changed since their index was written are
+  // tokenized again
+  return search_index.Update(library_dir, jobs, rebuild, cancelled);
+}
+
+bool SwordBackend::Search(std::string query,
+  std::function<bool(const SearchHit &)> on_hit, std::string & error,
+  std::vector<std::string> mod_names)
+{
+  return search_index.Search(query, mod_names, on_hit, error);
+}
 
-    input.erase(a_begin, a_end-a_begin);
-    input.insert(a_begin, ss.str());
+bool SwordBackend::GetStrongsOccurrences(std::string mod_name,
+  std::string strongs_number, StrongsOccurrences & result, size_t max_verses)
+{
+  // Answered from the precomputed concordance; the text is never rescanned
+  return search_index.LookupStrongs(mod_name, strongs_number, result,
+    max_verses);
+}
 
-    a_begin += ss.str().length();
-    ss.clear();
-    ss.str("");
+std::string SwordBackend::GetStrongsLexicon(char testament)
+{
+  const char * feature = (testament == 'H') ? "HebrewDef" : "GreekDef";
+  std::string preferred = (testament == 'H') ? "StrongsHebrew" : "StrongsGreek";
+  std::string found;
+  for(const CatalogModule & module : library_mgr.GetCatalog())
+  {
+    if(module.Type != "Lexicons / Dictionaries") continue;
+    if(module.Name == preferred) return preferred;
+    if(found == "" && std::find(module.Features.begin(), module.Features.end(),
+      feature) != module.Features.end())
+    {
+      found = module.Name;
+    }
+  }
+  return found;
+}
+
+bool SwordBackend::GetLexiconEntry(std::string mod_name, std::string key,
+  std::string & html)
+{
+  TRACE_SCOPE("backend.GetLexiconEntry");
+  LibraryMgr::ModuleScope scope(library_mgr);
+  std::string cache_key = mod_name + '\x1f' + FoldLexiconKey(key);
+  if(lexicon_cache.Get(cache_key, html))
+  {
+    TRACE_COUNT("lexicon_cache.hits", 1);
+    return true;
+  }
+  TRACE_COUNT("lexicon_cache.misses", 1);
+  sword::SWModule * module = library_mgr.GetModule(mod_name);
+  if(!module) return false;
+  // Until the key index is built SWORD picks the nearest key, as GetText
+  // does, and the entry is not cached under the key asked for
+  std::string entry_key = key;
+  std::shared_ptr<LexiconIndex> index = search_index.GetLexiconIndex(mod_name);
+  if(index && !index->Find(key, entry_key)) return false;
+  SetDefaultModuleOptions(module);
+  module->setKey(entry_key.c_str());
+  std::string input;
+  {
+    TRACE_SCOPE("sword.renderText");
+    input.assign(module->renderText());
+  }
+  PostProcessHtml(input, html);
+  if(index) lexicon_cache.Put(cache_key, html);
+  return true;
+}
+
+bool SwordBackend::FindLexiconKey(std::string mod_name, std::string key,
+  std::string & entry_key)
+{
+  entry_key = key;
+  std::shared_ptr<LexiconIndex> index = search_index.GetLexiconIndex(mod_name);
+  return !index || index->Find(key, entry_key);
+}
+
+std::vector<LexiconMatch> SwordBackend::FindLexiconKeys(std::string prefix,
+  size_t max_keys, std::vector<std::string> mod_names)
+{
+  TRACE_SCOPE("backend.FindLexiconKeys");
+  std::vector<LexiconMatch> matches;
+  if(FoldLexiconKey(prefix) == "") return matches;
+  if(mod_names.empty()) mod_names = dictionaries;
+  std::vector<std::string> keys;
+  for(const std::string & mod_name : mod_names)
+  {
+    std::shared_ptr<LexiconIndex> index = search_index.GetLexiconIndex(mod_name);
+    if(!index) continue;
+    keys.clear();
+    index->FindPrefix(prefix, max_keys, keys);
+    for(const std::string & key : keys)
+    {
+      matches.push_back(LexiconMatch{mod_name, key});
+    }
+  }
+  return matches;
+}
+
+bool SwordBackend::GetCrossReferences(std::string verse,
+  std::vector<CrossReference> & outgoing, std::vector<CrossReference> & incoming)
+{
+  // Only versification arithmetic is done here; no module is read
+  sword::VerseKey key;
+  key.setText(verse.c_str());
+  if(key.popError()) return false;
+  search_index.GetCrossReferences(CrossRefVerseId(key), outgoing, incoming);
+  for(CrossReference & reference : outgoing)
+  {
+    reference.Verse = CrossRefVerseText(reference.VerseId);
+  }
+  for(CrossReference & reference : incoming)
+  {
+    reference.Verse = CrossRefVerseText(reference.VerseId);
   }
+  return !outgoing.empty() || !incoming.empty();
+}
 
-  return input;
+std::string SwordBackend::RenderCacheKey(sword::SWModule * module)
+{
+  return RenderCacheKey(module, module->getKeyText());
+}
+
+std::string SwordBackend::RenderCacheKey(sword::SWModule * module,
+  const char * key_text)
+{
+  // Module name, normalized key and option filter state, separated by
+  // characters that cannot appear in any of them
+  std::string cache_key(module->getName());
+  cache_key += '\x1f';
+  cache_key += key_text;
+  cache_key += '\x1f';
+  cache_key += ModuleOptionValues(module);
+  return cache_key;
 }
 
 std::string SwordBackend::GetSwordVersion()
@@ -307,18 +1074,21 @@ std::string SwordBackend::GetSwordVersion()
 
 std::string SwordBackend::GetVerseRef(std::string mod_name)
 {
-  sword::SWKey * my_key = (library_mgr.getModule(mod_name.c_str()))->getKey();
+  LibraryMgr::ModuleScope scope(library_mgr);
+  sword::SWKey * my_key = (library_mgr.GetModule(mod_name))->getKey();
   return std::string(my_key->getText());
 }
 
 void SwordBackend::SetVerseRef(std::string mod_name, std::string key)
 {
-  library_mgr.getModule(mod_name.c_str())->setKey(key.c_str());
+  LibraryMgr::ModuleScope scope(library_mgr);
+  library_mgr.GetModule(mod_name)->setKey(key.c_str());
 }
 
 std::string SwordBackend::IncrementVerse(std::string mod_name, int n)
 {
-  sword::SWKey * my_key = (library_mgr.getModule(mod_name.c_str()))->getKey();
+  LibraryMgr::ModuleScope scope(library_mgr);
+  sword::SWKey * my_key = (library_mgr.GetModule(mod_name))->getKey();
   if(n >= 0) my_key->increment(n);
   else my_key->decrement(-1*n);
   return std::string(my_key->getText());
@@ -11,10 +11,26 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <mutex>
+#include <memory>
+#include <map>
 
 #include <swmgr.h>
 #include <installmgr.h>
 
+#include "RenderCache.hpp"
+#include "BlockCache.hpp"
+#include "DirInstallMgr.hpp"
+#include "SearchIndex.hpp"
+#include "LibraryMgr.hpp"
+#include "SourceCatalog.hpp"
+#include "CatalogIndex.hpp"
+#include "VerseStore.hpp"
+#include "VerseTokens.hpp"
+#include "ReferenceParser.hpp"
+#include "ModuleExporter.hpp"
+
 class SwordBackendSettings
 {
   public:
@@ -26,15 +42,14 @@ class SwordBackendSettings
     std::string LibraryDir;
     std::string InstallDir;
     std::string DefaultSource;
-};
-
-struct SwordModuleInfo
-{
-  std::string Name;
-  std::string Type;
-  std::string Language;
-  std::string Description;
-  std::string Version;
+    // Remote catalogs older than this are fetched again
+    int CatalogMaxAgeHours;
+    // Modules transferred at the same time by a batch install
+    int InstallJobs;
+    // Least recently used modules are closed beyond this many open, or
+    // while the process uses more memory than this (0 for no limit)
+    size_t MaxOpenModules;
+    size_t MaxResidentMB;
 };
 
 class SwordBackend
@@ -47,22 +62,144 @@ class SwordBackend
     bool HasInstallerConfig();
     void InitInstallerConfig();
     void AddRemoteSourcesCSV(std::string csv_file_name);
+    void AddLocalSource(std::string src_name, std::string path);
     void InitializeInstaller();
     std::vector<std::string> GetRemoteSources(){ return remote_sources; }
-    void SelectRemoteSource(std::string src_name = "");
-    std::vector<SwordModuleInfo> GetRemoteSourceModules();
+    // Serves the source's cached catalog, fetching it again only when it is
+    // stale (local directory sources: when their configs changed) or forced
+    bool SelectRemoteSource(std::string src_name = "", bool force = false);
+    // Shows the cached catalog without touching the installer, so the UI
+    // can list it while SelectRemoteSource runs in the background
+    bool LoadCachedSourceCatalog(std::string src_name);
+    // The selected source's catalog with its sort and filter index; it is
+    // never changed once published (a refresh publishes a new one), so the
+    // UI can keep the pointer and read it without copying or locking
+    std::shared_ptr<const CatalogIndex> GetRemoteCatalog();
     void InstallRemoteModule(std::string mod_name);
+    // Installs several modules, up to jobs (InstallJobs when 0) at a time,
+    // then registers them together
+    void InstallRemoteModules(std::vector<std::string> mod_names, int jobs = 0);
+    // Installer operations that may run on a worker thread (they never
+    // touch the loaded modules); registration must run on the UI thread
+    bool DownloadRemoteModule(std::string mod_name);
+    // installed gets the modules that were installed, in the order given;
+    // false unless all were
+    bool DownloadRemoteModules(std::vector<std::string> mod_names,
+      std::vector<std::string> & installed, int jobs = 0);
+    // Installed modules that a source offers a newer Version of, from the
+    // cached catalogs of every source (each is read once; sources never
+    // selected have no catalog yet)
+    std::vector<ModuleUpdate> CheckForUpdates();
+    // Reinstalls just those modules from their sources, fetching only the
+    // files that changed (local directory sources); updated gets the
+    // modules downloaded, which must then be registered
+    bool DownloadModuleUpdates(const std::vector<ModuleUpdate> & updates,
+      std::vector<std::string> & updated, int jobs = 0);
+    void UpdateModules(int jobs = 0);
+    // Files copied and skipped by the last install or update
+    TransferStats GetTransferStats();
+    // Moves the downloaded files of the modules named (of every module
+    // downloaded when none are) over the installed ones, with the modules
+    // closed, then adds just those modules (from their own configs) to the
+    // library, or checks every config for changes when none are named
+    void RegisterInstalledModules(
+      std::vector<std::string> mod_names = std::vector<std::string>());
+    void SetInstallProgressCallback(
+      std::function<void(const InstallProgress &)> callback);
+    // Called by RegisterInstalledModules once the modules are in the
+    // library, so workers with readers of their own can reload it
+    void SetLibraryChangedCallback(std::function<void()> callback){ library_changed = callback; }
+    void CancelInstallerOperation();
     // Library Manager
     void InitializeLibrary();
     std::string GetBiblicalText(int n){ return biblical_texts[n]; }
     std::vector<std::string> GetBiblicalTexts(){ return biblical_texts; }
     std::string GetCommentary(int n){ return commentaries[n]; }
     std::vector<std::string> GetCommentaries(){ return commentaries; }
+    std::vector<std::string> GetDictionaries(){ return dictionaries; }
+    const std::vector<CatalogModule> & GetModuleCatalog()
+    {
+      return library_mgr.GetCatalog();
+    }
+    LibraryLoadStats GetLibraryLoadStats(){ return library_mgr.GetLoadStats(); }
+    // Modules are opened on first use and closed again, least recently used
+    // first, beyond the limits
+    void SetResidencyLimits(const ResidencyLimits & limits){ library_mgr.SetResidencyLimits(limits); }
+    ResidencyStats GetResidencyStats(){ return library_mgr.GetResidencyStats(); }
     std::string GetText(std::string key, std::string mod_name);
+    // Ranges and verse lists ("John 3:1-21", "Romans 8; Psalm 23"), rendered
+    // into one page with an anchor per verse; single verses match GetText
+    std::string GetPassage(std::string ref, std::string mod_name);
+    // Typed references, read with the book names and chapter and verse
+    // counts of the module's versification: the canonical key to pass to
+    // GetText or GetPassage, and completions of the text so far
+    ParsedReference ParseReference(std::string text, std::string mod_name);
+    std::vector<std::string> SuggestReferences(std::string text,
+      std::string mod_name, size_t max_suggestions = 10);
+    ReferenceParserStats GetReferenceParserStats();
+    // Pre-renders a Bible into its verse store, which GetText and GetPassage
+    // then read until the module is updated; uses its own reader, so it may
+    // run on a worker thread (the store is picked up at the next
+    // InitializeLibrary)
+    bool ExportVerseStore(std::string mod_name);
+    // Exports Bibles and commentaries (every installed one when none are
+    // named) to static HTML, one file per chapter; uses its own readers, so
+    // it may run on a worker thread
+    bool ExportModules(ExportOptions options, ExportStats & stats,
+      ExportProgress progress = nullptr);
+    // Search (the index is built with separate readers, so updates may run
+    // on a worker thread, and stop early once cancelled returns true)
+    int UpdateSearchIndex(int jobs = 0, bool rebuild = false,
+      const std::function<bool()> & cancelled = nullptr);
+    bool Search(std::string query, std::function<bool(const SearchHit &)> on_hit,
+      std::string & error,
+      std::vector<std::string> mod_names = std::vector<std::string>());
+    bool GetStrongsOccurrences(std::string mod_name, std::string strongs_number,
+      StrongsOccurrences & result, size_t max_verses = SIZE_MAX);
+    // References from and to a verse, from the precomputed graphs
+    bool GetCrossReferences(std::string verse,
+      std::vector<CrossReference> & outgoing,
+      std::vector<CrossReference> & incoming);
+    // Lexicons: keys are matched through each dictionary's key index (built
+    // with the search index), and entries rendered on first use and kept in
+    // a bounded cache
+    // Dictionary for Strong's numbers, testament 'H' or 'G' (StrongsHebrew
+    // or StrongsGreek, else the first with Feature HebrewDef or GreekDef);
+    // empty when none is installed
+    std::string GetStrongsLexicon(char testament);
+    // Entry matching key ("3056" finds "03056"); false when the dictionary
+    // has no such key
+    bool GetLexiconEntry(std::string mod_name, std::string key,
+      std::string & html);
+    // Module key of that entry, for rendering it with another reader (key
+    // itself until the key index is built)
+    bool FindLexiconKey(std::string mod_name, std::string key,
+      std::string & entry_key);
+    // Keys starting with prefix, at most max_keys from each dictionary
+    // (every installed one when mod_names is empty)
+    std::vector<LexiconMatch> FindLexiconKeys(std::string prefix,
+      size_t max_keys = 20,
+      std::vector<std::string> mod_names = std::vector<std::string>());
+    RenderCacheStats GetLexiconCacheStats(){ return lexicon_cache.GetStats(); }
+    // Render Cache
+    RenderCacheStats GetRenderCacheStats(){ return render_cache.GetStats(); }
+    void SetRenderCacheSize(size_t max_bytes){ render_cache.SetMaxBytes(max_bytes); }
+    void ClearRenderCache(){ render_cache.Clear(); }
+    // Decompressed blocks of zText/zCom modules, shared with every reader
+    // in the process (the hover previewer, export and search workers)
+    BlockCacheStats GetBlockCacheStats(){ return SharedBlockCache().GetStats(); }
+    void SetBlockCacheSize(size_t max_bytes){ SharedBlockCache().SetMaxBytes(max_bytes); }
+    void ClearBlockCache(){ SharedBlockCache().Clear(); }
+    // Display options for GetText and GetPassage; OSIS modules re-emit
+    // verses already parsed rather than rendering them again
+    void SetDisplayOptions(const DisplayOptions & options){ display_options = options; }
+    DisplayOptions GetDisplayOptions(){ return display_options; }
+    unsigned long GetVerseTokenHits(){ return token_cache.GetHits(); }
     // Get/Set
     std::string GetInstallDir(){ return install_manager_dir; }
     std::string GetLibraryDir(){ return library_dir; }
     std::string GetDefaultSource(){ return default_source; }
+    void SetCatalogMaxAge(int hours){ catalog_max_age = hours*3600; }
     // Utilities
     std::string GetSwordVersion();
     std::string GetVerseRef(std::string mod_name);
@@ -75,15 +212,57 @@ class SwordBackend
     // Variables
     std::string default_source;
     std::string selected_source;
-    // Local Module Library
-    sword::SWMgr library_mgr;
+    // Local Module Library (modules are opened on first use)
+    LibraryMgr library_mgr;
     std::vector<std::string> biblical_texts;
     std::vector<std::string> commentaries;
     std::vector<std::string> dictionaries;
+    void ListModules();
+    std::function<void()> library_changed;
+    // Rendered Passages
+    VerseStoreSet verse_stores;
+    RenderCache render_cache;
+    RenderCache lexicon_cache;
+    std::string RenderCacheKey(sword::SWModule * module);
+    std::string RenderCacheKey(sword::SWModule * module, const char * key_text);
+    // Display Options
+    DisplayOptions display_options;
+    VerseTokenCache token_cache;
+    bool UsesVerseTokens(sword::SWModule * module);
+    void RenderEntry(sword::SWModule * module, std::string & output);
+    // Reference parsers, one per versification
+    std::map<std::string, std::unique_ptr<ReferenceParser>> reference_parsers;
+    ReferenceParser & GetReferenceParser(std::string mod_name);
+    // Full-text Search
+    SearchIndex search_index;
     // Module Installer
-    sword::InstallMgr install_mgr;
+    InstallStatusReporter install_status;
+    DirInstallMgr install_mgr;
+    std::mutex installer_mutex;
+    std::mutex catalog_mutex;
     std::vector<std::string> remote_sources;
-    std::vector<SwordModuleInfo> remote_module_info_list;
+    // Install managers of the batch install in progress, so it can be
+    // cancelled (guarded by batch_mutex)
+    int install_jobs;
+    std::mutex batch_mutex;
+    std::vector<DirInstallMgr *> batch_install_mgrs;
+    TransferStats transfer_stats;
+    // Downloads go to a library of their own per module (in staging_dir)
+    // and are moved into the real one by RegisterInstalledModules
+    std::string staging_dir;
+    void InitializeStaging();
+    sword::SWMgr * CreateStagingMgr(std::string mod_name);
+    void DiscardStagedModule(std::string mod_name);
+    void CommitStagedModules(std::vector<std::string> mod_names);
+    bool DownloadFromSource(std::string src_name,
+      std::vector<std::string> mod_names, std::vector<std::string> & installed,
+      int jobs);
+    // Catalog of the selected source (swapped in whole under catalog_mutex)
+    std::shared_ptr<const CatalogIndex> remote_catalog;
+    int64_t catalog_max_age;
+    std::string RemoteCatalogFile(std::string src_name);
+    void BuildRemoteCatalog(sword::InstallSource * is, SourceCatalog & catalog);
+    void PublishRemoteCatalog(SourceCatalog catalog);
 };
 
 #endif
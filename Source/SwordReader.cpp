@@ -0,0 +1,243 @@
+// Machaira: SwordReader.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a read-only view of the local module library with its own
+// SWORD manager, so that worker threads can render text without touching
+// the shared SwordBackend (SWMgr and its module keys are not thread-safe)
+// Current version: Pre-release
+
+#include "SwordReader.hpp"
+#include "HtmlPostProcess.hpp"
+#include "Trace.hpp"
+
+#include <iostream>
+#include <memory>
+
+#include <markupfiltmgr.h>
+#include <swoptfilter.h>
+#include <versekey.h>
+
+void ApplyDisplayOptions(sword::SWModule * module,
+  const DisplayOptions & options)
+{
+  bool bible = std::string(module->getType()) == "Biblical Texts";
+  for(sword::OptionFilterList::const_iterator it =
+    module->getOptionFilters().begin();
+    it != module->getOptionFilters().end(); ++it)
+  {
+    std::string name((*it)->getOptionName());
+    bool on = false;
+    if(name == "Strong's Numbers") on = options.StrongsNumbers && bible;
+    else if(name == "Morphological Tags") on = options.Morphology;
+    else if(name == "Footnotes") on = options.Footnotes;
+    else if(name == "Cross-references") on = options.CrossReferences;
+    else if(name == "Headings") on = options.Headings;
+    else if(name == "Words of Christ in Red") on = options.RedLetter;
+    (*it)->setOptionValue(on ? "On" : "Off");
+  }
+}
+
+void SetDefaultModuleOptions(sword::SWModule * module)
+{
+  // Strong's numbers on for Bible texts, every other option off
+  ApplyDisplayOptions(module, DisplayOptions());
+}
+
+std::string ModuleOptionValues(sword::SWModule * module)
+{
+  std::string values;
+  for(sword::OptionFilterList::const_iterator it =
+    module->getOptionFilters().begin();
+    it != module->getOptionFilters().end(); ++it)
+  {
+    values += (*it)->getOptionValue();
+    values += ';';
+  }
+  return values;
+}
+
+bool ParsePassage(sword::SWModule * module, std::string ref,
+  sword::ListKey & passage)
+{
+  // Only verse-keyed modules (Bibles, commentaries) have ranges
+  std::unique_ptr<sword::SWKey> module_key(module->createKey());
+  sword::VerseKey * parser = dynamic_cast<sword::VerseKey *>(module_key.get());
+  if(!parser) return false;
+  parser->setText(module->getKeyText());
+  passage = parser->parseVerseList(ref.c_str(), parser->getText(), true);
+  if(passage.getCount() == 0) return false;
+  sword::VerseKey * first =
+    dynamic_cast<sword::VerseKey *>(passage.getElement(0));
+  if(!first) return false;
+  if(passage.getCount() == 1 && !first->isBoundSet()) return false;
+
+  // The current verse becomes the start of the passage
+  sword::VerseKey start(first->isBoundSet() ? first->getLowerBound() : *first);
+  module->setKey(start);
+  return true;
+}
+
+void RenderPassage(sword::SWModule * module, sword::ListKey & passage,
+  std::string & output,
+  const std::function<void(sword::SWModule *, std::string &)> & render_entry,
+  const std::function<bool()> & cancelled)
+{
+  // Walk each element once, post-processing each verse into a scratch
+  // buffer and appending it after the verse's anchor and label
+  output.clear();
+  std::string verse_html;
+  int book = -1;
+  std::unique_ptr<sword::VerseKey> start;
+  bool stopped = false;
+  for(int n = 0; n < passage.getCount() && !stopped; n++)
+  {
+    sword::VerseKey * element =
+      dynamic_cast<sword::VerseKey *>(passage.getElement(n));
+    if(!element) continue;
+    sword::VerseKey verse(element->isBoundSet() ?
+      element->getLowerBound() : *element);
+    sword::VerseKey last(element->isBoundSet() ?
+      element->getUpperBound() : *element);
+    if(!start) start.reset(new sword::VerseKey(verse));
+    for(; verse.compare(last) <= 0 && !verse.popError(); verse.increment(1))
+    {
+      if(cancelled && cancelled())
+      {
+        stopped = true;
+        break;
+      }
+      module->setKey(verse);
+      if(render_entry) render_entry(module, verse_html);
+      else
+      {
+        std::string raw_text;
+        {
+          TRACE_SCOPE("sword.renderText");
+          raw_text.assign(module->renderText());
+        }
+        PostProcessHtml(raw_text, verse_html);
+      }
+      if(verse.getBook() != book)
+      {
+        // Name the book once per run of verses from it
+        book = verse.getBook();
+        output += "<h3>";
+        output += verse.getBookName();
+        output += "</h3>";
+      }
+      output += "<a name=\"";
+      output += verse.getOSISRef();
+      output += "\"></a><sup>";
+      output += std::to_string(verse.getChapter());
+      output += ':';
+      output += std::to_string(verse.getVerse());
+      output += "</sup> ";
+      output += verse_html;
+      output += '\n';
+    }
+  }
+  if(start) module->setKey(*start);
+}
+
+SwordReader::SwordReader(std::string library_dir) :
+  library_dir(library_dir),
+  library_mgr(library_dir, new sword::MarkupFilterMgr(sword::FMT_XHTML)),
+  verse_stores(library_dir)
+{
+  // The backend keeps the catalog snapshot up to date; readers only use it
+  library_mgr.LoadCatalog(false);
+}
+
+sword::SWModule * SwordReader::GetModule(std::string mod_name)
+{
+  return library_mgr.GetModule(mod_name);
+}
+
+std::vector<std::string> SwordReader::GetModules(std::string type)
+{
+  std::vector<std::string> names;
+  for(const CatalogModule & module : library_mgr.GetCatalog())
+  {
+    if(type == "" || module.Type == type) names.push_back(module.Name);
+  }
+  return names;
+}
+
+std::string SwordReader::GetText(std::string key, std::string mod_name)
+{
+  sword::SWKey myKey(key.c_str());
+  sword::SWModule * module = library_mgr.GetModule(mod_name);
+  if(!module)
+  {
+    std::cout << "Error: Couldn't find module " << mod_name << '\n';
+    return std::string("");
+  }
+  module->setKey(myKey);
+  std::string output;
+  RenderCurrentEntry(module, output);
+  return output;
+}
+
+void SwordReader::RenderCurrentEntry(sword::SWModule * module,
+  std::string & output)
+{
+  // Under other display options, entries that can be parsed are emitted
+  // from their tokens rather than run through SWORD's filters
+  if(!display_options.IsDefault() && HasVerseTokens(module))
+  {
+    TokenizeCurrentEntry(module, tokens);
+    EmitVerseHtml(tokens, display_options, output);
+    return;
+  }
+  ApplyDisplayOptions(module, display_options);
+  const char * stored_text;
+  size_t stored_length;
+  if(verse_stores.GetCurrentEntry(module, stored_text, stored_length))
+  {
+    TRACE_COUNT("verse_store.hits", 1);
+    output.assign(stored_text, stored_length);
+    return;
+  }
+  // Raw buffer is reused between calls to avoid reallocating per verse
+  {
+    TRACE_SCOPE("sword.renderText");
+    raw_text.assign(module->renderText());
+  }
+  PostProcessHtml(raw_text, output);
+}
+
+std::string SwordReader::GetPassage(std::string ref, std::string mod_name,
+  const std::function<bool()> & cancelled)
+{
+  sword::SWModule * module = library_mgr.GetModule(mod_name);
+  sword::ListKey passage;
+  if(!module || !ParsePassage(module, ref, passage))
+  {
+    return GetText(ref, mod_name);
+  }
+  std::string output;
+  RenderPassage(module, passage, output,
+    [this](sword::SWModule * verse_module, std::string & verse_html)
+    {
+      RenderCurrentEntry(verse_module, verse_html);
+    }, cancelled);
+  return output;
+}
+
+std::string SwordReader::GetVerseRef(std::string mod_name)
+{
+  sword::SWKey * my_key = (library_mgr.GetModule(mod_name))->getKey();
+  return std::string(my_key->getText());
+}
+
+void SwordReader::SetVerseRef(std::string mod_name, std::string key)
+{
+  library_mgr.GetModule(mod_name)->setKey(key.c_str());
+}
+
+std::string SwordReader::IncrementVerse(std::string mod_name, int n)
+{
+  sword::SWKey * my_key = (library_mgr.GetModule(mod_name))->getKey();
+  if(n >= 0) my_key->increment(n);
+  else my_key->decrement(-1*n);
+  return std::string(my_key->getText());
+}
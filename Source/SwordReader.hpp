@@ -0,0 +1,78 @@
+// Machaira: SwordReader.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is a read-only view of the local module library with its own
+// SWORD manager, so that worker threads can render text without touching
+// the shared SwordBackend (SWMgr and its module keys are not thread-safe)
+// Current version: Pre-release
+
+#ifndef SWORDREADER_HPP
+#define SWORDREADER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <swmgr.h>
+#include <listkey.h>
+
+#include "LibraryMgr.hpp"
+#include "VerseStore.hpp"
+#include "VerseTokens.hpp"
+
+// Sets the module's option filters for the display options (Strong's
+// numbers only ever for Bible texts, unknown options off)
+void ApplyDisplayOptions(sword::SWModule * module,
+  const DisplayOptions & options);
+// Default option filter values used everywhere modules are rendered
+void SetDefaultModuleOptions(sword::SWModule * module);
+// Current option filter values, in filter order ("On;Off;...")
+std::string ModuleOptionValues(sword::SWModule * module);
+// Parses a range or verse list in the module's versification and moves the
+// module to its first verse; false for a single verse or a module without
+// verse keys, which are rendered as one entry
+bool ParsePassage(sword::SWModule * module, std::string ref,
+  sword::ListKey & passage);
+// Renders every verse of a parsed passage after its anchor and label, each
+// with render_entry (SWORD's output, post-processed, when not given); the
+// module is left at the first verse. Stops before the next verse once
+// cancelled returns true, leaving the output incomplete
+void RenderPassage(sword::SWModule * module, sword::ListKey & passage,
+  std::string & output,
+  const std::function<void(sword::SWModule *, std::string &)> & render_entry =
+    nullptr,
+  const std::function<bool()> & cancelled = nullptr);
+
+class SwordReader
+{
+  public:
+    // Constructor
+    SwordReader(std::string library_dir);
+    // Library
+    sword::SWModule * GetModule(std::string mod_name);
+    std::vector<std::string> GetModules(std::string type);
+    // Text (same output as SwordBackend::GetText, without caching; verses
+    // come from the module's verse store when it has a current one, and
+    // from its parsed entry under non-default display options)
+    std::string GetText(std::string key, std::string mod_name);
+    void RenderCurrentEntry(sword::SWModule * module, std::string & output);
+    // Passage (same output as SwordBackend::GetPassage, without caching);
+    // checks cancelled between verses
+    std::string GetPassage(std::string ref, std::string mod_name,
+      const std::function<bool()> & cancelled = nullptr);
+    // Display options (as set on SwordBackend)
+    void SetDisplayOptions(const DisplayOptions & options){ display_options = options; }
+    DisplayOptions GetDisplayOptions(){ return display_options; }
+    // Utilities
+    std::string GetVerseRef(std::string mod_name);
+    void SetVerseRef(std::string mod_name, std::string key);
+    std::string IncrementVerse(std::string mod_name, int n);
+  private:
+    std::string library_dir;
+    LibraryMgr library_mgr;
+    VerseStoreSet verse_stores;
+    DisplayOptions display_options;
+    std::vector<VerseToken> tokens;
+    std::string raw_text;
+};
+
+#endif
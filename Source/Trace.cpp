@@ -0,0 +1,218 @@
+// Machaira: Trace.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the hot-path instrumentation: scoped timers and counters
+// that are compiled in with MACHAIRA_TRACE and recorded only while tracing
+// is enabled, with a live summary and Chrome trace or CSV export
+// Current version: Pre-release
+
+#include "Trace.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  struct NameLess
+  {
+    bool operator()(const char * a, const char * b) const
+    {
+      return std::strcmp(a, b) < 0;
+    }
+  };
+
+  // Timer events have a duration; counter events carry the running total
+  struct TraceEvent
+  {
+    const char * Name;
+    int64_t StartUs;
+    int64_t DurationUs;
+    int64_t Value;
+    uint32_t Thread;
+    bool Timer;
+  };
+
+  // Events past this many only add to the totals, so a long session keeps
+  // bounded memory (about 40 MB)
+  const size_t max_events = 1 << 20;
+
+  struct TraceState
+  {
+    std::mutex mutex;
+    Tracer::Clock::time_point origin = Tracer::Clock::now();
+    std::map<const char *, TraceStat, NameLess> stats;
+    std::vector<TraceEvent> events;
+    std::map<std::thread::id, uint32_t> threads;
+    uint64_t dropped = 0;
+
+    uint32_t ThreadNumber()
+    {
+      std::map<std::thread::id, uint32_t>::iterator known =
+        threads.find(std::this_thread::get_id());
+      if(known != threads.end()) return known->second;
+      uint32_t number = threads.size() + 1;
+      threads[std::this_thread::get_id()] = number;
+      return number;
+    }
+
+    void AddEvent(const TraceEvent & event)
+    {
+      if(events.size() < max_events) events.push_back(event);
+      else dropped++;
+    }
+  };
+
+  TraceState & State()
+  {
+    static TraceState state;
+    return state;
+  }
+
+  int64_t Microseconds(Tracer::Clock::duration d)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  }
+
+  void AppendJsonString(std::ostream & out, const std::string & s)
+  {
+    out << '"';
+    for(char c : s)
+    {
+      if(c == '"' || c == '\\') out << '\\' << c;
+      else if(static_cast<unsigned char>(c) >= 0x20) out << c;
+    }
+    out << '"';
+  }
+}
+
+std::atomic<bool> Tracer::enabled(false);
+
+void Tracer::Record(const char * name, Clock::time_point start,
+  Clock::time_point end)
+{
+  TraceState & state = State();
+  double ms = std::chrono::duration<double, std::milli>(end - start).count();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  TraceStat & stat = state.stats[name];
+  stat.Count++;
+  stat.TotalMs += ms;
+  stat.MaxMs = std::max(stat.MaxMs, ms);
+  state.AddEvent(TraceEvent{name, Microseconds(start - state.origin),
+    Microseconds(end - start), 0, state.ThreadNumber(), true});
+}
+
+void Tracer::Count(const char * name, int64_t n)
+{
+  TraceState & state = State();
+  Clock::time_point now = Clock::now();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  TraceStat & stat = state.stats[name];
+  stat.Timer = false;
+  stat.Count += n;
+  state.AddEvent(TraceEvent{name, Microseconds(now - state.origin), 0,
+    int64_t(stat.Count), state.ThreadNumber(), false});
+}
+
+void Tracer::Reset()
+{
+  TraceState & state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.stats.clear();
+  state.events.clear();
+  state.dropped = 0;
+  state.origin = Clock::now();
+}
+
+std::vector<TraceStat> Tracer::GetStats()
+{
+  TraceState & state = State();
+  std::vector<TraceStat> stats;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for(const std::pair<const char * const, TraceStat> & entry : state.stats)
+    {
+      stats.push_back(entry.second);
+      stats.back().Name = entry.first;
+    }
+  }
+  std::stable_sort(stats.begin(), stats.end(),
+    [](const TraceStat & a, const TraceStat & b)
+    {
+      if(a.Timer != b.Timer) return a.Timer;
+      return a.TotalMs > b.TotalMs;
+    });
+  return stats;
+}
+
+std::string Tracer::Summary(size_t max_timers)
+{
+  std::stringstream out;
+  out << std::fixed << std::setprecision(2);
+  size_t shown = 0;
+  for(const TraceStat & stat : GetStats())
+  {
+    if(!stat.Timer || shown == max_timers) break;
+    if(shown++ > 0) out << " | ";
+    out << stat.Name << ' ' << stat.TotalMs/stat.Count << " ms x" << stat.Count;
+  }
+  if(shown == 0) return "No timings recorded";
+  return out.str();
+}
+
+bool Tracer::WriteChromeTrace(std::string file_name)
+{
+  std::ofstream out(file_name.c_str());
+  if(!out) return false;
+  TraceState & state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  // Complete ("X") events for timers, counter ("C") events for counters
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  for(size_t n = 0; n < state.events.size(); n++)
+  {
+    const TraceEvent & event = state.events[n];
+    if(n > 0) out << ",\n";
+    out << "{\"name\":";
+    AppendJsonString(out, event.Name);
+    out << ",\"cat\":\"machaira\",\"pid\":1,\"tid\":" << event.Thread <<
+      ",\"ts\":" << event.StartUs;
+    if(event.Timer) out << ",\"ph\":\"X\",\"dur\":" << event.DurationUs << '}';
+    else out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.Value << "}}";
+  }
+  out << "\n],\"otherData\":{\"dropped_events\":" << state.dropped << "}}\n";
+  return bool(out);
+}
+
+bool Tracer::WriteCsv(std::string file_name)
+{
+  std::ofstream out(file_name.c_str());
+  if(!out) return false;
+  out << "name,kind,count,total_ms,mean_ms,max_ms\n";
+  for(const TraceStat & stat : GetStats())
+  {
+    out << stat.Name << ',' << (stat.Timer ? "timer" : "counter") << ',' <<
+      stat.Count;
+    if(stat.Timer)
+    {
+      out << ',' << stat.TotalMs << ',' << stat.TotalMs/stat.Count << ',' <<
+        stat.MaxMs;
+    }
+    else out << ",,,";
+    out << '\n';
+  }
+  return bool(out);
+}
+
+bool Tracer::Write(std::string file_name)
+{
+  if(file_name.size() >= 4 &&
+    file_name.compare(file_name.size() - 4, 4, ".csv") == 0)
+  {
+    return WriteCsv(file_name);
+  }
+  return WriteChromeTrace(file_name);
+}
@@ -0,0 +1,85 @@
+// Machaira: Trace.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the hot-path instrumentation: scoped timers and counters
+// that are compiled in with MACHAIRA_TRACE and recorded only while tracing
+// is enabled, with a live summary and Chrome trace or CSV export
+// Current version: Pre-release
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+struct TraceStat
+{
+  std::string Name;
+  // Timers: calls, total and longest time; counters: the running total in
+  // Count
+  bool Timer = true;
+  uint64_t Count = 0;
+  double TotalMs = 0.0;
+  double MaxMs = 0.0;
+};
+
+class Tracer
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+    // Recording is off until enabled (MACHAIRA_TRACE_FILE enables it at
+    // startup); names must be string literals
+    static void Enable(bool enable){ enabled.store(enable, std::memory_order_relaxed); }
+    static bool IsEnabled(){ return enabled.load(std::memory_order_relaxed); }
+    static void Record(const char * name, Clock::time_point start,
+      Clock::time_point end);
+    static void Count(const char * name, int64_t n = 1);
+    static void Reset();
+    // Totals by name, slowest (total time) first, then counters
+    static std::vector<TraceStat> GetStats();
+    // One line for the status bar: the timers with the most total time
+    static std::string Summary(size_t max_timers = 4);
+    // Every recorded event as Chrome trace JSON (chrome://tracing,
+    // Perfetto), or the totals as CSV
+    static bool WriteChromeTrace(std::string file_name);
+    static bool WriteCsv(std::string file_name);
+    // CSV for *.csv file names, Chrome trace otherwise
+    static bool Write(std::string file_name);
+  private:
+    static std::atomic<bool> enabled;
+};
+
+// Times the enclosing scope when tracing is enabled
+class TraceScope
+{
+  public:
+    explicit TraceScope(const char * name) : name(name), active(Tracer::IsEnabled())
+    {
+      if(active) start = Tracer::Clock::now();
+    }
+    ~TraceScope()
+    {
+      if(active) Tracer::Record(name, start, Tracer::Clock::now());
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope & operator=(const TraceScope &) = delete;
+  private:
+    const char * name;
+    bool active;
+    Tracer::Clock::time_point start;
+};
+
+#ifdef MACHAIRA_TRACE
+  #define TRACE_JOIN_NAME(a, b) a##b
+  #define TRACE_SCOPE_NAME(line) TRACE_JOIN_NAME(trace_scope_, line)
+  #define TRACE_SCOPE(name) TraceScope TRACE_SCOPE_NAME(__LINE__)(name)
+  #define TRACE_COUNT(name, n) \
+    do { if(Tracer::IsEnabled()) Tracer::Count(name, n); } while(0)
+#else
+  #define TRACE_SCOPE(name) ((void)0)
+  #define TRACE_COUNT(name, n) ((void)0)
+#endif
+
+#endif
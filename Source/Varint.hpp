@@ -0,0 +1,36 @@
+// Machaira: Varint.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file has the variable-length integer coding (7 bits per byte, low
+// bits first) shared by the on-disk indexes
+// Current version: Pre-release
+
+#ifndef VARINT_HPP
+#define VARINT_HPP
+
+#include <string>
+#include <cstdint>
+
+inline void WriteVarint(std::string & out, uint32_t value)
+{
+  while(value >= 0x80)
+  {
+    out += char((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += char(value);
+}
+
+inline uint32_t ReadVarint(const unsigned char *& in)
+{
+  uint32_t value = 0;
+  int shift = 0;
+  while(*in & 0x80)
+  {
+    value |= uint32_t(*in++ & 0x7f) << shift;
+    shift += 7;
+  }
+  value |= uint32_t(*in++) << shift;
+  return value;
+}
+
+#endif
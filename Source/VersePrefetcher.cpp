@@ -0,0 +1,165 @@
+// Machaira: VersePrefetcher.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file renders the verses around the current one on a background
+// thread (with its own SWORD manager), so that stepping through a chapter
+// does not wait on SWORD
+// Current version: Pre-release
+
+#include "VersePrefetcher.hpp"
+
+VersePrefetcher::VersePrefetcher(std::string library_dir, int neighbours) :
+  library_dir(library_dir), stopping(false), pending(false), generation(0), neighbours(neighbours),
+  max_pages(256)
+{
+  // Reader is created here, on the caller's thread, because SWORD's global
+  // managers are not safe to initialize from two threads at once
+  reader.reset(new SwordReader(library_dir));
+  worker = std::thread(&VersePrefetcher::Run, this);
+}
+
+VersePrefetcher::~VersePrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  worker.join();
+}
+
+void VersePrefetcher::Request(std::string key, std::vector<std::string> mod_names)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = true;
+    generation++;
+    pending_key = key;
+    pending_mods = mod_names;
+    stats.Requests++;
+  }
+  wake.notify_all();
+}
+
+bool VersePrefetcher::Lookup(std::string key, std::string mod_name,
+  std::string & html)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  stats.Lookups++;
+  auto it = pages.find(PageKey(key, mod_name));
+  if(it == pages.end()) return false;
+  html = it->second;
+  stats.Ready++;
+  return true;
+}
+
+PrefetchStats VersePrefetcher::GetStats()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+void VersePrefetcher::SetNeighbours(int n)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  neighbours = n;
+}
+
+void VersePrefetcher::SetDisplayOptions(const DisplayOptions & options)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if(options == display_options) return;
+  display_options = options;
+  generation++;
+  pages.clear();
+  page_order.clear();
+}
+
+void VersePrefetcher::ReloadLibrary()
+{
+  // Created on the caller's thread, as in the constructor
+  std::unique_ptr<SwordReader> fresh(new SwordReader(library_dir));
+  std::lock_guard<std::mutex> lock(mutex);
+  next_reader.swap(fresh);
+  generation++;
+  pages.clear();
+  page_order.clear();
+}
+
+std::string VersePrefetcher::PageKey(const std::string & key,
+  const std::string & mod_name)
+{
+  return mod_name + '\x1f' + key;
+}
+
+void VersePrefetcher::StorePage(const std::string & page_key,
+  const std::string & html)
+{
+  // Called with the mutex held
+  if(pages.find(page_key) == pages.end()) page_order.push_back(page_key);
+  pages[page_key] = html;
+  stats.PagesRendered++;
+  while(page_order.size() > max_pages)
+  {
+    pages.erase(page_order.front());
+    page_order.pop_front();
+  }
+}
+
+void VersePrefetcher::Run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+  {
+    wake.wait(lock, [this]{ return stopping || pending; });
+    if(stopping) return;
+    pending = false;
+    unsigned long my_generation = generation;
+    std::string key = pending_key;
+    std::vector<std::string> mod_names = pending_mods;
+    int count = neighbours;
+    if(next_reader) reader.swap(next_reader);
+    next_reader.reset();
+    reader->SetDisplayOptions(display_options);
+    lock.unlock();
+
+    // Neighbouring keys come from the first module; the others are
+    // rendered at the same keys, as MainFrame::UpdateWindows does
+    std::vector<std::string> keys;
+    if(mod_names.size() > 0 && reader->GetModule(mod_names[0]))
+    {
+      // Nearest verses first: +1, -1, +2, -2, ...
+      for(int d = 1; d <= count; d++)
+      {
+        for(int sign : {1, -1})
+        {
+          reader->SetVerseRef(mod_names[0], key);
+          std::string neighbour = reader->IncrementVerse(mod_names[0], sign*d);
+          if(neighbour != key) keys.push_back(neighbour);
+        }
+      }
+    }
+
+    bool stale = false;
+    for(size_t n = 0; n < keys.size() && !stale; n++)
+    {
+      for(const std::string & mod_name : mod_names)
+      {
+        if(!reader->GetModule(mod_name)) continue;
+        std::string page_key = PageKey(keys[n], mod_name);
+        lock.lock();
+        // Stop as soon as a newer request arrives
+        stale = stopping || (generation != my_generation);
+        bool have = (pages.find(page_key) != pages.end());
+        lock.unlock();
+        if(stale) break;
+        if(have) continue;
+        std::string html = reader->GetText(keys[n], mod_name);
+        lock.lock();
+        // Pages rendered with options changed since are dropped
+        if(generation == my_generation) StorePage(page_key, html);
+        lock.unlock();
+      }
+    }
+    lock.lock();
+  }
+}
@@ -0,0 +1,77 @@
+// Machaira: VersePrefetcher.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file renders the verses around the current one on a background
+// thread (with its own SWORD manager), so that stepping through a chapter
+// does not wait on SWORD
+// Current version: Pre-release
+
+#ifndef VERSEPREFETCHER_HPP
+#define VERSEPREFETCHER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "SwordReader.hpp"
+
+struct PrefetchStats
+{
+  unsigned long Requests = 0;
+  unsigned long PagesRendered = 0;
+  // Lookups made while navigating, and how many found their page ready
+  unsigned long Lookups = 0;
+  unsigned long Ready = 0;
+};
+
+class VersePrefetcher
+{
+  public:
+    // Constructor
+    VersePrefetcher(std::string library_dir, int neighbours = 3);
+    ~VersePrefetcher();
+    // Render the neighbours of key for each module (first module sets the
+    // verse numbering); replaces any request that has not finished yet
+    void Request(std::string key, std::vector<std::string> mod_names);
+    // Finished pages for the UI thread
+    bool Lookup(std::string key, std::string mod_name, std::string & html);
+    // Get/Set
+    PrefetchStats GetStats();
+    void SetNeighbours(int n);
+    // Drops the finished pages (and any request in progress) when the
+    // options change, since they were rendered with the old ones
+    void SetDisplayOptions(const DisplayOptions & options);
+    // After modules are installed or updated: the finished pages (and any
+    // request in progress) are dropped, and the worker moves to a new
+    // reader, created here, before its next request
+    void ReloadLibrary();
+  private:
+    void Run();
+    std::string PageKey(const std::string & key, const std::string & mod_name);
+    void StorePage(const std::string & page_key, const std::string & html);
+    // Worker state (reader is only used on the worker thread)
+    std::string library_dir;
+    std::unique_ptr<SwordReader> reader;
+    std::unique_ptr<SwordReader> next_reader;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    bool pending;
+    unsigned long generation;
+    std::string pending_key;
+    std::vector<std::string> pending_mods;
+    int neighbours;
+    DisplayOptions display_options;
+    // Finished pages, oldest first in page_order
+    std::map<std::string, std::string> pages;
+    std::deque<std::string> page_order;
+    size_t max_pages;
+    PrefetchStats stats;
+};
+
+#endif
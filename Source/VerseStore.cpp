@@ -0,0 +1,231 @@
+// Machaira: VerseStore.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the pre-rendered verse store of a Bible: every verse as
+// GetText renders it, in a memory-mapped file indexed by verse, so the most
+// read modules are served without SWORD's decompression and filters
+// Current version: Pre-release
+
+#include "VerseStore.hpp"
+#include "HtmlPostProcess.hpp"
+#include "SearchIndex.hpp"
+#include "SwordReader.hpp"
+
+#include <vector>
+#include <filesystem>
+#include <cstring>
+
+#include <versekey.h>
+
+// Store file layout (host byte order):
+//   VerseStoreHeader, stamp, option values and versification texts,
+//   padding to 8 bytes
+//   uint32 offsets[verse_count+1] into the text, then the UTF-8 text of
+//   every verse back to back
+struct VerseStoreHeader
+{
+  char Magic[4];
+  uint32_t Version;
+  uint32_t VerseCount;
+  uint32_t StampLength;
+  uint32_t OptionsLength;
+  uint32_t VersificationLength;
+  uint64_t StampOffset;
+  uint64_t OptionsOffset;
+  uint64_t VersificationOffset;
+  uint64_t OffsetsOffset;
+  uint64_t TextOffset;
+  uint64_t TextSize;
+  uint64_t FileSize;
+};
+
+static const char store_magic[4] = {'M', 'X', 'V', 'S'};
+static const uint32_t store_version = 1;
+
+VerseStore::VerseStore() :
+  verse_count(0), offsets(0), text_data(0), stamp(0), stamp_length(0),
+  options(0), options_length(0), versification(0), versification_length(0)
+{
+}
+
+bool VerseStore::Open(std::string file_name)
+{
+  if(!file.Open(file_name)) return false;
+  if(file.Size() < sizeof(VerseStoreHeader))
+  {
+    file.Close();
+    return false;
+  }
+  const VerseStoreHeader * header =
+    reinterpret_cast<const VerseStoreHeader *>(file.Data());
+  uint64_t offsets_bytes = 4*(uint64_t(header->VerseCount) + 1);
+  if(std::memcmp(header->Magic, store_magic, 4) != 0 ||
+    header->Version != store_version || header->FileSize != file.Size() ||
+    header->StampOffset + header->StampLength > file.Size() ||
+    header->OptionsOffset + header->OptionsLength > file.Size() ||
+    header->VersificationOffset + header->VersificationLength > file.Size() ||
+    header->OffsetsOffset + offsets_bytes > file.Size() ||
+    header->TextOffset + header->TextSize > file.Size())
+  {
+    file.Close();
+    return false;
+  }
+  verse_count = header->VerseCount;
+  offsets = reinterpret_cast<const uint32_t *>(file.Data() +
+    header->OffsetsOffset);
+  // The last offset closes the last verse, so it bounds every range
+  if(offsets[verse_count] > header->TextSize)
+  {
+    file.Close();
+    return false;
+  }
+  text_data = file.Data() + header->TextOffset;
+  stamp = file.Data() + header->StampOffset;
+  stamp_length = header->StampLength;
+  options = file.Data() + header->OptionsOffset;
+  options_length = header->OptionsLength;
+  versification = file.Data() + header->VersificationOffset;
+  versification_length = header->VersificationLength;
+  return true;
+}
+
+std::string VerseStore::GetStamp()
+{
+  if(!stamp) return "";
+  return std::string(stamp, stamp_length);
+}
+
+std::string VerseStore::GetOptions()
+{
+  if(!options) return "";
+  return std::string(options, options_length);
+}
+
+std::string VerseStore::GetVersification()
+{
+  if(!versification) return "";
+  return std::string(versification, versification_length);
+}
+
+bool VerseStore::GetVerse(long verse_index, const char *& text,
+  size_t & length)
+{
+  if(!offsets || verse_index < 0 || verse_index >= long(verse_count))
+  {
+    return false;
+  }
+  uint32_t begin = offsets[verse_index];
+  uint32_t end = offsets[verse_index + 1];
+  if(end < begin) return false;
+  text = text_data + begin;
+  length = end - begin;
+  return true;
+}
+
+std::string VerseStoreFile(std::string library_dir, std::string mod_name)
+{
+  return (std::filesystem::path(library_dir) / "machaira-index" /
+    (mod_name + ".mxv")).string();
+}
+
+bool BuildVerseStore(sword::SWModule * module, std::string stamp,
+  std::string file_name)
+{
+  std::unique_ptr<sword::SWKey> key(module->createKey());
+  sword::VerseKey * verse = dynamic_cast<sword::VerseKey *>(key.get());
+  if(!verse) return false;
+  std::string versification_name(verse->getVersificationSystem());
+  std::string option_values = ModuleOptionValues(module);
+
+  // Every index up to the last verse, so a lookup is one array access;
+  // positions the module's key normalizes elsewhere (headings) stay empty
+  verse->setPosition(BOTTOM);
+  long last = verse->getIndex();
+  std::vector<uint32_t> verse_offsets;
+  verse_offsets.reserve(last + 2);
+  std::string text;
+  std::string raw_text;
+  std::string html;
+  for(long n = 0; n <= last; n++)
+  {
+    verse_offsets.push_back(text.size());
+    verse->setIndex(n);
+    if(verse->popError()) continue;
+    module->setKey(*verse);
+    if(module->getKey()->getIndex() != n) continue;
+    raw_text.assign(module->renderText());
+    PostProcessHtml(raw_text, html);
+    text += html;
+    if(text.size() > UINT32_MAX) return false;
+  }
+  verse_offsets.push_back(text.size());
+
+  auto pad = [](std::string & out)
+  {
+    while(out.size() % 8) out += '\0';
+  };
+  VerseStoreHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, store_magic, 4);
+  header.Version = store_version;
+  header.VerseCount = verse_offsets.size() - 1;
+  header.StampLength = stamp.size();
+  header.OptionsLength = option_values.size();
+  header.VersificationLength = versification_name.size();
+
+  std::string body(sizeof(VerseStoreHeader), '\0');
+  header.StampOffset = body.size();
+  body += stamp;
+  header.OptionsOffset = body.size();
+  body += option_values;
+  header.VersificationOffset = body.size();
+  body += versification_name;
+  pad(body);
+  header.OffsetsOffset = body.size();
+  body.append(reinterpret_cast<const char *>(verse_offsets.data()),
+    4*verse_offsets.size());
+  header.TextOffset = body.size();
+  header.TextSize = text.size();
+  body += text;
+  header.FileSize = body.size();
+  std::memcpy(&body[0], &header, sizeof(header));
+
+  return ReplaceFileContents(file_name, body);
+}
+
+VerseStoreSet::VerseStoreSet(std::string library_dir) :
+  library_dir(library_dir)
+{
+}
+
+VerseStore * VerseStoreSet::GetStore(sword::SWModule * module)
+{
+  std::string mod_name(module->getName());
+  std::map<std::string, std::unique_ptr<VerseStore>>::iterator known =
+    stores.find(mod_name);
+  if(known != stores.end()) return known->second.get();
+
+  // Checked once: a store older than the installed module (or written for
+  // another versification) is ignored until the next Clear
+  std::unique_ptr<VerseStore> store(new VerseStore());
+  sword::VerseKey * verse = dynamic_cast<sword::VerseKey *>(module->getKey());
+  if(!verse || !store->Open(VerseStoreFile(library_dir, mod_name)) ||
+    store->GetVersification() != verse->getVersificationSystem() ||
+    store->GetStamp() != ModuleIndexStamp(library_dir, module))
+  {
+    store.reset();
+  }
+  VerseStore * result = store.get();
+  stores[mod_name] = std::move(store);
+  return result;
+}
+
+bool VerseStoreSet::GetCurrentEntry(sword::SWModule * module,
+  const char *& text, size_t & length)
+{
+  VerseStore * store = GetStore(module);
+  if(!store) return false;
+  // Verses rendered with other option values (Strong's numbers, footnotes)
+  // come from SWORD
+  if(store->GetOptions() != ModuleOptionValues(module)) return false;
+  return store->GetVerse(module->getKey()->getIndex(), text, length);
+}
@@ -0,0 +1,75 @@
+// Machaira: VerseStore.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the pre-rendered verse store of a Bible: every verse as
+// GetText renders it, in a memory-mapped file indexed by verse, so the most
+// read modules are served without SWORD's decompression and filters
+// Current version: Pre-release
+
+#ifndef VERSESTORE_HPP
+#define VERSESTORE_HPP
+
+#include <string>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+#include <swmodule.h>
+
+#include "MappedFile.hpp"
+
+class VerseStore
+{
+  public:
+    // Constructor
+    VerseStore();
+    bool Open(std::string file_name);
+    std::string GetStamp();
+    // Option filter values the verses were rendered with
+    std::string GetOptions();
+    std::string GetVersification();
+    uint32_t GetVerseCount(){ return verse_count; }
+    // Rendered verse by its index in the module's versification; the text
+    // points into the mapped file
+    bool GetVerse(long verse_index, const char *& text, size_t & length);
+  private:
+    MappedFile file;
+    uint32_t verse_count;
+    const uint32_t * offsets;
+    const char * text_data;
+    const char * stamp;
+    uint32_t stamp_length;
+    const char * options;
+    uint32_t options_length;
+    const char * versification;
+    uint32_t versification_length;
+};
+
+// Store file of a module (in the library's machaira-index directory)
+std::string VerseStoreFile(std::string library_dir, std::string mod_name);
+// Renders every verse of a Bible with its current option values and writes
+// its store (to a temporary name, then renamed); false for other modules
+bool BuildVerseStore(sword::SWModule * module, std::string stamp,
+  std::string file_name);
+
+// The stores of one library, opened when a module is first looked up and
+// kept only when they match the installed module (ModuleIndexStamp); a
+// missing or stale store means the module is rendered by SWORD
+class VerseStoreSet
+{
+  public:
+    // Constructor
+    VerseStoreSet(std::string library_dir);
+    // Rendered text of the module's current verse, when its store is current
+    // and was rendered with the module's present option values
+    bool GetCurrentEntry(sword::SWModule * module, const char *& text,
+      size_t & length);
+    VerseStore * GetStore(sword::SWModule * module);
+    // Forgets every store (after modules are installed or stores rebuilt)
+    void Clear(){ stores.clear(); }
+  private:
+    std::string library_dir;
+    // Null entries are modules without a usable store
+    std::map<std::string, std::unique_ptr<VerseStore>> stores;
+};
+
+#endif
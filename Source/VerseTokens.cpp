@@ -0,0 +1,347 @@
+// Machaira: VerseTokens.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the structured form of a verse: the words of an OSIS entry
+// with their Strong's numbers and morphology, notes, cross-references and
+// headings, parsed once and emitted as HTML for any set of display options
+// Current version: Pre-release
+
+#include "VerseTokens.hpp"
+#include "HtmlPostProcess.hpp"
+#include "Trace.hpp"
+
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  // Name of the element in a tag ("<w lemma=...>" is "w", "</q>" is "q")
+  std::string TagName(const std::string & tag)
+  {
+    size_t p = (tag.size() > 1 && tag[1] == '/') ? 2 : 1;
+    size_t q = tag.find_first_of(" \t\r\n/>", p);
+    return tag.substr(p, q - p);
+  }
+
+  std::string TagAttribute(const std::string & tag, const char * attribute)
+  {
+    std::string marker = std::string(" ") + attribute + "=\"";
+    size_t p = tag.find(marker);
+    if(p == std::string::npos) return "";
+    p += marker.size();
+    size_t q = tag.find('"', p);
+    if(q == std::string::npos) return "";
+    return tag.substr(p, q - p);
+  }
+
+  // Text of an element's content with any markup inside it dropped
+  std::string StripTags(const std::string & content)
+  {
+    std::string text;
+    bool in_tag = false;
+    for(char c : content)
+    {
+      if(c == '<') in_tag = true;
+      else if(c == '>') in_tag = false;
+      else if(!in_tag) text += c;
+    }
+    return text;
+  }
+
+  // Content of the element opened just before pos; pos moves past its end
+  // tag (or to the end of the entry when it is not closed)
+  std::string ElementContent(const std::string & raw, size_t & pos,
+    const char * end_tag)
+  {
+    size_t end = raw.find(end_tag, pos);
+    if(end == std::string::npos) end = raw.size();
+    std::string content = raw.substr(pos, end - pos);
+    pos = std::min(raw.size(), end + std::strlen(end_tag));
+    return content;
+  }
+
+  // Values of a space-separated attribute after their "scheme:" prefix
+  void AttributeValues(const std::string & value, const char * scheme,
+    std::vector<std::string> & values)
+  {
+    std::stringstream ss(value);
+    std::string item;
+    size_t scheme_length = scheme ? std::strlen(scheme) : 0;
+    while(ss >> item)
+    {
+      if(scheme)
+      {
+        if(item.compare(0, scheme_length, scheme) != 0) continue;
+        item = item.substr(scheme_length);
+      }
+      else if(item.find(':') != std::string::npos)
+      {
+        item = item.substr(item.find(':') + 1);
+      }
+      if(item != "") values.push_back(item);
+    }
+  }
+
+  void AppendText(std::vector<VerseToken> & tokens, const std::string & raw,
+    size_t begin, size_t end, bool red_letter)
+  {
+    if(end <= begin) return;
+    // Runs of text between markup are joined
+    if(!tokens.empty() && tokens.back().Type == TOKEN_Text &&
+      tokens.back().RedLetter == red_letter)
+    {
+      tokens.back().Text.append(raw, begin, end - begin);
+      return;
+    }
+    VerseToken token;
+    token.Type = TOKEN_Text;
+    token.Text.assign(raw, begin, end - begin);
+    token.RedLetter = red_letter;
+    tokens.push_back(token);
+  }
+
+  void AppendText(const std::string & text, std::string & output)
+  {
+    AppendEncodedHtml(text.data(), text.data() + text.size(), output);
+  }
+
+  void AppendReferenceLink(const VerseToken & token, std::string & output)
+  {
+    output += "<a href=\"showRef_scripRef_";
+    output += token.Ref;
+    output += "\">";
+    AppendText(token.Text, output);
+    output += "</a>";
+  }
+}
+
+bool DisplayOptions::operator==(const DisplayOptions & other) const
+{
+  return StrongsNumbers == other.StrongsNumbers &&
+    Morphology == other.Morphology && Footnotes == other.Footnotes &&
+    CrossReferences == other.CrossReferences && Headings == other.Headings &&
+    RedLetter == other.RedLetter;
+}
+
+bool HasVerseTokens(sword::SWModule * module)
+{
+  const char * source_type = module->getConfigEntry("SourceType");
+  return source_type && std::string(source_type) == "OSIS";
+}
+
+void TokenizeCurrentEntry(sword::SWModule * module,
+  std::vector<VerseToken> & tokens)
+{
+  TRACE_SCOPE("tokens.Tokenize");
+  TokenizeOsis(std::string(module->getRawEntry()), tokens);
+}
+
+void TokenizeOsis(const std::string & raw, std::vector<VerseToken> & tokens)
+{
+  tokens.clear();
+  // Red-letter state of each open <q> (containers and milestones)
+  std::vector<bool> quotes;
+  bool red_letter = false;
+  size_t pos = 0;
+  while(pos < raw.size())
+  {
+    size_t tag_begin = raw.find('<', pos);
+    if(tag_begin == std::string::npos) tag_begin = raw.size();
+    AppendText(tokens, raw, pos, tag_begin, red_letter);
+    if(tag_begin == raw.size()) break;
+    size_t tag_end = raw.find('>', tag_begin);
+    if(tag_end == std::string::npos) break;
+    std::string tag = raw.substr(tag_begin, tag_end - tag_begin + 1);
+    std::string name = TagName(tag);
+    bool closing = tag[1] == '/';
+    bool empty = tag.size() > 2 && tag[tag.size() - 2] == '/';
+    pos = tag_end + 1;
+
+    VerseToken token;
+    token.RedLetter = red_letter;
+    if(name == "w" && !closing && !empty)
+    {
+      token.Type = TOKEN_Word;
+      token.Text = StripTags(ElementContent(raw, pos, "</w>"));
+      AttributeValues(TagAttribute(tag, "lemma"), "strong:", token.Strongs);
+      AttributeValues(TagAttribute(tag, "morph"), 0, token.Morph);
+      tokens.push_back(token);
+    }
+    else if(name == "note" && !closing && !empty)
+    {
+      std::string content = ElementContent(raw, pos, "</note>");
+      if(TagAttribute(tag, "type") != "crossReference")
+      {
+        token.Type = TOKEN_Note;
+        token.Text = StripTags(content);
+        tokens.push_back(token);
+        continue;
+      }
+      // Each reference of a cross-reference note is its own link
+      size_t p = 0;
+      while((p = content.find("<reference", p)) != std::string::npos)
+      {
+        size_t q = content.find('>', p);
+        if(q == std::string::npos) break;
+        std::string reference_tag = content.substr(p, q - p + 1);
+        size_t content_begin = q + 1;
+        std::string text = StripTags(ElementContent(content, content_begin,
+          "</reference>"));
+        token.Type = TOKEN_CrossRef;
+        token.Ref = TagAttribute(reference_tag, "osisRef");
+        token.Text = text;
+        if(token.Ref == "") token.Ref = text;
+        tokens.push_back(token);
+        p = content_begin;
+      }
+    }
+    else if(name == "reference" && !closing && !empty)
+    {
+      token.Type = TOKEN_Reference;
+      token.Text = StripTags(ElementContent(raw, pos, "</reference>"));
+      token.Ref = TagAttribute(tag, "osisRef");
+      if(token.Ref == "") token.Ref = token.Text;
+      tokens.push_back(token);
+    }
+    else if(name == "title" && !closing && !empty)
+    {
+      token.Type = TOKEN_Heading;
+      token.Text = StripTags(ElementContent(raw, pos, "</title>"));
+      tokens.push_back(token);
+    }
+    else if(name == "q")
+    {
+      bool jesus = TagAttribute(tag, "who") == "Jesus";
+      if(closing || (empty && TagAttribute(tag, "eID") != ""))
+      {
+        if(!quotes.empty()) quotes.pop_back();
+      }
+      else if(!empty || TagAttribute(tag, "sID") != "") quotes.push_back(jesus);
+      red_letter = false;
+      for(bool quote : quotes) red_letter = red_letter || quote;
+    }
+    else if(name == "lb" || (closing && (name == "p" || name == "div")))
+    {
+      if(!tokens.empty() && tokens.back().Type != TOKEN_Break)
+      {
+        token.Type = TOKEN_Break;
+        tokens.push_back(token);
+      }
+    }
+    // Any other markup is dropped and its text kept
+  }
+}
+
+void EmitVerseHtml(const std::vector<VerseToken> & tokens,
+  const DisplayOptions & options, std::string & output)
+{
+  TRACE_SCOPE("tokens.EmitVerseHtml");
+  output.clear();
+  bool red_open = false;
+  for(const VerseToken & token : tokens)
+  {
+    bool red = options.RedLetter && token.RedLetter &&
+      (token.Type == TOKEN_Text || token.Type == TOKEN_Word);
+    if(red != red_open)
+    {
+      output += red ? "<font color=\"red\">" : "</font>";
+      red_open = red;
+    }
+    switch(token.Type)
+    {
+      case TOKEN_Text:
+        AppendText(token.Text, output);
+        break;
+      case TOKEN_Word:
+        AppendText(token.Text, output);
+        if(options.StrongsNumbers)
+        {
+          for(const std::string & number : token.Strongs)
+          {
+            if(number.size() < 2) continue;
+            std::string value = number.substr(1);
+            output += " <small><em>&lt;<a href=\"showStrongs_";
+            output += (number[0] == 'H') ? "Hebrew" : "Greek";
+            output += '_';
+            output += value;
+            output += "\">";
+            output += value;
+            output += "</a>&gt;</em></small>";
+          }
+        }
+        if(options.Morphology)
+        {
+          for(const std::string & code : token.Morph)
+          {
+            output += " <small><em>(";
+            AppendText(code, output);
+            output += ")</em></small>";
+          }
+        }
+        break;
+      case TOKEN_Note:
+        if(!options.Footnotes) break;
+        output += " <small>[";
+        AppendText(token.Text, output);
+        output += "]</small>";
+        break;
+      case TOKEN_CrossRef:
+        if(!options.CrossReferences) break;
+        output += " <small>[";
+        AppendReferenceLink(token, output);
+        output += "]</small>";
+        break;
+      case TOKEN_Reference:
+        AppendReferenceLink(token, output);
+        break;
+      case TOKEN_Heading:
+        if(!options.Headings) break;
+        output += "<h3>";
+        AppendText(token.Text, output);
+        output += "</h3>";
+        break;
+      case TOKEN_Break:
+        output += "<br>";
+        break;
+    }
+  }
+  if(red_open) output += "</font>";
+}
+
+VerseTokenCache::VerseTokenCache(size_t max_verses) :
+  max_verses(max_verses), hits(0), misses(0)
+{
+}
+
+const std::vector<VerseToken> & VerseTokenCache::Get(sword::SWModule * module)
+{
+  std::string key(module->getName());
+  key += '\x1f';
+  key += module->getKeyText();
+  std::map<std::string, std::unique_ptr<std::vector<VerseToken>>>::iterator
+    known = verses.find(key);
+  if(known != verses.end())
+  {
+    hits++;
+    return *known->second;
+  }
+  misses++;
+  std::unique_ptr<std::vector<VerseToken>> tokens(new std::vector<VerseToken>());
+  TokenizeCurrentEntry(module, *tokens);
+  // Oldest verses are dropped first
+  while(verse_order.size() >= max_verses && !verse_order.empty())
+  {
+    verses.erase(verse_order.front());
+    verse_order.pop_front();
+  }
+  verse_order.push_back(key);
+  std::vector<VerseToken> & result = *tokens;
+  verses[key] = std::move(tokens);
+  return result;
+}
+
+void VerseTokenCache::Clear()
+{
+  verses.clear();
+  verse_order.clear();
+}
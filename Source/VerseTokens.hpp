@@ -0,0 +1,93 @@
+// Machaira: VerseTokens.hpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the structured form of a verse: the words of an OSIS entry
+// with their Strong's numbers and morphology, notes, cross-references and
+// headings, parsed once and emitted as HTML for any set of display options
+// Current version: Pre-release
+
+#ifndef VERSETOKENS_HPP
+#define VERSETOKENS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+
+#include <swmodule.h>
+
+enum VerseTokenType
+{
+  TOKEN_Text = 0,
+  TOKEN_Word = 1,
+  // Footnote, shown with Footnotes on
+  TOKEN_Note = 2,
+  // Reference inside a cross-reference note, shown with Cross-references on
+  TOKEN_CrossRef = 3,
+  // Reference in the running text (commentaries), always shown
+  TOKEN_Reference = 4,
+  TOKEN_Heading = 5,
+  TOKEN_Break = 6
+};
+
+struct VerseToken
+{
+  VerseTokenType Type = TOKEN_Text;
+  // Text as found in the entry (UTF-8, XML entities kept)
+  std::string Text;
+  // Words: Strong's numbers ("G3056", "H07225") and morphology codes
+  std::vector<std::string> Strongs;
+  std::vector<std::string> Morph;
+  // References: the OSIS reference linked to
+  std::string Ref;
+  // Inside words of Christ
+  bool RedLetter = false;
+};
+
+// Display options shared by every module; the defaults are the options
+// modules have always been rendered with
+struct DisplayOptions
+{
+  bool StrongsNumbers = true;
+  bool Morphology = false;
+  bool Footnotes = false;
+  bool CrossReferences = false;
+  bool Headings = false;
+  bool RedLetter = false;
+  bool operator==(const DisplayOptions & other) const;
+  bool operator!=(const DisplayOptions & other) const { return !(*this == other); }
+  bool IsDefault() const { return *this == DisplayOptions(); }
+};
+
+// Entries that can be tokenized (OSIS source)
+bool HasVerseTokens(sword::SWModule * module);
+// Parses the module's current raw entry (no SWORD filters are run)
+void TokenizeCurrentEntry(sword::SWModule * module,
+  std::vector<VerseToken> & tokens);
+void TokenizeOsis(const std::string & raw, std::vector<VerseToken> & tokens);
+// HTML for the tokens under the options, entity-encoded and with links in
+// the UI's action_type_value form, like PostProcessHtml output
+void EmitVerseHtml(const std::vector<VerseToken> & tokens,
+  const DisplayOptions & options, std::string & output);
+
+// Tokens of recently shown verses, so that changing options re-emits them
+// instead of reading the module again
+class VerseTokenCache
+{
+  public:
+    // Constructor
+    VerseTokenCache(size_t max_verses = 4096);
+    // Tokens of the module's current entry, parsed on first use
+    const std::vector<VerseToken> & Get(sword::SWModule * module);
+    void Clear();
+    unsigned long GetHits(){ return hits; }
+    unsigned long GetMisses(){ return misses; }
+  private:
+    size_t max_verses;
+    std::map<std::string, std::unique_ptr<std::vector<VerseToken>>> verses;
+    std::deque<std::string> verse_order;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+#endif
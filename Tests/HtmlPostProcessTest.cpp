@@ -0,0 +1,93 @@
+// Machaira: HtmlPostProcessTest.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the machaira_tests program, which checks PostProcessHtml
+// byte for byte against the golden outputs in Tests/Golden
+// Current version: Pre-release
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "HtmlPostProcess.hpp"
+
+// Each NAME.in holds rendered SWORD output and NAME.html what GetText
+// must make of it. The expected outputs were captured from the original
+// multi-pass GetText code (wstring_convert, then erase/insert per link).
+// That code threw on invalid UTF-8 and on a link cut short before its
+// "action=" could be reached, so invalid_utf8, invalid_utf8_link,
+// link_bare and link_unterminated_first hold the replacement behaviour
+// instead: U+FFFD for each bad byte, and the link left as it is.
+
+std::string ReadFile(const std::filesystem::path & path)
+{
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+// Position of the first differing byte, or npos if equal
+size_t FirstDifference(const std::string & a, const std::string & b)
+{
+  size_t n = std::mismatch(a.begin(), a.begin() + std::min(a.size(), b.size()),
+    b.begin()).first - a.begin();
+  if(n == a.size() && n == b.size()) return std::string::npos;
+  return n;
+}
+
+int main(int argc, char ** argv)
+{
+  if(argc != 2)
+  {
+    std::cout << "Usage: machaira_tests GOLDEN_DIR" << std::endl;
+    return 1;
+  }
+  std::filesystem::path golden_dir = std::filesystem::path(argv[1]) / "HtmlPostProcess";
+  std::vector<std::filesystem::path> inputs;
+  std::error_code ec;
+  for(auto & entry : std::filesystem::directory_iterator(golden_dir, ec))
+  {
+    if(entry.path().extension() == ".in") inputs.push_back(entry.path());
+  }
+  std::sort(inputs.begin(), inputs.end());
+  if(inputs.empty())
+  {
+    std::cout << "Error: no golden inputs in " << golden_dir.string() << std::endl;
+    return 1;
+  }
+
+  int failures = 0;
+  // Reused between cases, as GetText callers do
+  std::string reused = "stale output";
+  for(auto & input_path : inputs)
+  {
+    std::filesystem::path expected_path = input_path;
+    expected_path.replace_extension(".html");
+    std::string name = input_path.stem().string();
+    if(!std::filesystem::exists(expected_path))
+    {
+      std::cout << "Error: " << name << ": missing " << expected_path.string() << std::endl;
+      failures++;
+      continue;
+    }
+    std::string input = ReadFile(input_path);
+    std::string expected = ReadFile(expected_path);
+
+    std::string output = PostProcessHtml(input);
+    PostProcessHtml(input, reused);
+    size_t diff = FirstDifference(output, expected);
+    if(diff == std::string::npos) diff = FirstDifference(reused, expected);
+    if(diff != std::string::npos)
+    {
+      std::cout << "Error: " << name << ": output differs from the golden at byte "
+        << diff << std::endl;
+      failures++;
+    }
+    else std::cout << "ok " << name << std::endl;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+// Machaira: SourceCatalogTest.cpp
+// GUI viewer for SWORD Project files using wxWidgets
+// This file is the machaira_catalog_test program, which checks that a local
+// directory source's cached catalog is served while its configs are
+// unchanged and fetched again once a config is added or edited
+// Current version: Pre-release
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <memory>
+
+#include "SwordBackend.hpp"
+#include "BenchFixture.hpp"
+
+// Selects the source and checks whether its catalog was fetched
+bool CheckSelect(SwordBackend & backend, std::string src_name,
+  bool expect_downloaded, std::string step)
+{
+  if(!backend.SelectRemoteSource(src_name))
+  {
+    std::cout << "Error: " << step << ": couldn't select " << src_name << std::endl;
+    return false;
+  }
+  bool downloaded = backend.GetRemoteCatalog()->GetCatalog().Downloaded;
+  if(downloaded != expect_downloaded)
+  {
+    std::cout << "Error: " << step << ": the catalog was "
+      << (downloaded ? "fetched" : "served from the cache") << std::endl;
+    return false;
+  }
+  std::cout << "ok " << step << std::endl;
+  return true;
+}
+
+// Version the selected source's catalog lists for a module ("" if missing)
+std::string CatalogVersion(SwordBackend & backend, std::string mod_name)
+{
+  std::shared_ptr<const CatalogIndex> catalog = backend.GetRemoteCatalog();
+  long m = catalog->Find(mod_name);
+  if(m < 0) return "";
+  return catalog->GetModules()[m].Version;
+}
+
+int main(int argc, char ** argv)
+{
+  if(argc != 3)
+  {
+    std::cout << "Usage: machaira_catalog_test FIXTURE_DIR WORK_DIR" << std::endl;
+    return 1;
+  }
+  BenchFixture fixture;
+  if(!BuildBenchFixture(argv[1], argv[2], 20, fixture)) return 1;
+
+  SwordBackendSettings settings;
+  settings.LibraryDir = fixture.LibraryDir;
+  settings.InstallDir = fixture.InstallDir;
+  settings.DefaultSource = "TestCatalog";
+  SwordBackend backend(settings);
+  backend.AddLocalSource("TestCatalog", fixture.CatalogDir);
+  std::filesystem::path mods_dir = std::filesystem::path(fixture.CatalogDir) / "mods.d";
+
+  // No cache yet, then the cache of an unchanged source
+  if(!CheckSelect(backend, "TestCatalog", true, "first select")) return 1;
+  if(!CheckSelect(backend, "TestCatalog", false, "unchanged source")) return 1;
+
+  // A module added to the source
+  {
+    std::ofstream conf((mods_dir / "machcatalogadded.conf").string());
+    conf << "[MachCatalogAdded]\nDataPath=./modules/texts/rawtext/machcatalogadded/\n"
+      << "ModDrv=RawText\nLang=en\nVersion=1.0\nDescription=Added module\n";
+  }
+  if(!CheckSelect(backend, "TestCatalog", true, "added config")) return 1;
+  if(CatalogVersion(backend, "MachCatalogAdded") != "1.0")
+  {
+    std::cout << "Error: added config: MachCatalogAdded is not in the catalog"
+      << std::endl;
+    return 1;
+  }
+  if(!CheckSelect(backend, "TestCatalog", false, "unchanged after adding")) return 1;
+
+  // A module's config edited (the size changes, so the check doesn't rely
+  // on the file time moving)
+  {
+    std::filesystem::path conf_path = mods_dir / "machcatalog0000.conf";
+    std::ifstream old_conf(conf_path.string());
+    std::stringstream body;
+    body << old_conf.rdbuf();
+    old_conf.close();
+    std::string text = body.str();
+    size_t version = text.find("Version=");
+    if(version == std::string::npos)
+    {
+      std::cout << "Error: " << conf_path.string() << " has no Version" << std::endl;
+      return 1;
+    }
+    text.replace(version, text.find('\n', version) - version, "Version=10.0.1");
+    std::ofstream new_conf(conf_path.string());
+    new_conf << text;
+  }
+  if(!CheckSelect(backend, "TestCatalog", true, "edited config")) return 1;
+  if(CatalogVersion(backend, "MachCatalog0000") != "10.0.1")
+  {
+    std::cout << "Error: edited config: MachCatalog0000 still has version "
+      << CatalogVersion(backend, "MachCatalog0000") << std::endl;
+    return 1;
+  }
+  if(!CheckSelect(backend, "TestCatalog", false, "unchanged after editing")) return 1;
+  return 0;
+}